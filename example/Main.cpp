@@ -2,9 +2,13 @@
 
 #include<iostream>
 #include<array>
+#include<stdexcept>
+#include<string>
 
 #include<glm/vec2.hpp>
 
+using namespace rut::literals;
+
 struct Vertex
 {
     glm::vec2 position;
@@ -55,6 +59,17 @@ static const std::string FRAGMENT_SOURCE = R"(
     }
 )";
 
+static const rut::UniformBindingProperties &FindUniformBinding(const rut::ShaderProgramProperties &props, uint32_t binding)
+{
+    for (const auto &uniform_binding : props.uniform_bindings)
+    {
+        if (uniform_binding.binding == binding)
+            return uniform_binding;
+    }
+
+    throw std::runtime_error("Shader has no uniform block at binding " + std::to_string(binding));
+}
+
 class Application
 {
 public:
@@ -76,36 +91,29 @@ public:
                 { "position", rut::VT_FVEC2 }
             }
         );
-        m_mesh->SetVertices(VERTICES.size(), VERTICES.data());
+
+        // Welds the duplicate corners of the quad into an indexed mesh
+        rut::MeshOptimizer optimizer(m_mesh->GetLayout());
+        optimizer.Optimize(VERTICES.size(), VERTICES.data());
+        optimizer.Upload(m_mesh.get());
+
+        const rut::MeshOptimizerStats &mesh_stats = optimizer.GetStats();
+        std::cout << "Mesh vertices: " << mesh_stats.vertices_before << " -> " << mesh_stats.vertices_after << ", ACMR: " << mesh_stats.acmr_before << " -> " << mesh_stats.acmr_after << std::endl;
 
         // Setup shader
         rut::ShaderProgramCreateProperties shader_props;
         shader_props.vertex_shader = rut::ShaderUnit::Create(m_window->GetContext(), rut::ST_VERTEX, VERTEX_SOURCE);
         shader_props.fragment_shader = rut::ShaderUnit::Create(m_window->GetContext(), rut::ST_FRAGMENT, FRAGMENT_SOURCE);
-        shader_props.props.input_layout =
-        {
-            { "position", rut::VT_FVEC2 }
-        };
-        shader_props.props.uniform_bindings =
-        {
-            { 0, "VertexUniforms", rut::ST_VERTEX, { { "projection", rut::VT_MAT4 } } },
-            { 1, "FragUniforms", rut::ST_FRAGMENT, { { "color", rut::VT_FVEC3 } } }
-        };
 
+        // Input and uniform layouts are reflected from the shaders
         m_shader = rut::ShaderProgram::Create(m_window->GetContext(), shader_props);
 
         // Setup uniform buffers
-        m_vertex_ub = rut::UniformBuffer::Create(m_window->GetContext(), 
-            {
-                { "projection", rut::VT_MAT4 }
-            }
-        );
-
-        m_fragment_ub = rut::UniformBuffer::Create(m_window->GetContext(), 
-            {
-                { "color", rut::VT_FVEC3 }
-            }
-        );
+        const rut::ShaderProgramProperties &program_props = m_shader->GetProperties();
+        m_vertex_ub = rut::UniformBuffer::Create(m_window->GetContext(), FindUniformBinding(program_props, 0).layout);
+        m_fragment_ub = rut::UniformBuffer::Create(m_window->GetContext(), FindUniformBinding(program_props, 1).layout);
+        m_projection_handle = m_vertex_ub->GetVariableHandle("projection"_uniform);
+        m_color_handle = m_fragment_ub->GetVariableHandle("color"_uniform);
 
         m_shader->BindUniformBuffer(0, m_vertex_ub);
         m_shader->BindUniformBuffer(1, m_fragment_ub);
@@ -133,11 +141,11 @@ public:
 
         // Upload uniform data
         m_vertex_ub->Map();
-        m_vertex_ub->SetVariable("projection", rut::CreateOrthoProjection(-1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 1.0f));
+        m_vertex_ub->SetVariable(m_projection_handle, rut::CreateOrthoProjection(-1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 1.0f));
         m_vertex_ub->Unmap();
 
         m_fragment_ub->Map();
-        m_fragment_ub->SetVariable("color", glm::vec3(1.0f, 0.0f, 0.0f));
+        m_fragment_ub->SetVariable(m_color_handle, glm::vec3(1.0f, 0.0f, 0.0f));
         m_fragment_ub->Unmap();
 
         // Render mesh
@@ -153,6 +161,7 @@ private:
     std::shared_ptr<rut::Mesh> m_mesh;
     std::shared_ptr<rut::ShaderProgram> m_shader;
     std::shared_ptr<rut::UniformBuffer> m_vertex_ub, m_fragment_ub;
+    rut::UniformHandle m_projection_handle, m_color_handle;
     std::shared_ptr<rut::Renderer> m_renderer;
     bool m_should_close;
 };
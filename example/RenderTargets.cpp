@@ -0,0 +1,155 @@
+#include"RUT/rut.h"
+
+#include<array>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+#include<glm/vec2.hpp>
+#include<glm/vec3.hpp>
+
+using namespace rut::literals;
+
+// Renders one quad into two targets per frame, changing its color between the passes.
+// Each target has to come out in the color its own pass was given
+
+static const uint32_t TARGET_SIZE = 16;
+static const uint32_t NUM_FRAMES = 4;
+
+static const std::array<glm::vec2, 6> VERTICES =
+{{
+    glm::vec2(-1.0f, -1.0f),
+    glm::vec2( 1.0f, -1.0f),
+    glm::vec2( 1.0f,  1.0f),
+    glm::vec2(-1.0f, -1.0f),
+    glm::vec2( 1.0f,  1.0f),
+    glm::vec2(-1.0f,  1.0f)
+}};
+
+static const std::string VERTEX_SOURCE = R"(
+    #version 450
+
+    layout(location = 0) in vec2 position;
+
+    void main() {
+        gl_Position = vec4(position, 0.0, 1.0);
+    }
+)";
+
+static const std::string FRAGMENT_SOURCE = R"(
+    #version 450
+
+    layout(location = 0) out vec4 fragColor;
+
+    layout(binding = 0) uniform FragUniforms
+    {
+        vec3 color;
+    };
+
+    void main() {
+        fragColor = vec4(color, 1.0);
+    }
+)";
+
+static const std::array<glm::vec3, 2> COLORS =
+{{
+    glm::vec3(1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f)
+}};
+
+// Number of pixels that differ from the color by more than rounding
+static size_t CountMismatches(const std::vector<uint8_t> &pixels, const glm::vec3 &color)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            if (std::abs(static_cast<int>(pixels[i + c]) - static_cast<int>(color[c] * 255.0f)) > 1)
+            {
+                ++mismatches;
+                break;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    rut::Api::ChooseDefaults();
+    if (argc > 1 && std::strcmp(argv[1], "vulkan") == 0)
+    {
+        rut::Api::SetContextApi(rut::CONTEXT_API_KHR_SURFACE);
+        rut::Api::SetRenderApi(rut::RENDER_API_VULKAN);
+    }
+    rut::Api::CheckCompatibility();
+    rut::Api::PrintInfo();
+
+    // The window is never shown, only its context is used
+    rut::WindowProperties window_props;
+    window_props.width = TARGET_SIZE;
+    window_props.height = TARGET_SIZE;
+    window_props.title = "RUT render targets";
+    std::shared_ptr<rut::Window> window = rut::Window::Create(window_props);
+    rut::Context *context = window->GetContext();
+
+    std::shared_ptr<rut::Mesh> mesh = rut::Mesh::Create(context, { { "position", rut::VT_FVEC2 } });
+    mesh->SetVertices(VERTICES.size(), VERTICES.data());
+
+    rut::ShaderProgramCreateProperties shader_props;
+    shader_props.vertex_shader = rut::ShaderUnit::Create(context, rut::ST_VERTEX, VERTEX_SOURCE);
+    shader_props.fragment_shader = rut::ShaderUnit::Create(context, rut::ST_FRAGMENT, FRAGMENT_SOURCE);
+    std::shared_ptr<rut::ShaderProgram> shader = rut::ShaderProgram::Create(context, shader_props);
+
+    std::shared_ptr<rut::UniformBuffer> uniforms = rut::UniformBuffer::Create(context, shader->GetProperties().uniform_bindings.at(0).layout);
+    rut::UniformHandle color_handle = uniforms->GetVariableHandle("color"_uniform);
+    shader->BindUniformBuffer(0, uniforms);
+
+    rut::RendererProperties renderer_props;
+    renderer_props.shader = shader;
+    std::shared_ptr<rut::Renderer> renderer = rut::Renderer::Create(context, renderer_props);
+
+    rut::RenderTargetProperties target_props;
+    target_props.width = TARGET_SIZE;
+    target_props.height = TARGET_SIZE;
+    std::array<std::shared_ptr<rut::RenderTarget>, 2> targets;
+    for (auto &target : targets)
+        target = rut::RenderTarget::Create(context, target_props);
+
+    // Several frames, so every frame in flight's copies get reused
+    size_t mismatches = 0;
+    for (uint32_t frame = 0; frame < NUM_FRAMES; ++frame)
+    {
+        context->Begin();
+
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            uniforms->Map();
+            uniforms->SetVariable(color_handle, COLORS[(i + frame) % COLORS.size()]);
+            uniforms->Unmap();
+
+            renderer->Begin(targets[i]);
+            renderer->Render(mesh);
+            renderer->End();
+        }
+
+        context->End();
+
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            std::vector<uint8_t> pixels(targets[i]->GetPixelDataSize());
+            targets[i]->ReadPixels(pixels.data());
+
+            size_t target_mismatches = CountMismatches(pixels, COLORS[(i + frame) % COLORS.size()]);
+            std::cout << "Frame " << frame << ", target " << i << ": " << target_mismatches << " mismatching pixels" << std::endl;
+            mismatches += target_mismatches;
+        }
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include"RUT/rut.h"
+
+#include<array>
+#include<iostream>
+#include<vector>
+
+#include<glm/vec2.hpp>
+
+// Evicts a mesh with LODs through a ResidencyManager and uses it again.
+// The restored mesh has to come back with the same LOD chain
+
+static const std::array<glm::vec2, 4> VERTICES =
+{{
+    glm::vec2(-1.0f, -1.0f),
+    glm::vec2( 1.0f, -1.0f),
+    glm::vec2( 1.0f,  1.0f),
+    glm::vec2(-1.0f,  1.0f)
+}};
+
+static const std::array<uint32_t, 6> INDICES = {{ 0, 1, 2, 0, 2, 3 }};
+
+static bool LodsEqual(const std::vector<rut::MeshLod> &a, const std::vector<rut::MeshLod> &b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].index_offset != b[i].index_offset || a[i].index_count != b[i].index_count || a[i].error != b[i].error)
+            return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    rut::Api::ChooseDefaults();
+    rut::Api::CheckCompatibility();
+    rut::Api::PrintInfo();
+
+    // The window is never shown, only its context is used
+    rut::WindowProperties window_props;
+    window_props.width = 16;
+    window_props.height = 16;
+    window_props.title = "RUT residency";
+    std::shared_ptr<rut::Window> window = rut::Window::Create(window_props);
+    rut::Context *context = window->GetContext();
+
+    std::shared_ptr<rut::Mesh> mesh = rut::Mesh::Create(context, { { "position", rut::VT_FVEC2 } });
+    mesh->SetVertices(VERTICES.size(), VERTICES.data());
+    mesh->SetIndices(INDICES.size(), INDICES.data());
+
+    std::vector<rut::MeshLod> lods = { { 0, 6, 0.0f }, { 0, 3, 0.5f } };
+    mesh->SetLods(lods);
+
+    // Nothing fits the budget and nothing counts as recently drawn, so every update evicts the mesh
+    rut::ResidencyManagerProperties residency_props;
+    residency_props.budget_bytes = 1;
+    residency_props.min_idle_frames = 0;
+    rut::ResidencyManager residency(context, residency_props);
+    residency.Track(mesh, VERTICES.size(), VERTICES.data(), INDICES.size(), INDICES.data());
+
+    residency.Update();
+    bool evicted = residency.GetNumEvicted() == 1;
+
+    residency.Use(mesh.get());
+    bool restored = residency.GetNumEvicted() == 0;
+    bool lods_kept = LodsEqual(mesh->GetLods(), lods);
+
+    std::cout << "Evicted: " << evicted << ", restored: " << restored << ", LODs kept: " << lods_kept << std::endl;
+
+    return evicted && restored && lods_kept ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include"RUT/rut.h"
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<iostream>
+#include<random>
+#include<vector>
+
+#include<glm/gtc/matrix_transform.hpp>
+
+// Compares SceneIndex queries against brute force culling and raycasting over the same boxes.
+// Results have to match, the timings show where the hierarchy pays off
+
+static const size_t NUM_OBJECTS = 100000;
+static const size_t NUM_QUERIES = 64;
+static const float WORLD_SIZE = 1000.0f;
+
+// Slab test, returns the entry distance or INFINITY on a miss
+static float IntersectRay(const rut::BoundingBox &box, const glm::vec3 &origin, const glm::vec3 &direction, float max_distance)
+{
+    float t_min = 0.0f, t_max = max_distance;
+    for (int i = 0; i < 3; ++i)
+    {
+        float t0 = (box.min[i] - origin[i]) / direction[i];
+        float t1 = (box.max[i] - origin[i]) / direction[i];
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        t_min = std::max(t_min, t0);
+        t_max = std::min(t_max, t1);
+    }
+
+    return t_min <= t_max ? t_min : INFINITY;
+}
+
+template <typename F>
+static double Time(F &&f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    // Frustum planes depend on the clip space depth range of the render api
+    rut::Api::ChooseDefaults();
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-WORLD_SIZE, WORLD_SIZE);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<rut::BoundingBox> boxes(NUM_OBJECTS);
+    for (rut::BoundingBox &box : boxes)
+    {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        glm::vec3 extent(size(rng), size(rng), size(rng));
+        box = { center - extent, center + extent };
+    }
+
+    rut::SceneIndex index;
+    for (const rut::BoundingBox &box : boxes)
+        index.Insert(box);
+
+    double build_time = Time([&]() { index.Rebuild(); });
+
+    std::vector<rut::Frustum> frustums;
+    std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+    glm::mat4 projection = rut::CreatePerspectiveProjection(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+    for (size_t i = 0; i < NUM_QUERIES; ++i)
+    {
+        glm::vec3 eye(position(rng), position(rng), position(rng));
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+        frustums.emplace_back(projection * glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+        rays.push_back({ eye, direction });
+    }
+
+    // Culling
+    rut::FrustumCuller culler;
+    std::vector<std::vector<uint32_t>> brute_visible(NUM_QUERIES), index_visible(NUM_QUERIES);
+
+    double brute_cull_time = Time([&]()
+    {
+        for (size_t i = 0; i < NUM_QUERIES; ++i)
+            brute_visible[i] = culler.Cull(frustums[i], boxes.data(), boxes.size());
+    });
+
+    double index_cull_time = Time([&]()
+    {
+        for (size_t i = 0; i < NUM_QUERIES; ++i)
+            index.Cull(frustums[i], index_visible[i]);
+    });
+
+    size_t cull_mismatches = 0, num_visible = 0;
+    for (size_t i = 0; i < NUM_QUERIES; ++i)
+    {
+        std::sort(index_visible[i].begin(), index_visible[i].end());
+        cull_mismatches += brute_visible[i] != index_visible[i];
+        num_visible += brute_visible[i].size();
+    }
+
+    // Raycasting
+    std::vector<float> brute_distances(NUM_QUERIES, INFINITY), index_distances(NUM_QUERIES, INFINITY);
+
+    double brute_ray_time = Time([&]()
+    {
+        for (size_t i = 0; i < NUM_QUERIES; ++i)
+        {
+            for (const rut::BoundingBox &box : boxes)
+                brute_distances[i] = std::min(brute_distances[i], IntersectRay(box, rays[i].first, rays[i].second, 2.0f * WORLD_SIZE));
+        }
+    });
+
+    double index_ray_time = Time([&]()
+    {
+        for (size_t i = 0; i < NUM_QUERIES; ++i)
+        {
+            rut::SceneRayHit hit;
+            if (index.Raycast(rays[i].first, rays[i].second, 2.0f * WORLD_SIZE, hit))
+                index_distances[i] = hit.distance;
+        }
+    });
+
+    // Distances of the same box only differ by rounding, ties between boxes may pick either
+    size_t ray_mismatches = 0, num_hits = 0;
+    for (size_t i = 0; i < NUM_QUERIES; ++i)
+    {
+        bool brute_hit = brute_distances[i] != INFINITY, index_hit = index_distances[i] != INFINITY;
+        ray_mismatches += brute_hit != index_hit || (brute_hit && std::abs(brute_distances[i] - index_distances[i]) > 1e-3f * brute_distances[i] + 1e-4f);
+        num_hits += brute_hit;
+    }
+
+    std::cout << NUM_OBJECTS << " objects, " << NUM_QUERIES << " queries, build " << build_time << " ms" << std::endl;
+    std::cout << "Cull:    brute force " << brute_cull_time << " ms, index " << index_cull_time << " ms, " << num_visible << " visible, " << cull_mismatches << " mismatches" << std::endl;
+    std::cout << "Raycast: brute force " << brute_ray_time << " ms, index " << index_ray_time << " ms, " << num_hits << " hits, " << ray_mismatches << " mismatches" << std::endl;
+
+    return cull_mismatches == 0 && ray_mismatches == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include"Mesh.h"
+
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<future>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<utility>
+#include<vector>
+
+namespace rut
+{
+    class Context;
+    class MeshFile;
+
+    struct AssetStreamerProperties
+    {
+        // Threads mapping and prefetching files. 0 uses all hardware threads
+        uint32_t num_threads = 2;
+
+        // Per Update call. At least one upload step runs every frame, so assets larger than the budget still make progress
+        size_t upload_budget_bytes = 8 << 20;
+        float upload_budget_ms = 2.0f;
+    };
+
+    enum AssetState
+    {
+        AS_QUEUED,
+        AS_LOADING,
+        AS_UPLOADING,
+        AS_RESIDENT,
+        AS_CANCELLED,
+        AS_FAILED
+    };
+
+    typedef std::function<void(const std::shared_ptr<Mesh>&)> MeshResidentCallback;
+
+    class AssetRequest
+    {
+    public:
+        AssetState GetState() const;
+        int32_t GetPriority() const;
+
+        // Becomes ready once the mesh is resident. Holds an exception if loading failed or the request was cancelled
+        std::shared_future<std::shared_ptr<Mesh>> GetFuture() const;
+
+        // Drops the request at its next stage. Has no effect once the mesh is resident
+        void Cancel();
+
+    private:
+        friend class AssetStreamer;
+
+        std::string m_path;
+        MeshUsage m_usage;
+        int32_t m_priority;
+        uint64_t m_sequence;
+        MeshResidentCallback m_callback;
+
+        std::atomic<AssetState> m_state;
+        std::atomic<bool> m_cancelled;
+        std::promise<std::shared_ptr<Mesh>> m_promise;
+        std::shared_future<std::shared_ptr<Mesh>> m_future;
+
+        // Owned by the render thread once loaded
+        std::unique_ptr<MeshFile> m_file;
+        std::shared_ptr<Mesh> m_mesh;
+        uint32_t m_upload_step;
+    };
+
+    // Loads .rutmesh files in the background. Workers map and prefetch the files, the render thread creates the meshes
+    // and uploads their streams in Update, bounded by a per-frame budget so large scene loads spread over several frames
+    class AssetStreamer
+    {
+    public:
+        AssetStreamer(Context *context, const AssetStreamerProperties &props = {});
+        ~AssetStreamer();
+
+        AssetStreamer(const AssetStreamer&) = delete;
+        AssetStreamer &operator=(const AssetStreamer&) = delete;
+
+        // Higher priorities are loaded and uploaded first. The callback runs on the render thread at the end of Update, exceptions
+        // it throws leave Update and the callbacks of other meshes run on the next call
+        std::shared_ptr<AssetRequest> LoadMesh(const std::string &path, int32_t priority = 0, MeshUsage usage = MU_IMMUTABLE, MeshResidentCallback callback = {});
+
+        // Call once per frame on the render thread, with the context current
+        void Update();
+
+        size_t GetNumPending() const;
+
+    private:
+        Context *m_context;
+        AssetStreamerProperties m_props;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_stop;
+        uint64_t m_sequence;
+        std::atomic<size_t> m_num_pending;
+
+        // Requests waiting for a worker, and loaded requests waiting for the render thread
+        std::vector<std::shared_ptr<AssetRequest>> m_load_queue;
+        std::vector<std::shared_ptr<AssetRequest>> m_upload_queue;
+        std::vector<std::thread> m_workers;
+
+        // Render thread only
+        std::vector<std::shared_ptr<AssetRequest>> m_uploading;
+        std::vector<std::pair<MeshResidentCallback, std::shared_ptr<Mesh>>> m_callbacks;
+
+        // Max heap order on priority, first come first served within a priority
+        static bool CompareRequests(const std::shared_ptr<AssetRequest> &a, const std::shared_ptr<AssetRequest> &b);
+
+        void WorkerMain();
+        size_t UploadStep(AssetRequest &request);
+        void Finish(AssetRequest &request, AssetState state, std::exception_ptr error = nullptr);
+    };
+}
\ No newline at end of file
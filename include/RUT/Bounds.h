@@ -0,0 +1,67 @@
+#pragma once
+
+#include"Layout.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+#include<glm/vec3.hpp>
+#include<glm/vec4.hpp>
+#include<glm/mat4x4.hpp>
+
+namespace rut
+{
+    struct BoundingBox
+    {
+        glm::vec3 min, max;
+    };
+
+    // Packed into 16 bytes so batches load straight into SIMD registers
+    struct BoundingSphere
+    {
+        glm::vec3 center;
+        float radius;
+    };
+
+    struct MeshBounds
+    {
+        BoundingBox box{ glm::vec3(0.0f), glm::vec3(0.0f) };
+        BoundingSphere sphere{ glm::vec3(0.0f), 0.0f };
+
+        // False until vertices with a float "position" attribute were set
+        bool valid = false;
+    };
+
+    // Recomputes the bounds if the stream holds the float vec2, vec3 or vec4 attribute named "position". Returns whether it did
+    bool UpdateMeshBounds(MeshBounds &bounds, const VertexLayout &layout, uint32_t stream, size_t num_vertices, const void *data);
+
+    BoundingBox TransformBox(const BoundingBox &box, const glm::mat4 &transform);
+    BoundingSphere TransformSphere(const BoundingSphere &sphere, const glm::mat4 &transform);
+
+    // Planes point inwards and are normalized, for the clip space depth range of the selected render api
+    struct Frustum
+    {
+        glm::vec4 planes[6];
+
+        explicit Frustum(const glm::mat4 &view_projection);
+    };
+
+    // Tests batches of world space bounds 4 at a time with SSE, or 8 with AVX, split across threads for large batches
+    class FrustumCuller
+    {
+    public:
+        FrustumCuller(uint32_t num_threads = 0);
+
+        // Indices of the visible bounds, in input order. Valid until the next call
+        const std::vector<uint32_t> &Cull(const Frustum &frustum, const BoundingSphere *spheres, size_t count);
+        const std::vector<uint32_t> &Cull(const Frustum &frustum, const BoundingBox *boxes, size_t count);
+
+    private:
+        uint32_t m_num_threads;
+        std::vector<uint8_t> m_visibility;
+        std::vector<uint32_t> m_visible;
+
+        const std::vector<uint32_t> &Compact(size_t count);
+    };
+}
\ No newline at end of file
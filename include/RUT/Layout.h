@@ -7,6 +7,16 @@
 
 namespace rut
 {
+    constexpr uint64_t HashLayoutName(const char *str, size_t length)
+    {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < length; ++i)
+            hash = (hash ^ static_cast<uint8_t>(str[i])) * 0x100000001b3ull;
+        
+        return hash;
+    }
+
     enum Type
     {
         VT_INT,
@@ -18,13 +28,94 @@ namespace rut
         VT_IVEC4,
         VT_FVEC4,
         VT_MAT3,
-        VT_MAT4
+        VT_MAT4,
+
+        // Compact vertex-only types, read as floats by shaders
+        VT_HVEC2,
+        VT_HVEC4,
+        VT_UNORM8_VEC4,
+        VT_SNORM8_VEC4,
+        VT_UNORM16_VEC2,
+        VT_SNORM16_VEC2,
+        VT_UNORM16_VEC4,
+        VT_SNORM16_VEC4,
+        VT_UNORM_10_10_10_2,
+        VT_SNORM_10_10_10_2
     };
 
+    constexpr bool IsVertexOnlyType(Type type) { return type >= VT_HVEC2; }
+    constexpr bool IsIntegerType(Type type) { return type == VT_INT || type == VT_IVEC2 || type == VT_IVEC3 || type == VT_IVEC4; }
+
+    constexpr uint32_t GetStd140Alignment(Type type, uint32_t length = 1)
+    {
+        if (length > 1)
+            return 16;
+        
+        switch (type)
+        {
+            case VT_INT:
+            case VT_FLOAT:
+                return 4;
+            
+            case VT_IVEC2:
+            case VT_FVEC2:
+                return 8;
+            
+            default:
+                return 16;
+        }
+    }
+
+    constexpr uint32_t GetStd140Size(Type type, uint32_t length = 1)
+    {
+        uint32_t size = 0;
+        switch (type)
+        {
+            case VT_INT:
+            case VT_FLOAT:
+                size = 4;
+                break;
+            
+            case VT_IVEC2:
+            case VT_FVEC2:
+                size = 8;
+                break;
+            
+            case VT_IVEC3:
+            case VT_FVEC3:
+                size = 12;
+                break;
+            
+            case VT_IVEC4:
+            case VT_FVEC4:
+                size = 16;
+                break;
+            
+            // Matrix columns are padded to vec4
+            case VT_MAT3:
+                size = 48;
+                break;
+            
+            case VT_MAT4:
+                size = 64;
+                break;
+            
+            default:
+                break;
+        }
+
+        // Array elements are padded to vec4
+        if (length > 1)
+            size = (size + 15) / 16 * 16 * length;
+        
+        return size;
+    }
+
     struct VertexLayoutElement
     {
         std::string name;
         Type type;
+        uint32_t stream = 0;
     };
 
     struct UniformLayoutElement
@@ -34,134 +125,96 @@ namespace rut
         uint32_t length = 1;
     };
 
-    class LayoutItem
+    enum LayoutCopy : uint32_t
     {
-    public:
-        LayoutItem();
-        LayoutItem(const LayoutItem &item);
-        virtual ~LayoutItem() = default;
-
-        const std::string &GetName() const;
-        Type GetType() const;
-        uint32_t GetOffset() const;
-        uint32_t GetSize() const;
-        uint32_t GetCount() const;
-        uint32_t GetLength() const;
-
-        void SetName(const std::string &name);
-        void SetType(Type type);
-        void SetOffset(uint32_t offset);
-        void SetSize(uint32_t size);
-        void SetCount(uint32_t count);
-        void SetLength(uint32_t length);
-
-        virtual void Read(void *dst, const void *src) const = 0;
-        virtual void Write(void *dst, const void *src) const = 0;
-
-        virtual LayoutItem *Copy() const = 0;
-    
-    private:
-        std::string m_name;
-        Type m_type;
-        uint32_t m_offset, m_size, m_count, m_length;
+        LC_PACKED,
+        LC_STRIDED,
+        LC_MATRIX
     };
 
-    class VertexLayoutItem : public LayoutItem
+    // Flat descriptor of one layout entry. Client data is always tightly packed
+    struct LayoutEntry
     {
-    public:
-        virtual void Read(void *dst, const void *src) const override;
-        virtual void Write(void *dst, const void *src) const override;
-
-        virtual LayoutItem *Copy() const override;
+        uint64_t name_hash;
+        uint32_t name_offset;
+        Type type;
+        LayoutCopy copy;
+        uint32_t offset;
+        uint32_t stream;
+        uint32_t size;
+        uint32_t count;
+        uint32_t length;
+        uint32_t stride;
+        uint32_t column_stride;
+        uint32_t client_size;
     };
 
-    class UniformArrayLayoutItem : public LayoutItem
+    // Converts between the tightly packed client representation and the layout representation of an entry
+    void ReadLayoutEntry(const LayoutEntry &entry, void *dst, const void *src);
+    void WriteLayoutEntry(const LayoutEntry &entry, void *dst, const void *src);
+
+    class Layout
     {
     public:
-        UniformArrayLayoutItem();
-        UniformArrayLayoutItem(const UniformArrayLayoutItem &item);
-        virtual ~UniformArrayLayoutItem();
-
-        LayoutItem *GetItem() const;
-        uint32_t GetStride() const;
-        void SetItem(LayoutItem *item);
-        void SetStride(uint32_t stride);
+        typedef std::vector<LayoutEntry> VecType;
 
-        virtual void Read(void *dst, const void *src) const override;
-        virtual void Write(void *dst, const void *src) const override;
-
-        virtual LayoutItem *Copy() const override;
-    
-    private:
-        LayoutItem *m_item;
-        uint32_t m_stride;
-    };
+        VecType::const_iterator begin() const;
+        VecType::const_iterator end() const;
 
-    class UniformMatrixLayoutItem : public LayoutItem
-    {
-    public:
-        UniformMatrixLayoutItem();
-        UniformMatrixLayoutItem(const UniformMatrixLayoutItem &item);
+        size_t GetNumEntries() const;
+        const LayoutEntry &operator[](size_t index) const;
+        const LayoutEntry *Find(uint64_t name_hash) const;
+        const char *GetName(const LayoutEntry &entry) const;
 
+        // Sum of all stream strides for vertex layouts
         uint32_t GetStride() const;
-        uint32_t GetDimension() const;
-        void SetStride(uint32_t stride);
-        void SetDimension(uint32_t dimension);
-
-        virtual void Read(void *dst, const void *src) const override;
-        virtual void Write(void *dst, const void *src) const override;
+        bool IsEmpty() const;
 
-        virtual LayoutItem *Copy() const override;
+        // Covers types, offsets, streams and strides but not names, so layouts that only differ in naming hash equally
+        uint64_t GetFormatHash() const;
+        bool HasSameFormat(const Layout &other) const;
     
-    private:
-        uint32_t m_stride, m_dimension;
+    protected:
+        VecType m_entries;
+        std::string m_names;
+        uint32_t m_stride = 0;
+
+        LayoutEntry &AddEntry(const std::string &name, Type type);
     };
 
-    struct VertexLayout
+    // Elements may be split across several streams, each backed by its own vertex buffer. Entry offsets are relative to their stream
+    struct VertexLayout : public Layout
     {
     public:
-        typedef std::vector<VertexLayoutItem> VecType;
+        static constexpr uint32_t MAX_STREAMS = 8;
 
         VertexLayout(std::initializer_list<VertexLayoutElement> il);
-        VertexLayout(const VertexLayout &layout);
-        VertexLayout(VertexLayout &&layout);
+        VertexLayout(const std::vector<VertexLayoutElement> &elements);
 
-        VertexLayout &operator=(const VertexLayout &layout);
-        VertexLayout &operator=(VertexLayout &&layout);
+        uint32_t GetNumStreams() const;
+        uint32_t GetStreamStride(uint32_t stream) const;
 
-        VecType::const_iterator begin() const;
-        VecType::const_iterator end() const;
+        // Byte offset of the stream's block in non-interleaved vertex data, given per vertex
+        uint32_t GetStreamBase(uint32_t stream) const;
 
-        uint32_t GetStride() const;
+        // Entry feeding each of a shader's inputs, indexed by input location. Inputs are matched by name, or by position if
+        // no entry has their name. Entries the shader doesn't read are left out, so their streams need not be fetched
+        std::vector<const LayoutEntry*> MatchInputs(const VertexLayout &inputs) const;
     
     private:
-        VecType m_items;
-        uint32_t m_stride;
+        std::vector<uint32_t> m_stream_strides;
+
+        void Init(const VertexLayoutElement *elements, size_t count);
     };
 
-    struct UniformLayout
+    // Offsets follow the std140 rules, which both backends use for uniform blocks
+    struct UniformLayout : public Layout
     {
     public:
-        typedef std::vector<LayoutItem*> VecType;
-
         UniformLayout(std::initializer_list<UniformLayoutElement> il);
-        UniformLayout(const UniformLayout &layout);
-        UniformLayout(UniformLayout &&layout);
-        ~UniformLayout();
-
-        UniformLayout &operator=(const UniformLayout &layout);
-        UniformLayout &operator=(UniformLayout &&layout);
-
-        VecType::const_iterator begin() const;
-        VecType::const_iterator end() const;
-        VecType::iterator begin();
-        VecType::iterator end();
-
-        uint32_t GetStride() const;
-        void SetStride(uint32_t stride);
+        UniformLayout(const std::vector<UniformLayoutElement> &elements);
     
     private:
-        VecType m_items;
-        uint32_t m_stride;
+        void Init(const UniformLayoutElement *elements, size_t count);
     };
 }
\ No newline at end of file
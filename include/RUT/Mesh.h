@@ -2,11 +2,31 @@
 
 #include<cstdint>
 #include<memory>
+#include<string>
+#include<vector>
 
 namespace rut
 {
     class Context;
-    class VertexLayout;
+    struct VertexLayout;
+    struct MeshBounds;
+
+    enum MeshUsage
+    {
+        MU_IMMUTABLE,   // Set once, never updated
+        MU_STATIC,      // Rarely updated
+        MU_DYNAMIC,     // Updated every few frames
+        MU_STREAM       // Rewritten every frame
+    };
+
+    // Range of a level of detail in the index buffer. The error is the largest distance of a remaining vertex from the planes of the
+    // full mesh's triangles it replaced, in object units
+    struct MeshLod
+    {
+        uint32_t index_offset;
+        uint32_t index_count;
+        float error;
+    };
 
     class Mesh
     {
@@ -14,13 +34,36 @@ namespace rut
         virtual ~Mesh() = default;
 
         virtual const VertexLayout &GetLayout() const = 0;
+        virtual MeshUsage GetUsage() const = 0;
 
+        // Multi-stream vertices are given stream after stream, see VertexLayout::GetStreamBase
         virtual void SetVertices(size_t num_vertices, const void *vertices) = 0;
+        virtual void SetVertexStream(uint32_t stream, size_t num_vertices, const void *vertices) = 0;
         virtual void SetIndices(size_t num_indices, const uint32_t *indices) = 0;
 
+        // Ordered from the full mesh to the coarsest. Without LODs the whole index buffer is drawn. Ranges must lie within the
+        // indices, which are set first since setting them clears the LODs
+        virtual void SetLods(const std::vector<MeshLod> &lods) = 0;
+        virtual const std::vector<MeshLod> &GetLods() const = 0;
+
+        // Object space bounds, updated whenever the stream holding the "position" attribute is set
+        virtual const MeshBounds &GetBounds() const = 0;
+
+        // Bytes of gpu memory held by the mesh's own buffers
+        virtual size_t GetGpuSize() const = 0;
+
+        // Frees the gpu buffers and draws nothing until new data is set. Layout, LODs and bounds are kept, immutable meshes may be set again
+        virtual void Evict() = 0;
+
+        // Converts vertices from the source layout into the mesh layout first, which quantizes float data into compact types
+        void SetVerticesFrom(size_t num_vertices, const void *vertices, const VertexLayout &source_layout);
+
         virtual uint64_t GetHandle() const = 0;
 
-        static std::shared_ptr<Mesh> Create(Context *context, const VertexLayout &layout);
-        static std::shared_ptr<Mesh> Create(Context *context, VertexLayout &&layout);
+        static std::shared_ptr<Mesh> Create(Context *context, const VertexLayout &layout, MeshUsage usage = MU_STATIC);
+        static std::shared_ptr<Mesh> Create(Context *context, VertexLayout &&layout, MeshUsage usage = MU_STATIC);
+
+        // Memory maps a .rutmesh file and uploads its vertex, index and LOD data straight from the mapping
+        static std::shared_ptr<Mesh> LoadFromFile(Context *context, const std::string &path, MeshUsage usage = MU_IMMUTABLE, bool validate_indices = false);
     };
 }
\ No newline at end of file
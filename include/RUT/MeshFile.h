@@ -0,0 +1,99 @@
+#pragma once
+
+#include"Layout.h"
+#include"Mesh.h"
+#include"Bounds.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<string>
+#include<vector>
+
+namespace rut
+{
+    // .rutmesh layout, little endian: header, elements, lods, then the vertex and index blobs, each aligned to MESH_FILE_ALIGNMENT.
+    // Vertex data is stored stream after stream in the exact format the vertex layout describes, so it uploads without conversion
+    static constexpr char MESH_FILE_MAGIC[8] = { 'R', 'U', 'T', 'M', 'E', 'S', 'H', '\0' };
+    static constexpr uint32_t MESH_FILE_VERSION = 1;
+    static constexpr uint64_t MESH_FILE_ALIGNMENT = 16;
+
+    struct MeshFileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t num_elements;
+        uint64_t num_vertices;
+        uint64_t num_indices;
+        uint32_t num_lods;
+        uint32_t bounds_valid;
+        float box_min[3], box_max[3];
+        float sphere_center[3], sphere_radius;
+        uint64_t elements_offset, lods_offset;
+        uint64_t vertices_offset, vertices_size;
+        uint64_t indices_offset, indices_size;
+    };
+
+    // Types are stored by their Type value, so the enum order is part of the format
+    struct MeshFileElement
+    {
+        char name[56];
+        uint32_t type;
+        uint32_t stream;
+    };
+
+    struct MeshFileLod
+    {
+        uint32_t index_offset;
+        uint32_t index_count;
+        float error;
+        uint32_t reserved;
+    };
+
+    // The structs are read straight from the mapping, so their layout is part of the format
+    static_assert(sizeof(MeshFileHeader) == 128, "MeshFileHeader layout changed");
+    static_assert(offsetof(MeshFileHeader, version) == 8 && offsetof(MeshFileHeader, num_vertices) == 16 && offsetof(MeshFileHeader, num_lods) == 32, "MeshFileHeader layout changed");
+    static_assert(offsetof(MeshFileHeader, box_min) == 40 && offsetof(MeshFileHeader, sphere_radius) == 76, "MeshFileHeader layout changed");
+    static_assert(offsetof(MeshFileHeader, elements_offset) == 80 && offsetof(MeshFileHeader, vertices_offset) == 96 && offsetof(MeshFileHeader, indices_size) == 120, "MeshFileHeader layout changed");
+    static_assert(sizeof(MeshFileElement) == 64 && offsetof(MeshFileElement, type) == 56 && offsetof(MeshFileElement, stream) == 60, "MeshFileElement layout changed");
+    static_assert(sizeof(MeshFileLod) == 16 && offsetof(MeshFileLod, index_count) == 4 && offsetof(MeshFileLod, error) == 8, "MeshFileLod layout changed");
+
+    // Read only memory mapping of a .rutmesh file. Vertex and index pointers point into the mapping and stay valid as long as the object lives
+    class MeshFile
+    {
+    public:
+        // Checking every index against the vertex count reads all of the index data, so it is only done on request
+        MeshFile(const std::string &path, bool validate_indices = false);
+        ~MeshFile();
+
+        MeshFile(const MeshFile&) = delete;
+        MeshFile &operator=(const MeshFile&) = delete;
+
+        const VertexLayout &GetLayout() const;
+
+        size_t GetNumVertices() const;
+        const void *GetVertices() const;
+        size_t GetNumIndices() const;
+        const uint32_t *GetIndices() const;
+
+        const std::vector<MeshLod> &GetLods() const;
+        const MeshBounds &GetBounds() const;
+
+        // Bounds are computed from the vertices
+        static void Write(const std::string &path, const VertexLayout &layout, size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices, const std::vector<MeshLod> &lods = {});
+
+    private:
+        const uint8_t *m_data;
+        size_t m_size;
+        void *m_handle;
+
+        std::unique_ptr<VertexLayout> m_layout;
+        const MeshFileHeader *m_header;
+        std::vector<MeshLod> m_lods;
+        MeshBounds m_bounds;
+
+        void Map(const std::string &path);
+        void Parse(bool validate_indices);
+        void Unmap();
+    };
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include"Mesh.h"
+#include"Layout.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+#include<glm/mat4x4.hpp>
+
+namespace rut
+{
+    struct LodGeneratorProperties
+    {
+        // Each LOD aims for this fraction of the triangles of the previous one
+        uint32_t max_lods = 6;
+        float reduction = 0.5f;
+
+        // Largest allowed deviation as a fraction of the mesh's bounding box diagonal
+        float max_error = 0.05f;
+
+        // Vertices on open borders keep their position so holes don't grow
+        bool lock_borders = true;
+
+        // Float vec3 or vec4 attribute to simplify by. Vertices with equal attributes are welded, those sharing a position but
+        // differing in other attributes, such as along uv seams, are never collapsed
+        std::string position_name = "position";
+    };
+
+    // Quadric error edge collapse onto existing vertices, so all LODs share the vertex buffer and only differ in indices
+    class LodGenerator
+    {
+    public:
+        LodGenerator(const VertexLayout &layout, const LodGeneratorProperties &props = {});
+
+        // Indices of the full mesh, LOD 0
+        void Generate(size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices);
+
+        // Sets the combined indices and LOD ranges on a mesh already holding the vertices
+        void Upload(Mesh *mesh) const;
+
+        const std::vector<uint32_t> &GetIndices() const;
+        const std::vector<MeshLod> &GetLods() const;
+
+    private:
+        VertexLayout m_layout;
+        LodGeneratorProperties m_props;
+
+        std::vector<uint32_t> m_indices;
+        std::vector<MeshLod> m_lods;
+    };
+
+    struct LodProperties
+    {
+        // Projection from CreatePerspectiveProjection and the height of the viewport in pixels
+        glm::mat4 projection = glm::mat4(1.0f);
+        float viewport_height = 1080.0f;
+
+        // Largest on-screen deviation of a selected LOD in pixels
+        float pixel_error = 1.0f;
+    };
+
+    // Coarsest LOD whose error projects to at most props.pixel_error pixels at the given view distance. Object scale is not accounted for
+    uint32_t SelectLod(const std::vector<MeshLod> &lods, const LodProperties &props, float distance);
+}
\ No newline at end of file
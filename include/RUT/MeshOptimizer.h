@@ -0,0 +1,72 @@
+#pragma once
+
+#include"Layout.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+namespace rut
+{
+    class Mesh;
+
+    struct MeshOptimizerProperties
+    {
+        // Welds bitwise equal vertices, which turns triangle soup into an indexed mesh
+        bool generate_indices = true;
+
+        // Reorders triangles for the post-transform vertex cache (Tipsify)
+        bool optimize_vertex_cache = true;
+        uint32_t cache_size = 16;
+
+        // Sorts triangle clusters front to back, using the float vec3 or vec4 attribute named position_name.
+        // Clusters are split where the local ACMR stays below overdraw_threshold times that of their cache cluster
+        bool optimize_overdraw = false;
+        float overdraw_threshold = 1.05f;
+        std::string position_name = "position";
+
+        // Reorders vertices by first use, which also drops unreferenced vertices
+        bool optimize_vertex_fetch = true;
+
+        // Large meshes are split across this many threads where possible, 0 uses all hardware threads
+        uint32_t num_threads = 0;
+    };
+
+    // ACMR is the average number of cache misses per triangle, between 0.5 and 3.0 with lower being better
+    struct MeshOptimizerStats
+    {
+        size_t vertices_before, vertices_after;
+        float acmr_before, acmr_after;
+    };
+
+    // Optimizes triangle lists on the cpu ahead of upload. Multi-stream vertices are stored stream after stream, like Mesh::SetVertices expects
+    class MeshOptimizer
+    {
+    public:
+        MeshOptimizer(const VertexLayout &layout, const MeshOptimizerProperties &props = {});
+
+        // Unindexed input is treated as triangle soup
+        void Optimize(size_t num_vertices, const void *vertices, size_t num_indices = 0, const uint32_t *indices = nullptr);
+
+        // Sets the optimized vertices and indices on a mesh of the same vertex format
+        void Upload(Mesh *mesh) const;
+
+        size_t GetNumVertices() const;
+        const std::vector<uint8_t> &GetVertices() const;
+        const std::vector<uint32_t> &GetIndices() const;
+        const MeshOptimizerStats &GetStats() const;
+
+        // Simulates a fifo vertex cache of the given size
+        static float ComputeACMR(const uint32_t *indices, size_t num_indices, size_t num_vertices, uint32_t cache_size);
+
+    private:
+        VertexLayout m_layout;
+        MeshOptimizerProperties m_props;
+
+        size_t m_num_vertices;
+        std::vector<uint8_t> m_vertices;
+        std::vector<uint32_t> m_indices;
+        MeshOptimizerStats m_stats;
+    };
+}
\ No newline at end of file
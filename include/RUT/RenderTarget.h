@@ -0,0 +1,45 @@
+#pragma once
+
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+
+namespace rut
+{
+    class Context;
+
+    enum RenderTargetFormat
+    {
+        RTF_RGBA8,
+        RTF_RGBA16F,
+        RTF_RGBA32F
+    };
+
+    struct RenderTargetProperties
+    {
+        uint32_t width, height;
+        RenderTargetFormat color_format = RTF_RGBA8;
+        bool has_depth = false;
+    };
+
+    // Offscreen color and optional depth attachments, drawn into by passing the target to Renderer::Begin.
+    // Rendering into targets only never presents, so a window's context can be used for batch rendering without showing it
+    class RenderTarget
+    {
+    public:
+        virtual ~RenderTarget() = default;
+
+        virtual const RenderTargetProperties &GetProperties() const = 0;
+
+        // Bytes ReadPixels writes, rows are tightly packed
+        size_t GetPixelDataSize() const;
+
+        // Copies the color attachment to dst, top row first. Waits for all rendering submitted so far, so call it after
+        // the Context::End of the frame that drew the target
+        virtual void ReadPixels(void *dst) = 0;
+
+        virtual uint64_t GetHandle() const = 0;
+
+        static std::shared_ptr<RenderTarget> Create(Context *context, const RenderTargetProperties &props);
+    };
+}
\ No newline at end of file
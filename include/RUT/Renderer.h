@@ -1,6 +1,9 @@
 #pragma once
 
+#include"MeshLod.h"
+
 #include<memory>
+#include<vector>
 
 #include<glm/vec4.hpp>
 
@@ -9,6 +12,15 @@ namespace rut
     class Mesh;
     class ShaderProgram;
     class Context;
+    class ResidencyManager;
+    class SceneIndex;
+    class RenderTarget;
+    struct Frustum;
+
+    namespace impl
+    {
+        struct RendererCullState;
+    }
 
     enum CullMode
     {
@@ -50,21 +62,58 @@ namespace rut
         BlendMode blend_mode = BM_NONE;
         DepthProperties depth_props;
         ClearProperties clear_props;
+        LodProperties lod_props;
 
         std::shared_ptr<ShaderProgram> shader;
+
+        // Optional. Drawn meshes are marked as used and uploaded again if they were evicted
+        std::shared_ptr<ResidencyManager> residency;
+    };
+
+    struct RendererStats
+    {
+        // State changes sent to the driver and those skipped because the state was already set
+        uint64_t state_changes_issued = 0;
+        uint64_t state_changes_elided = 0;
     };
 
     class Renderer
     {
     public:
-        virtual ~Renderer() = default;
+        Renderer();
+        virtual ~Renderer();
 
         virtual const RendererProperties &GetProperties() const = 0;
 
+        // Counted per context, so renderers of one context share them. Always zero for Vulkan, which records state into pipelines
+        virtual RendererStats GetStats() const = 0;
+        virtual void ResetStats() = 0;
+
+        // Draws into the window
         virtual void Begin() = 0;
+
+        // Draws into the target, or into the window if it is null. Any number of passes can be begun per frame,
+        // each one clears its target and draws with the uniform buffers' contents as they are when it draws
+        virtual void Begin(std::shared_ptr<RenderTarget> target) = 0;
         virtual void Render(std::shared_ptr<Mesh> mesh) = 0;
+
+        // Draws a single level of detail, clamped to the coarsest the mesh has
+        virtual void RenderLod(std::shared_ptr<Mesh> mesh, uint32_t lod) = 0;
+
+        // Picks the level of detail from the mesh's projected error at the given view distance, see SelectLod
+        void RenderAtDistance(std::shared_ptr<Mesh> mesh, float distance);
+
+        // Draws only the meshes whose bounds intersect the frustum, for meshes with vertices in world space. Returns the number drawn
+        size_t RenderVisible(const std::vector<std::shared_ptr<Mesh>> &meshes, const Frustum &frustum);
+
+        // Same, but culls through the index, whose object ids are indices into meshes. Refit the index before calling
+        size_t RenderVisible(const std::vector<std::shared_ptr<Mesh>> &meshes, const SceneIndex &index, const Frustum &frustum);
         virtual void End() = 0;
 
         static std::shared_ptr<Renderer> Create(Context *context, const RendererProperties &props);
+    
+    private:
+        // Culler and scratch buffers of RenderVisible, created on first use and reused across frames
+        std::unique_ptr<impl::RendererCullState> m_cull_state;
     };
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include<cstddef>
+#include<cstdint>
+#include<list>
+#include<memory>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+namespace rut
+{
+    class Context;
+    class Mesh;
+
+    struct ResidencyManagerProperties
+    {
+        // Bytes the tracked meshes may occupy. With 0, budget_fraction of the device's memory budget is used where the api
+        // reports one (VK_EXT_memory_budget) and fallback_budget_bytes otherwise
+        size_t budget_bytes = 0;
+        float budget_fraction = 0.8f;
+        size_t fallback_budget_bytes = 512 << 20;
+
+        // Meshes drawn this recently are never evicted, since frames in flight may still read them
+        uint32_t min_idle_frames = 3;
+    };
+
+    // Keeps tracked meshes within a gpu memory budget. The least recently drawn ones are evicted to their cpu side copy
+    // and uploaded again the next time they are used
+    class ResidencyManager
+    {
+    public:
+        ResidencyManager(Context *context, const ResidencyManagerProperties &props = {});
+
+        // Copies the data to upload again after eviction. Track again after changing the mesh's data.
+        // Multi-stream vertices are given stream after stream
+        void Track(const std::shared_ptr<Mesh> &mesh, size_t num_vertices, const void *vertices, size_t num_indices = 0, const uint32_t *indices = nullptr);
+
+        // Maps the .rutmesh file the mesh was loaded from again instead of keeping a copy
+        void Track(const std::shared_ptr<Mesh> &mesh, const std::string &path);
+        void Untrack(const Mesh *mesh);
+
+        // Marks the mesh as drawn this frame, uploading it first if it was evicted. Untracked meshes are ignored.
+        // Renderers call this for every mesh they draw when RendererProperties::residency is set
+        void Use(Mesh *mesh);
+
+        // Call once per frame. Forgets destroyed meshes, then evicts the least recently drawn ones until the rest fit the budget
+        void Update();
+
+        size_t GetBudget() const;
+        size_t GetResidentBytes() const;
+        size_t GetNumTracked() const;
+        size_t GetNumEvicted() const;
+
+    private:
+        struct Entry
+        {
+            std::weak_ptr<Mesh> mesh;
+            const Mesh *key;
+
+            // Either a copy of the data or the file to map it from
+            std::string path;
+            size_t num_vertices;
+            std::vector<uint8_t> vertices;
+            std::vector<uint32_t> indices;
+
+            size_t gpu_size;
+            uint64_t last_used;
+            bool resident;
+        };
+
+        Context *m_context;
+        ResidencyManagerProperties m_props;
+
+        // Most recently used first
+        std::list<Entry> m_entries;
+        std::unordered_map<const Mesh*, std::list<Entry>::iterator> m_lookup;
+
+        uint64_t m_frame;
+        size_t m_budget;
+        size_t m_resident_bytes;
+        size_t m_num_evicted;
+
+        void Insert(const std::shared_ptr<Mesh> &mesh, Entry &&entry);
+        void Erase(std::list<Entry>::iterator it);
+        void Restore(Entry &entry, Mesh *mesh);
+        size_t QueryBudget() const;
+    };
+}
\ No newline at end of file
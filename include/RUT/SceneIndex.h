@@ -0,0 +1,101 @@
+#pragma once
+
+#include"Bounds.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<future>
+#include<vector>
+
+#include<glm/vec3.hpp>
+
+namespace rut
+{
+    struct SceneIndexProperties
+    {
+        uint32_t max_leaf_size = 4;
+
+        // Fraction of the objects inserted or moved since the last build that starts a rebuild in the background
+        float rebuild_threshold = 0.25f;
+    };
+
+    struct SceneRayHit
+    {
+        uint32_t id;
+
+        // Entry distance into the object's box, in multiples of the ray direction
+        float distance;
+    };
+
+    // Bounding volume hierarchy over world space object boxes, built with the surface area heuristic.
+    // Moved objects are refit in place, objects inserted since the last build are tested linearly until the next one
+    class SceneIndex
+    {
+    public:
+        SceneIndex(const SceneIndexProperties &props = {});
+        ~SceneIndex();
+
+        uint32_t Insert(const BoundingBox &box);
+        void Update(uint32_t id, const BoundingBox &box);
+        void Remove(uint32_t id);
+
+        // Call once per frame before querying. Refits the nodes above moved objects, swaps in a finished background build
+        // and starts a new one once enough has changed
+        void Refit();
+
+        // Builds synchronously, for example after loading a scene
+        void Rebuild();
+
+        // Ids of the objects whose boxes intersect the frustum. Subtrees fully inside skip further plane tests
+        void Cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+        // Closest object box along the ray, for picking
+        bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance, SceneRayHit &hit) const;
+
+        size_t GetNumObjects() const;
+
+    private:
+        // Internal nodes have a count of 0 and their children at first and first + 1, leaves reference count objects starting at first
+        struct Node
+        {
+            BoundingBox box;
+            uint32_t first;
+            uint32_t count;
+            uint32_t parent;
+        };
+
+        struct Tree
+        {
+            std::vector<Node> nodes;
+            std::vector<uint32_t> objects;
+        };
+
+        struct Object
+        {
+            BoundingBox box;
+            uint32_t leaf;
+            bool alive;
+        };
+
+        SceneIndexProperties m_props;
+
+        std::vector<Object> m_objects;
+        std::vector<uint32_t> m_free_ids;
+        size_t m_num_alive;
+
+        Tree m_tree;
+        std::vector<uint32_t> m_pending;
+        std::vector<uint32_t> m_dirty_leaves;
+        std::vector<bool> m_refit_marks;
+        std::vector<uint32_t> m_refit_nodes;
+
+        size_t m_num_changes;
+        std::future<Tree> m_build;
+
+        static Tree Build(std::vector<BoundingBox> boxes, std::vector<uint32_t> ids, uint32_t max_leaf_size);
+
+        void StartBuild(bool background);
+        void Install(Tree &&tree);
+        void RefitNode(uint32_t index);
+    };
+}
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include<cstdint>
 #include<string>
 #include<memory>
+#include<vector>
+#include<cstring>
 
 namespace rut
 {
@@ -18,6 +20,12 @@ namespace rut
         ST_GEOMETRY
     };
 
+    struct ShaderDefine
+    {
+        std::string name;
+        std::string value = "1";
+    };
+
     class ShaderUnit
     {
     public:
@@ -27,7 +35,18 @@ namespace rut
 
         virtual uint64_t GetHandle() const = 0;
 
-        static std::shared_ptr<ShaderUnit> Create(Context *context, ShaderType type, const std::string &source);
+        static std::shared_ptr<ShaderUnit> Create(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines = {});
+    };
+
+    struct SpecializationConstant
+    {
+        uint32_t id;
+        uint32_t value;
+
+        SpecializationConstant(uint32_t id, int32_t value): id(id) { std::memcpy(&this->value, &value, sizeof(value)); }
+        SpecializationConstant(uint32_t id, uint32_t value): id(id), value(value) {}
+        SpecializationConstant(uint32_t id, float value): id(id) { std::memcpy(&this->value, &value, sizeof(value)); }
+        SpecializationConstant(uint32_t id, bool value): id(id), value(value ? 1 : 0) {}
     };
 
     struct UniformBindingProperties
@@ -35,7 +54,7 @@ namespace rut
         uint32_t binding;
         std::string name;
         ShaderType stage;
-        VertexLayout layout = {};
+        UniformLayout layout = {};
     };
 
     struct ShaderProgramProperties
@@ -51,6 +70,12 @@ namespace rut
         std::shared_ptr<ShaderUnit> geometry_shader;
 
         ShaderProgramProperties props = {};
+
+        // Values for the shaders' layout(constant_id = ...) constants, applied to every stage
+        std::vector<SpecializationConstant> specialization_constants;
+
+        // Directory for caching linked program binaries. Caching is disabled if empty
+        std::string binary_cache_directory;
     };
 
     class ShaderProgram
@@ -60,6 +85,7 @@ namespace rut
 
         virtual const ShaderProgramProperties &GetProperties() const = 0;
 
+        // Every uniform binding needs a buffer before a renderer using the program begins a pass
         virtual void BindUniformBuffer(uint32_t binding, std::shared_ptr<UniformBuffer> buffer) = 0;
 
         virtual uint64_t GetHandle() const = 0;
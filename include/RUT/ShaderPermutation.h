@@ -0,0 +1,55 @@
+#pragma once
+
+#include"Shader.h"
+
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<memory>
+#include<unordered_map>
+
+namespace rut
+{
+    class Context;
+
+    // A keyword without values is a boolean toggle which defines NAME when enabled.
+    // A keyword with values selects one of them and defines NAME=<index> and NAME_<VALUE>
+    struct ShaderKeyword
+    {
+        std::string name;
+        std::vector<std::string> values;
+    };
+
+    class ShaderPermutation
+    {
+    public:
+        ShaderPermutation(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderKeyword> &keywords);
+
+        // Keys of different keywords are combined with bitwise or. Build them once, not per draw
+        uint64_t GetKey(const std::string &keyword, uint32_t value = 1) const;
+
+        // Compiles the variant on first use
+        std::shared_ptr<ShaderUnit> Get(uint64_t key);
+
+        // Compiles the given variants ahead of time, in parallel where the render api allows it
+        void Precompile(const std::vector<uint64_t> &keys);
+
+        static std::shared_ptr<ShaderPermutation> Create(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderKeyword> &keywords);
+
+    private:
+        struct KeywordSlot
+        {
+            uint32_t shift;
+            uint32_t bits;
+        };
+
+        std::vector<ShaderDefine> GetDefines(uint64_t key) const;
+
+        Context *m_context;
+        ShaderType m_type;
+        std::string m_source;
+        std::vector<ShaderKeyword> m_keywords;
+        std::vector<KeywordSlot> m_slots;
+        std::unordered_map<uint64_t, std::shared_ptr<ShaderUnit>> m_variants;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#pragma once
+
+#include"UniformBuffer.h"
+#include"Layout.h"
+
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<vector>
+
+#include<glm/vec2.hpp>
+#include<glm/vec3.hpp>
+#include<glm/vec4.hpp>
+#include<glm/mat3x3.hpp>
+#include<glm/mat4x4.hpp>
+
+namespace rut
+{
+    class Context;
+
+    // glm::mat3 is tightly packed, std140 pads each column to a vec4
+    struct Std140Mat3
+    {
+        glm::vec4 columns[3];
+
+        Std140Mat3() = default;
+        Std140Mat3(const glm::mat3 &m): columns{ glm::vec4(m[0], 0.0f), glm::vec4(m[1], 0.0f), glm::vec4(m[2], 0.0f) } {}
+    };
+
+    // std140 pads every array element to a vec4
+    template<typename T, uint32_t N>
+    struct Std140Array
+    {
+        struct alignas(16) Element
+        {
+            T value;
+        };
+
+        Element elements[N];
+
+        T &operator[](uint32_t index) { return elements[index].value; }
+        const T &operator[](uint32_t index) const { return elements[index].value; }
+    };
+
+    template<typename T> struct UniformMemberTraits;
+
+    template<> struct UniformMemberTraits<int32_t>     { static constexpr Type TYPE = VT_INT;   static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<float>       { static constexpr Type TYPE = VT_FLOAT; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::ivec2>  { static constexpr Type TYPE = VT_IVEC2; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::vec2>   { static constexpr Type TYPE = VT_FVEC2; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::ivec3>  { static constexpr Type TYPE = VT_IVEC3; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::vec3>   { static constexpr Type TYPE = VT_FVEC3; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::ivec4>  { static constexpr Type TYPE = VT_IVEC4; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::vec4>   { static constexpr Type TYPE = VT_FVEC4; static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<Std140Mat3>  { static constexpr Type TYPE = VT_MAT3;  static constexpr uint32_t LENGTH = 1; };
+    template<> struct UniformMemberTraits<glm::mat4>   { static constexpr Type TYPE = VT_MAT4;  static constexpr uint32_t LENGTH = 1; };
+
+    template<typename T, uint32_t N>
+    struct UniformMemberTraits<Std140Array<T, N>>
+    {
+        static_assert(UniformMemberTraits<T>::LENGTH == 1, "Nested uniform arrays are not supported");
+
+        static constexpr Type TYPE = UniformMemberTraits<T>::TYPE;
+        static constexpr uint32_t LENGTH = N;
+    };
+
+    struct UniformMember
+    {
+        const char *name;
+        Type type;
+        uint32_t length;
+        size_t offset;
+    };
+
+    template<typename T>
+    constexpr UniformMember MakeUniformMember(const char *name, size_t offset)
+    {
+        return { name, UniformMemberTraits<T>::TYPE, UniformMemberTraits<T>::LENGTH, offset };
+    }
+
+    // Specialize with a static constexpr MEMBERS array listing each member through RUT_UNIFORM_MEMBER, in declaration order
+    template<typename T> struct UniformBlockTraits;
+
+#define RUT_UNIFORM_MEMBER(block, member) ::rut::MakeUniformMember<decltype(block::member)>(#member, offsetof(block, member))
+
+    template<typename T>
+    constexpr uint32_t GetStd140BlockSize()
+    {
+        uint32_t offset = 0;
+        for (const UniformMember &member : UniformBlockTraits<T>::MEMBERS)
+        {
+            uint32_t alignment = GetStd140Alignment(member.type, member.length);
+            offset = (offset + alignment - 1) / alignment * alignment;
+            offset += GetStd140Size(member.type, member.length);
+        }
+
+        return (offset + 15) / 16 * 16;
+    }
+
+    template<typename T>
+    constexpr bool IsStd140Compatible()
+    {
+        uint32_t offset = 0;
+        for (const UniformMember &member : UniformBlockTraits<T>::MEMBERS)
+        {
+            uint32_t alignment = GetStd140Alignment(member.type, member.length);
+            offset = (offset + alignment - 1) / alignment * alignment;
+            if (member.offset != offset)
+                return false;
+
+            offset += GetStd140Size(member.type, member.length);
+        }
+
+        return sizeof(T) <= GetStd140BlockSize<T>();
+    }
+
+    template<typename T>
+    UniformLayout CreateUniformLayout()
+    {
+        std::vector<UniformLayoutElement> elements;
+        for (const UniformMember &member : UniformBlockTraits<T>::MEMBERS)
+            elements.push_back({ member.name, member.type, member.length });
+
+        return UniformLayout(elements);
+    }
+
+    template<typename T>
+    class TypedUniformBuffer
+    {
+        static_assert(IsStd140Compatible<T>(), "Uniform block struct does not match the std140 layout");
+
+    public:
+        TypedUniformBuffer(Context *context):
+            m_buffer(UniformBuffer::Create(context, CreateUniformLayout<T>()))
+        {}
+
+        void Set(const T &value)
+        {
+            m_buffer->Map();
+            m_buffer->SetData(&value, sizeof(T));
+            m_buffer->Unmap();
+        }
+
+        const std::shared_ptr<UniformBuffer> &GetBuffer() const { return m_buffer; }
+
+        static constexpr uint32_t SIZE = GetStd140BlockSize<T>();
+
+        static std::shared_ptr<TypedUniformBuffer<T>> Create(Context *context) { return std::make_shared<TypedUniformBuffer<T>>(context); }
+
+    private:
+        std::shared_ptr<UniformBuffer> m_buffer;
+    };
+}
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
+#include"Layout.h"
+
 #include<cstdint>
+#include<cstring>
+#include<algorithm>
+#include<stdexcept>
 #include<string>
 #include<memory>
 
@@ -12,9 +17,43 @@
 
 namespace rut
 {
-    class UniformLayout;
     class Context;
 
+    struct UniformName
+    {
+        uint64_t hash;
+    };
+
+    namespace literals
+    {
+        constexpr UniformName operator""_uniform(const char *str, size_t length) { return { HashLayoutName(str, length) }; }
+    }
+
+    // Resolved location of a uniform variable. Packed variables match their client layout and are copied directly
+    struct UniformHandle
+    {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        bool packed = false;
+        const LayoutEntry *entry = nullptr;
+
+        bool IsValid() const { return entry != nullptr; }
+    };
+
+    // Layout type of each value type SetVariable accepts. Other value types fail to compile
+    template<typename T> struct UniformValueType;
+
+    template<> struct UniformValueType<int32_t>    { static constexpr Type TYPE = VT_INT; };
+    template<> struct UniformValueType<float>      { static constexpr Type TYPE = VT_FLOAT; };
+    template<> struct UniformValueType<glm::ivec2> { static constexpr Type TYPE = VT_IVEC2; };
+    template<> struct UniformValueType<glm::vec2>  { static constexpr Type TYPE = VT_FVEC2; };
+    template<> struct UniformValueType<glm::ivec3> { static constexpr Type TYPE = VT_IVEC3; };
+    template<> struct UniformValueType<glm::vec3>  { static constexpr Type TYPE = VT_FVEC3; };
+    template<> struct UniformValueType<glm::ivec4> { static constexpr Type TYPE = VT_IVEC4; };
+    template<> struct UniformValueType<glm::vec4>  { static constexpr Type TYPE = VT_FVEC4; };
+    template<> struct UniformValueType<glm::mat3>  { static constexpr Type TYPE = VT_MAT3; };
+    template<> struct UniformValueType<glm::mat4>  { static constexpr Type TYPE = VT_MAT4; };
+
     class UniformBuffer
     {
     public:
@@ -24,30 +63,68 @@ namespace rut
 
         virtual void Map() = 0;
         virtual void Unmap() = 0;
-        virtual void SetVariable(const std::string &name, int i) = 0;
-        virtual void SetVariable(const std::string &name, float f) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec2 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec2 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec3 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec3 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec4 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec4 &v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::mat3 &m) = 0;
-        virtual void SetVariable(const std::string &name, const glm::mat4 &m) = 0;
-        virtual void SetVariable(const std::string &name, const int *i) = 0;
-        virtual void SetVariable(const std::string &name, const float *f) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec2 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec2 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec3 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec3 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::ivec4 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::vec4 *v) = 0;
-        virtual void SetVariable(const std::string &name, const glm::mat3 *m) = 0;
-        virtual void SetVariable(const std::string &name, const glm::mat4 *m) = 0;
+
+        UniformHandle GetVariableHandle(const std::string &name) const;
+        UniformHandle GetVariableHandle(UniformName name) const;
+
+        // Values must only be set between Map and Unmap, and must match the variable's type exactly
+        template<typename T>
+        void SetVariable(const UniformHandle &handle, const T &value)
+        {
+            CheckType(handle, UniformValueType<T>::TYPE);
+            MarkDirty(handle.offset, handle.size);
+            if (handle.packed)
+                std::memcpy(m_mapped_data + handle.offset, &value, sizeof(T) < handle.size ? sizeof(T) : handle.size);
+            else if (handle.entry)
+                WriteLayoutEntry(*handle.entry, m_mapped_data + handle.offset, &value);
+        }
+
+        template<typename T>
+        void SetVariable(const UniformHandle &handle, const T *values)
+        {
+            CheckType(handle, UniformValueType<T>::TYPE);
+            MarkDirty(handle.offset, handle.size);
+            if (handle.packed)
+                std::memcpy(m_mapped_data + handle.offset, values, handle.size);
+            else if (handle.entry)
+                WriteLayoutEntry(*handle.entry, m_mapped_data + handle.offset, values);
+        }
+
+        void SetData(const void *data, uint32_t size, uint32_t offset = 0)
+        {
+            MarkDirty(offset, size);
+            std::memcpy(m_mapped_data + offset, data, size);
+        }
+
+        template<typename T>
+        void SetVariable(UniformName name, const T &value) { SetVariable(GetVariableHandle(name), value); }
+
+        template<typename T>
+        void SetVariable(const std::string &name, const T &value) { SetVariable(GetVariableHandle(name), value); }
 
         virtual uint64_t GetHandle() const = 0;
 
         static std::shared_ptr<UniformBuffer> Create(Context *context, const UniformLayout &layout);
         static std::shared_ptr<UniformBuffer> Create(Context *context, UniformLayout &&layout);
+    
+    protected:
+        static void CheckType(const UniformHandle &handle, Type type)
+        {
+            if (handle.entry && handle.entry->type != type)
+                throw std::runtime_error("Error setting uniform variable: Value type does not match the variable's type");
+        }
+
+        // Byte range written since the last upload. Backends upload only this range and skip clean buffers
+        void MarkDirty(uint32_t offset, uint32_t size)
+        {
+            m_dirty_begin = std::min(m_dirty_begin, offset);
+            m_dirty_end = std::max(m_dirty_end, offset + size);
+        }
+
+        bool IsDirty() const { return m_dirty_begin < m_dirty_end; }
+        void ClearDirty() { m_dirty_begin = UINT32_MAX; m_dirty_end = 0; }
+
+        uint8_t *m_mapped_data = nullptr;
+        uint32_t m_dirty_begin = UINT32_MAX, m_dirty_end = 0;
     };
 }
\ No newline at end of file
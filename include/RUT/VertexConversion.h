@@ -0,0 +1,14 @@
+#pragma once
+
+#include"Layout.h"
+
+#include<cstddef>
+
+namespace rut
+{
+    // Converts num_values values of the given type from tightly packed float components. Compact types are quantized, others copied
+    void ConvertVertexComponents(Type type, const float *src, void *dst, size_t num_values);
+
+    // Converts vertices between layouts, matching entries by name. Multi-stream data is stored stream after stream. Source entries of a different type than their destination must be float types
+    void ConvertVertices(const VertexLayout &dst_layout, void *dst, const VertexLayout &src_layout, const void *src, size_t num_vertices);
+}
\ No newline at end of file
@@ -7,8 +7,19 @@
 #include"Window.h"
 #include"Context.h"
 #include"Mesh.h"
+#include"MeshFile.h"
+#include"AssetStreamer.h"
+#include"ResidencyManager.h"
+#include"VertexConversion.h"
+#include"MeshOptimizer.h"
+#include"MeshLod.h"
+#include"Bounds.h"
+#include"SceneIndex.h"
 #include"Shader.h"
+#include"ShaderPermutation.h"
 #include"Renderer.h"
+#include"RenderTarget.h"
 #include"UniformBuffer.h"
+#include"TypedUniformBuffer.h"
 
 #include"Utils.h"
\ No newline at end of file
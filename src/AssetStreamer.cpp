@@ -0,0 +1,248 @@
+#include"RUT/AssetStreamer.h"
+#include"RUT/Layout.h"
+#include"RUT/MeshFile.h"
+#include"Parallel.h"
+
+#include<algorithm>
+#include<chrono>
+#include<iterator>
+#include<stdexcept>
+
+// Touching one byte per page faults the mapping in on the worker instead of during the upload
+static const size_t PREFETCH_PAGE_SIZE = 4096;
+
+static void PrefetchPages(const void *data, size_t size)
+{
+    const volatile uint8_t *bytes = static_cast<const volatile uint8_t*>(data);
+    uint8_t sum = 0;
+    for (size_t offset = 0; offset < size; offset += PREFETCH_PAGE_SIZE)
+        sum += bytes[offset];
+
+    (void)sum;
+}
+
+namespace rut
+{
+    AssetState AssetRequest::GetState() const { return m_state; }
+    int32_t AssetRequest::GetPriority() const { return m_priority; }
+    std::shared_future<std::shared_ptr<Mesh>> AssetRequest::GetFuture() const { return m_future; }
+
+    void AssetRequest::Cancel() { m_cancelled = true; }
+
+    AssetStreamer::AssetStreamer(Context *context, const AssetStreamerProperties &props):
+        m_context(context),
+        m_props(props),
+        m_stop(false),
+        m_sequence(0),
+        m_num_pending(0)
+    {
+        uint32_t num_threads = ResolveThreadCount(m_props.num_threads);
+        for (uint32_t i = 0; i < num_threads; ++i)
+            m_workers.emplace_back(&AssetStreamer::WorkerMain, this);
+    }
+
+    AssetStreamer::~AssetStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+
+        m_condition.notify_all();
+        for (std::thread &worker : m_workers)
+            worker.join();
+
+        for (auto *queue : { &m_load_queue, &m_upload_queue, &m_uploading })
+        {
+            for (const auto &request : *queue)
+                Finish(*request, AS_CANCELLED);
+        }
+    }
+
+    bool AssetStreamer::CompareRequests(const std::shared_ptr<AssetRequest> &a, const std::shared_ptr<AssetRequest> &b)
+    {
+        if (a->m_priority != b->m_priority)
+            return a->m_priority < b->m_priority;
+
+        return a->m_sequence > b->m_sequence;
+    }
+
+    std::shared_ptr<AssetRequest> AssetStreamer::LoadMesh(const std::string &path, int32_t priority, MeshUsage usage, MeshResidentCallback callback)
+    {
+        std::shared_ptr<AssetRequest> request = std::make_shared<AssetRequest>();
+        request->m_path = path;
+        request->m_usage = usage;
+        request->m_priority = priority;
+        request->m_callback = std::move(callback);
+        request->m_state = AS_QUEUED;
+        request->m_cancelled = false;
+        request->m_future = request->m_promise.get_future().share();
+        request->m_upload_step = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            request->m_sequence = m_sequence++;
+            m_load_queue.push_back(request);
+            std::push_heap(m_load_queue.begin(), m_load_queue.end(), CompareRequests);
+        }
+
+        ++m_num_pending;
+        m_condition.notify_one();
+        return request;
+    }
+
+    void AssetStreamer::WorkerMain()
+    {
+        while (true)
+        {
+            std::shared_ptr<AssetRequest> request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || !m_load_queue.empty(); });
+                if (m_stop)
+                    return;
+
+                std::pop_heap(m_load_queue.begin(), m_load_queue.end(), CompareRequests);
+                request = std::move(m_load_queue.back());
+                m_load_queue.pop_back();
+            }
+
+            if (request->m_cancelled)
+            {
+                Finish(*request, AS_CANCELLED);
+                continue;
+            }
+
+            request->m_state = AS_LOADING;
+            try
+            {
+                request->m_file = std::make_unique<MeshFile>(request->m_path);
+
+                const MeshFile &file = *request->m_file;
+                PrefetchPages(file.GetVertices(), file.GetNumVertices() * file.GetLayout().GetStride());
+                PrefetchPages(file.GetIndices(), file.GetNumIndices() * sizeof(uint32_t));
+            }
+            catch (...)
+            {
+                Finish(*request, AS_FAILED, std::current_exception());
+                continue;
+            }
+
+            request->m_state = AS_UPLOADING;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_upload_queue.push_back(std::move(request));
+        }
+    }
+
+    void AssetStreamer::Update()
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &request : m_upload_queue)
+            {
+                m_uploading.push_back(std::move(request));
+                std::push_heap(m_uploading.begin(), m_uploading.end(), CompareRequests);
+            }
+
+            m_upload_queue.clear();
+        }
+
+        size_t bytes = 0;
+        while (!m_uploading.empty())
+        {
+            // A preempted mesh keeps its uploaded streams and continues where it stopped
+            AssetRequest &request = *m_uploading.front();
+            if (request.m_cancelled)
+                Finish(request, AS_CANCELLED);
+            else
+            {
+                try
+                {
+                    bytes += UploadStep(request);
+                }
+                catch (...)
+                {
+                    Finish(request, AS_FAILED, std::current_exception());
+                }
+            }
+
+            if (request.m_state != AS_UPLOADING)
+            {
+                std::pop_heap(m_uploading.begin(), m_uploading.end(), CompareRequests);
+                m_uploading.pop_back();
+            }
+
+            float elapsed_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (bytes >= m_props.upload_budget_bytes || elapsed_ms >= m_props.upload_budget_ms)
+                break;
+        }
+
+        // Run outside the upload error handling, a throwing callback must not fail a request that already finished
+        std::vector<std::pair<MeshResidentCallback, std::shared_ptr<Mesh>>> callbacks = std::move(m_callbacks);
+        m_callbacks.clear();
+        for (size_t i = 0; i < callbacks.size(); ++i)
+        {
+            try
+            {
+                callbacks[i].first(callbacks[i].second);
+            }
+            catch (...)
+            {
+                m_callbacks.insert(m_callbacks.end(), std::make_move_iterator(callbacks.begin() + i + 1), std::make_move_iterator(callbacks.end()));
+                throw;
+            }
+        }
+    }
+
+    size_t AssetStreamer::UploadStep(AssetRequest &request)
+    {
+        const MeshFile &file = *request.m_file;
+        const VertexLayout &layout = file.GetLayout();
+        uint32_t num_streams = layout.GetNumStreams();
+
+        if (!request.m_mesh)
+            request.m_mesh = Mesh::Create(m_context, layout, request.m_usage);
+
+        // One step per vertex stream, then the indices
+        uint32_t step = request.m_upload_step++;
+        if (step < num_streams)
+        {
+            const uint8_t *vertices = static_cast<const uint8_t*>(file.GetVertices()) + file.GetNumVertices() * layout.GetStreamBase(step);
+            request.m_mesh->SetVertexStream(step, file.GetNumVertices(), vertices);
+            return file.GetNumVertices() * layout.GetStreamStride(step);
+        }
+
+        size_t index_bytes = file.GetNumIndices() * sizeof(uint32_t);
+        if (file.GetNumIndices())
+            request.m_mesh->SetIndices(file.GetNumIndices(), file.GetIndices());
+
+        request.m_mesh->SetLods(file.GetLods());
+        Finish(request, AS_RESIDENT);
+        return index_bytes;
+    }
+
+    void AssetStreamer::Finish(AssetRequest &request, AssetState state, std::exception_ptr error)
+    {
+        std::shared_ptr<Mesh> mesh = std::move(request.m_mesh);
+        request.m_file.reset();
+        request.m_state = state;
+
+        if (state == AS_RESIDENT)
+        {
+            request.m_promise.set_value(mesh);
+            if (request.m_callback)
+                m_callbacks.push_back({ std::move(request.m_callback), mesh });
+        }
+        else if (state == AS_CANCELLED)
+            request.m_promise.set_exception(std::make_exception_ptr(std::runtime_error("Error streaming mesh: '" + request.m_path + "' was cancelled")));
+        else
+            request.m_promise.set_exception(error);
+
+        request.m_callback = nullptr;
+        --m_num_pending;
+    }
+
+    size_t AssetStreamer::GetNumPending() const { return m_num_pending; }
+}
\ No newline at end of file
@@ -0,0 +1,331 @@
+#include"RUT/Bounds.h"
+#include"RUT/Api.h"
+#include"Parallel.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+
+#include<glm/common.hpp>
+
+#if defined(__AVX__)
+#define RUT_HAS_AVX
+#include<immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RUT_HAS_SSE2
+#include<emmintrin.h>
+#endif
+
+// Plane tests are cheap, only large batches are worth splitting across threads
+static const size_t CULL_PARALLEL_MIN_ITEMS = 1 << 14;
+
+#if defined(RUT_HAS_AVX)
+typedef __m256 SimdFloat;
+static const size_t SIMD_WIDTH = 8;
+
+static inline SimdFloat SimdSet1(float value) { return _mm256_set1_ps(value); }
+static inline SimdFloat SimdGather(const float *base, size_t stride) { return _mm256_setr_ps(base[0], base[stride], base[2 * stride], base[3 * stride], base[4 * stride], base[5 * stride], base[6 * stride], base[7 * stride]); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a, b); }
+static inline SimdFloat SimdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm256_and_ps(a, b); }
+static inline uint32_t SimdMask(SimdFloat a) { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+#elif defined(RUT_HAS_SSE2)
+typedef __m128 SimdFloat;
+static const size_t SIMD_WIDTH = 4;
+
+static inline SimdFloat SimdSet1(float value) { return _mm_set1_ps(value); }
+static inline SimdFloat SimdGather(const float *base, size_t stride) { return _mm_setr_ps(base[0], base[stride], base[2 * stride], base[3 * stride]); }
+static inline SimdFloat SimdAdd(SimdFloat a, SimdFloat b) { return _mm_add_ps(a, b); }
+static inline SimdFloat SimdMul(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a, b); }
+static inline SimdFloat SimdGreaterEqual(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a, b); }
+static inline SimdFloat SimdAnd(SimdFloat a, SimdFloat b) { return _mm_and_ps(a, b); }
+static inline uint32_t SimdMask(SimdFloat a) { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+#endif
+
+static float PlaneDistance(const glm::vec4 &plane, const glm::vec3 &point)
+{
+    return plane.x * point.x + plane.y * point.y + plane.z * point.z + plane.w;
+}
+
+static void CullSpheres(const rut::Frustum &frustum, const rut::BoundingSphere *spheres, size_t begin, size_t end, uint8_t *visibility)
+{
+    size_t i = begin;
+
+#if defined(RUT_HAS_AVX) || defined(RUT_HAS_SSE2)
+    SimdFloat nx[6], ny[6], nz[6], d[6];
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        nx[p] = SimdSet1(frustum.planes[p].x);
+        ny[p] = SimdSet1(frustum.planes[p].y);
+        nz[p] = SimdSet1(frustum.planes[p].z);
+        d[p] = SimdSet1(frustum.planes[p].w);
+    }
+
+    SimdFloat negate = SimdSet1(-1.0f);
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH)
+    {
+        const float *base = &spheres[i].center.x;
+        SimdFloat cx = SimdGather(base, 4), cy = SimdGather(base + 1, 4), cz = SimdGather(base + 2, 4);
+        SimdFloat neg_radius = SimdMul(SimdGather(base + 3, 4), negate);
+
+        SimdFloat inside;
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            SimdFloat distance = SimdAdd(SimdAdd(SimdMul(nx[p], cx), SimdMul(ny[p], cy)), SimdAdd(SimdMul(nz[p], cz), d[p]));
+            SimdFloat plane_inside = SimdGreaterEqual(distance, neg_radius);
+            inside = p == 0 ? plane_inside : SimdAnd(inside, plane_inside);
+        }
+
+        uint32_t mask = SimdMask(inside);
+        for (size_t j = 0; j < SIMD_WIDTH; ++j)
+            visibility[i + j] = (mask >> j) & 1;
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        bool inside = true;
+        for (uint32_t p = 0; p < 6 && inside; ++p)
+            inside = PlaneDistance(frustum.planes[p], spheres[i].center) >= -spheres[i].radius;
+
+        visibility[i] = inside;
+    }
+}
+
+// A box is outside once its corner furthest along a plane's normal is behind it
+static void CullBoxes(const rut::Frustum &frustum, const rut::BoundingBox *boxes, size_t begin, size_t end, uint8_t *visibility)
+{
+    size_t i = begin;
+
+#if defined(RUT_HAS_AVX) || defined(RUT_HAS_SSE2)
+    const size_t stride = sizeof(rut::BoundingBox) / sizeof(float);
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH)
+    {
+        const float *min = &boxes[i].min.x, *max = &boxes[i].max.x;
+        SimdFloat min_x = SimdGather(min, stride), min_y = SimdGather(min + 1, stride), min_z = SimdGather(min + 2, stride);
+        SimdFloat max_x = SimdGather(max, stride), max_y = SimdGather(max + 1, stride), max_z = SimdGather(max + 2, stride);
+
+        SimdFloat inside;
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            SimdFloat x = plane.x >= 0.0f ? max_x : min_x;
+            SimdFloat y = plane.y >= 0.0f ? max_y : min_y;
+            SimdFloat z = plane.z >= 0.0f ? max_z : min_z;
+
+            SimdFloat distance = SimdAdd(SimdAdd(SimdMul(SimdSet1(plane.x), x), SimdMul(SimdSet1(plane.y), y)), SimdAdd(SimdMul(SimdSet1(plane.z), z), SimdSet1(plane.w)));
+            SimdFloat plane_inside = SimdGreaterEqual(distance, SimdSet1(0.0f));
+            inside = p == 0 ? plane_inside : SimdAnd(inside, plane_inside);
+        }
+
+        uint32_t mask = SimdMask(inside);
+        for (size_t j = 0; j < SIMD_WIDTH; ++j)
+            visibility[i + j] = (mask >> j) & 1;
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        bool inside = true;
+        for (uint32_t p = 0; p < 6 && inside; ++p)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            glm::vec3 corner(plane.x >= 0.0f ? boxes[i].max.x : boxes[i].min.x, plane.y >= 0.0f ? boxes[i].max.y : boxes[i].min.y, plane.z >= 0.0f ? boxes[i].max.z : boxes[i].min.z);
+            inside = PlaneDistance(plane, corner) >= 0.0f;
+        }
+
+        visibility[i] = inside;
+    }
+}
+
+namespace rut
+{
+    bool UpdateMeshBounds(MeshBounds &bounds, const VertexLayout &layout, uint32_t stream, size_t num_vertices, const void *data)
+    {
+        const LayoutEntry *entry = layout.Find(HashLayoutName("position", 8));
+        if (!entry || entry->stream != stream)
+            return false;
+
+        uint32_t num_components;
+        switch (entry->type)
+        {
+            case VT_FVEC2: num_components = 2; break;
+            case VT_FVEC3: num_components = 3; break;
+            case VT_FVEC4: num_components = 4; break;
+            default: return false;
+        }
+
+        bounds = MeshBounds{};
+        if (num_vertices == 0)
+            return true;
+
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data) + entry->offset;
+        uint32_t stride = layout.GetStreamStride(stream);
+
+#ifdef RUT_HAS_SSE2
+        // Whole vec4 loads may read into the next vertex, except for the last one. Unused lanes are masked to 0
+        size_t buffer_size = num_vertices * stride - entry->offset;
+        const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, num_components > 2 ? -1 : 0, 0));
+        auto load = [&](size_t i)
+        {
+            if (i * stride + 4 * sizeof(float) <= buffer_size)
+                return _mm_and_ps(_mm_loadu_ps(reinterpret_cast<const float*>(bytes + i * stride)), mask);
+
+            float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            std::memcpy(p, bytes + i * stride, std::min(num_components, 3u) * sizeof(float));
+            return _mm_loadu_ps(p);
+        };
+
+        __m128 min = load(0), max = min;
+        for (size_t i = 1; i < num_vertices; ++i)
+        {
+            __m128 p = load(i);
+            min = _mm_min_ps(min, p);
+            max = _mm_max_ps(max, p);
+        }
+
+        __m128 center = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+        __m128 max_distance = _mm_setzero_ps();
+        for (size_t i = 0; i < num_vertices; ++i)
+        {
+            __m128 offset = _mm_sub_ps(load(i), center);
+            __m128 squared = _mm_mul_ps(offset, offset);
+            squared = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+            squared = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 0, 3, 2)));
+            max_distance = _mm_max_ps(max_distance, squared);
+        }
+
+        float min_values[4], max_values[4];
+        _mm_storeu_ps(min_values, min);
+        _mm_storeu_ps(max_values, max);
+
+        bounds.box.min = glm::vec3(min_values[0], min_values[1], min_values[2]);
+        bounds.box.max = glm::vec3(max_values[0], max_values[1], max_values[2]);
+        bounds.sphere.center = (bounds.box.min + bounds.box.max) * 0.5f;
+        bounds.sphere.radius = std::sqrt(_mm_cvtss_f32(max_distance));
+#else
+        auto load = [&](size_t i)
+        {
+            float p[3] = { 0.0f, 0.0f, 0.0f };
+            std::memcpy(p, bytes + i * stride, std::min(num_components, 3u) * sizeof(float));
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        bounds.box.min = bounds.box.max = load(0);
+        for (size_t i = 1; i < num_vertices; ++i)
+        {
+            glm::vec3 p = load(i);
+            bounds.box.min = glm::min(bounds.box.min, p);
+            bounds.box.max = glm::max(bounds.box.max, p);
+        }
+
+        bounds.sphere.center = (bounds.box.min + bounds.box.max) * 0.5f;
+
+        float max_distance = 0.0f;
+        for (size_t i = 0; i < num_vertices; ++i)
+        {
+            glm::vec3 offset = load(i) - bounds.sphere.center;
+            max_distance = std::max(max_distance, offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+        }
+
+        bounds.sphere.radius = std::sqrt(max_distance);
+#endif
+
+        bounds.valid = true;
+        return true;
+    }
+
+    BoundingBox TransformBox(const BoundingBox &box, const glm::mat4 &transform)
+    {
+        // Arvo, transforms the center and accumulates the absolute extents
+        glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+        glm::vec3 new_center(transform[3]), new_extent(0.0f);
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                new_center[i] += transform[j][i] * center[j];
+                new_extent[i] += std::abs(transform[j][i]) * extent[j];
+            }
+        }
+
+        return { new_center - new_extent, new_center + new_extent };
+    }
+
+    BoundingSphere TransformSphere(const BoundingSphere &sphere, const glm::mat4 &transform)
+    {
+        glm::vec3 center(transform * glm::vec4(sphere.center, 1.0f));
+
+        float scale = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            glm::vec3 axis(transform[i]);
+            scale = std::max(scale, axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+        }
+
+        return { center, sphere.radius * std::sqrt(scale) };
+    }
+
+    Frustum::Frustum(const glm::mat4 &view_projection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+
+        // Gribb and Hartmann. Vulkan and DX11 clip depth to [0, w] instead of [-w, w]
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = Api::GetRenderApi() == RENDER_API_OPENGL ? rows[3] + rows[2] : rows[2];
+        planes[5] = rows[3] - rows[2];
+
+        for (glm::vec4 &plane : planes)
+        {
+            // Far planes of infinite projections have no normal, they are replaced by one culling nothing
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            plane = length > 0.0f ? plane / length : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    FrustumCuller::FrustumCuller(uint32_t num_threads):
+        m_num_threads(ResolveThreadCount(num_threads))
+    {}
+
+    const std::vector<uint32_t> &FrustumCuller::Cull(const Frustum &frustum, const BoundingSphere *spheres, size_t count)
+    {
+        m_visibility.resize(count);
+        ParallelFor(count, m_num_threads, CULL_PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+        {
+            CullSpheres(frustum, spheres, begin, end, m_visibility.data());
+        });
+
+        return Compact(count);
+    }
+
+    const std::vector<uint32_t> &FrustumCuller::Cull(const Frustum &frustum, const BoundingBox *boxes, size_t count)
+    {
+        m_visibility.resize(count);
+        ParallelFor(count, m_num_threads, CULL_PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+        {
+            CullBoxes(frustum, boxes, begin, end, m_visibility.data());
+        });
+
+        return Compact(count);
+    }
+
+    const std::vector<uint32_t> &FrustumCuller::Compact(size_t count)
+    {
+        m_visible.clear();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (m_visibility[i])
+                m_visible.push_back(static_cast<uint32_t>(i));
+        }
+
+        return m_visible;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include"BufferHeap.h"
+
+#include<algorithm>
+#include<stdexcept>
+
+namespace rut
+{
+    BufferHeap::BufferHeap(const BufferHeapProperties &props):
+        m_props(props),
+        m_frame(0),
+        m_capacity(0),
+        m_used(0),
+        m_defrag_pending(false)
+    {}
+
+    BufferHeap::Handle BufferHeap::Allocate(uint64_t size, MoveCallback on_move)
+    {
+        size = std::max<uint64_t>((size + m_props.alignment - 1) / m_props.alignment * m_props.alignment, m_props.alignment);
+
+        uint32_t block = UINT32_MAX;
+        uint64_t offset = 0;
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            if (m_blocks[i].alive && TakeRange(i, size, UINT64_MAX, offset))
+            {
+                block = i;
+                break;
+            }
+        }
+
+        if (block == UINT32_MAX)
+        {
+            block = NewBlock(std::max(m_props.block_size, size));
+            TakeRange(block, size, UINT64_MAX, offset);
+        }
+
+        Handle handle;
+        if (m_free_handles.empty())
+        {
+            handle = static_cast<Handle>(m_allocations.size());
+            m_allocations.emplace_back();
+        }
+        else
+        {
+            handle = m_free_handles.back();
+            m_free_handles.pop_back();
+        }
+
+        m_allocations[handle] = { block, offset, size, std::move(on_move), true };
+        m_blocks[block].live.insert({ offset, handle });
+        return handle;
+    }
+
+    void BufferHeap::Free(Handle handle)
+    {
+        Allocation &allocation = m_allocations[handle];
+        if (!allocation.alive)
+            throw std::runtime_error("Error freeing buffer heap range: Range was already freed");
+
+        m_blocks[allocation.block].live.erase({ allocation.offset, handle });
+        Retire(allocation.block, allocation.offset, allocation.size);
+
+        allocation.alive = false;
+        allocation.on_move = nullptr;
+        m_free_handles.push_back(handle);
+    }
+
+    uint32_t BufferHeap::GetBlock(Handle handle) const { return m_allocations[handle].block; }
+    uint64_t BufferHeap::GetOffset(Handle handle) const { return m_allocations[handle].offset; }
+    uint64_t BufferHeap::GetSize(Handle handle) const { return m_allocations[handle].size; }
+
+    uint64_t BufferHeap::GetCapacity() const { return m_capacity; }
+    uint64_t BufferHeap::GetUsedBytes() const { return m_used; }
+
+    size_t BufferHeap::GetNumBlocks() const
+    {
+        return std::count_if(m_blocks.begin(), m_blocks.end(), [](const Block &block) { return block.alive; });
+    }
+
+    bool BufferHeap::IsBlockAlive(uint32_t block) const { return m_blocks[block].alive; }
+    uint32_t BufferHeap::GetNumBlockSlots() const { return static_cast<uint32_t>(m_blocks.size()); }
+
+    bool BufferHeap::TakeRange(uint32_t block, uint64_t size, uint64_t limit, uint64_t &offset)
+    {
+        // First fit keeps live ranges packed towards the start of the block
+        std::map<uint64_t, uint64_t> &free_ranges = m_blocks[block].free_ranges;
+        for (auto it = free_ranges.begin(); it != free_ranges.end() && it->first + size <= limit; ++it)
+        {
+            if (it->second < size)
+                continue;
+
+            offset = it->first;
+            uint64_t remaining = it->second - size;
+            free_ranges.erase(it);
+            if (remaining)
+                free_ranges[offset + size] = remaining;
+
+            m_blocks[block].used += size;
+            m_used += size;
+            return true;
+        }
+
+        return false;
+    }
+
+    void BufferHeap::ReturnRange(uint32_t block, uint64_t offset, uint64_t size)
+    {
+        std::map<uint64_t, uint64_t> &free_ranges = m_blocks[block].free_ranges;
+        auto next = free_ranges.lower_bound(offset);
+
+        if (next != free_ranges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = free_ranges.erase(next);
+        }
+
+        if (next != free_ranges.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                size += prev->second;
+                free_ranges.erase(prev);
+            }
+        }
+
+        free_ranges[offset] = size;
+        m_defrag_pending = true;
+    }
+
+    void BufferHeap::Retire(uint32_t block, uint64_t offset, uint64_t size)
+    {
+        m_blocks[block].used -= size;
+        m_used -= size;
+
+        if (m_props.retire_frames == 0)
+        {
+            ReturnRange(block, offset, size);
+            return;
+        }
+
+        m_retiring.push_back({ block, offset, size, m_frame });
+        ++m_blocks[block].num_retiring;
+    }
+
+    uint32_t BufferHeap::NewBlock(uint64_t size)
+    {
+        uint32_t index = 0;
+        while (index < m_blocks.size() && m_blocks[index].alive)
+            ++index;
+
+        if (index == m_blocks.size())
+            m_blocks.emplace_back();
+
+        CreateBlock(index, size);
+
+        Block &block = m_blocks[index];
+        block.size = size;
+        block.used = 0;
+        block.alive = true;
+        block.free_ranges = { { 0, size } };
+        block.live.clear();
+        block.num_retiring = 0;
+
+        m_capacity += size;
+        return index;
+    }
+
+    void BufferHeap::ReleaseEmptyBlocks()
+    {
+        size_t num_alive = GetNumBlocks();
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            Block &block = m_blocks[i];
+            if (!block.alive || !block.live.empty() || block.num_retiring)
+                continue;
+
+            // One regular block is kept around so a heap that briefly runs empty doesn't recreate it
+            if (num_alive == 1 && block.size <= m_props.block_size)
+                break;
+
+            DestroyBlock(i);
+            block.alive = false;
+            block.free_ranges.clear();
+            m_capacity -= block.size;
+            --num_alive;
+        }
+    }
+
+    void BufferHeap::Update()
+    {
+        ++m_frame;
+
+        auto retired = std::partition(m_retiring.begin(), m_retiring.end(), [this](const RetiringRange &range)
+        {
+            return range.frame + m_props.retire_frames > m_frame;
+        });
+
+        for (auto it = retired; it != m_retiring.end(); ++it)
+        {
+            ReturnRange(it->block, it->offset, it->size);
+            --m_blocks[it->block].num_retiring;
+        }
+
+        m_retiring.erase(retired, m_retiring.end());
+
+        Defragment();
+        ReleaseEmptyBlocks();
+    }
+
+    void BufferHeap::Defragment()
+    {
+        // Only freed ranges open up new moves, so a pass that found none isn't repeated until then
+        if (!m_defrag_pending || m_capacity == 0 || m_capacity - m_used <= static_cast<uint64_t>(m_props.defrag_threshold * m_capacity))
+            return;
+
+        std::vector<Move> moves;
+        std::vector<Handle> moved;
+        uint64_t budget = m_props.defrag_bytes_per_frame;
+
+        // Live ranges of a block, last first
+        auto GetCandidates = [this](uint32_t block)
+        {
+            std::vector<Handle> handles;
+            for (auto it = m_blocks[block].live.rbegin(); it != m_blocks[block].live.rend(); ++it)
+                handles.push_back(it->second);
+
+            return handles;
+        };
+
+        auto TryMove = [&](Handle handle, uint32_t dst_block, uint64_t limit)
+        {
+            const Allocation &allocation = m_allocations[handle];
+            if (!moves.empty() && allocation.size > budget)
+                return false;
+
+            uint64_t dst_offset;
+            if (!TakeRange(dst_block, allocation.size, limit, dst_offset))
+                return false;
+
+            moves.push_back({ allocation.block, allocation.offset, dst_block, dst_offset, allocation.size });
+            moved.push_back(handle);
+            budget -= std::min(budget, allocation.size);
+            return true;
+        };
+
+        std::vector<uint32_t> blocks;
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            if (m_blocks[i].alive)
+                blocks.push_back(i);
+        }
+
+        // Fullest first
+        std::sort(blocks.begin(), blocks.end(), [this](uint32_t a, uint32_t b) { return m_blocks[a].used > m_blocks[b].used; });
+
+        // Empty the least used block into the others, so it can be released
+        if (blocks.size() > 1)
+        {
+            uint32_t source = blocks.back();
+            for (Handle handle : GetCandidates(source))
+            {
+                bool placed = false;
+                for (size_t i = 0; i + 1 < blocks.size() && !placed; ++i)
+                    placed = TryMove(handle, blocks[i], UINT64_MAX);
+
+                if (!placed || budget == 0)
+                    break;
+            }
+        }
+
+        // Otherwise close the gaps inside blocks by moving their last ranges forward
+        if (moves.empty())
+        {
+            for (uint32_t block : blocks)
+            {
+                for (Handle handle : GetCandidates(block))
+                {
+                    TryMove(handle, block, m_allocations[handle].offset);
+                    if (budget == 0)
+                        break;
+                }
+
+                if (budget == 0)
+                    break;
+            }
+        }
+
+        if (moves.empty())
+        {
+            m_defrag_pending = false;
+            return;
+        }
+
+        CopyRanges(moves);
+
+        // Sources are only retired now, so no move of this batch can have written over another's source
+        for (size_t i = 0; i < moves.size(); ++i)
+        {
+            const Move &move = moves[i];
+            Allocation &allocation = m_allocations[moved[i]];
+
+            m_blocks[move.src_block].live.erase({ move.src_offset, moved[i] });
+            m_blocks[move.dst_block].live.insert({ move.dst_offset, moved[i] });
+            Retire(move.src_block, move.src_offset, move.size);
+
+            allocation.block = move.dst_block;
+            allocation.offset = move.dst_offset;
+            if (allocation.on_move)
+                allocation.on_move(move.dst_block, move.dst_offset);
+        }
+    }
+}
\ No newline at end of file
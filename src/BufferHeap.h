@@ -0,0 +1,130 @@
+#pragma once
+
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<map>
+#include<set>
+#include<utility>
+#include<vector>
+
+namespace rut
+{
+    struct BufferHeapProperties
+    {
+        uint64_t block_size = 64ull << 20;
+        uint64_t alignment = 256;
+
+        // Frames freed and moved-from ranges stay reserved, while frames in flight may still read them
+        uint32_t retire_frames = 0;
+
+        // Defragmentation runs while more than defrag_threshold of the block memory is free, moving at most defrag_bytes_per_frame per Update
+        float defrag_threshold = 0.25f;
+        uint64_t defrag_bytes_per_frame = 4ull << 20;
+    };
+
+    // Sub-allocates ranges of large gpu buffers, called blocks, for the backends to fill. Update compacts the heap incrementally:
+    // it moves live ranges out of the emptiest block, or towards the start of a block, and releases blocks that run empty
+    class BufferHeap
+    {
+    public:
+        typedef uint32_t Handle;
+        static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+        // Called after a range was moved, with its new block and offset
+        typedef std::function<void(uint32_t block, uint64_t offset)> MoveCallback;
+
+        BufferHeap(const BufferHeapProperties &props);
+        virtual ~BufferHeap() = default;
+
+        BufferHeap(const BufferHeap&) = delete;
+        BufferHeap &operator=(const BufferHeap&) = delete;
+
+        // Ranges larger than the block size get a block of their own
+        Handle Allocate(uint64_t size, MoveCallback on_move);
+        void Free(Handle handle);
+
+        uint32_t GetBlock(Handle handle) const;
+        uint64_t GetOffset(Handle handle) const;
+        uint64_t GetSize(Handle handle) const;
+
+        // Call once per frame, once the frame retire_frames ago has finished on the gpu
+        void Update();
+
+        uint64_t GetCapacity() const;
+        uint64_t GetUsedBytes() const;
+        size_t GetNumBlocks() const;
+
+    protected:
+        struct Move
+        {
+            uint32_t src_block;
+            uint64_t src_offset;
+            uint32_t dst_block;
+            uint64_t dst_offset;
+            uint64_t size;
+        };
+
+        // Blocks are numbered densely, a released number is reused by the next block created
+        virtual void CreateBlock(uint32_t block, uint64_t size) = 0;
+        virtual void DestroyBlock(uint32_t block) = 0;
+
+        // Source and destination ranges never overlap. The copies must be complete before the next draw reads the new ranges
+        virtual void CopyRanges(const std::vector<Move> &moves) = 0;
+
+        // For the destructors of derived heaps, which release their own block storage
+        bool IsBlockAlive(uint32_t block) const;
+        uint32_t GetNumBlockSlots() const;
+
+    private:
+        struct Block
+        {
+            uint64_t size;
+            uint64_t used;
+            bool alive;
+
+            // Offset to size, adjacent free ranges are merged
+            std::map<uint64_t, uint64_t> free_ranges;
+
+            // Offset and handle of the live ranges
+            std::set<std::pair<uint64_t, Handle>> live;
+            uint32_t num_retiring;
+        };
+
+        struct Allocation
+        {
+            uint32_t block;
+            uint64_t offset;
+            uint64_t size;
+            MoveCallback on_move;
+            bool alive;
+        };
+
+        struct RetiringRange
+        {
+            uint32_t block;
+            uint64_t offset;
+            uint64_t size;
+            uint64_t frame;
+        };
+
+        BufferHeapProperties m_props;
+        std::vector<Block> m_blocks;
+        std::vector<Allocation> m_allocations;
+        std::vector<Handle> m_free_handles;
+        std::vector<RetiringRange> m_retiring;
+
+        uint64_t m_frame;
+        uint64_t m_capacity, m_used;
+
+        // Set when a range is returned to a free list, cleared by a defragmentation pass that finds nothing to move
+        bool m_defrag_pending;
+
+        bool TakeRange(uint32_t block, uint64_t size, uint64_t limit, uint64_t &offset);
+        void ReturnRange(uint32_t block, uint64_t offset, uint64_t size);
+        void Retire(uint32_t block, uint64_t offset, uint64_t size);
+        uint32_t NewBlock(uint64_t size);
+        void ReleaseEmptyBlocks();
+        void Defragment();
+    };
+}
\ No newline at end of file
@@ -1,273 +1,266 @@
 #include"RUT/Layout.h"
 
 #include<cstring>
+#include<stdexcept>
 
 static const uint32_t VERTEX_TYPE_BYTES[] =
 {
-    4, 4, 8, 8, 12, 12, 16, 16, 36, 64
+    4, 4, 8, 8, 12, 12, 16, 16, 36, 64,
+    4, 8, 4, 4, 4, 4, 8, 8, 4, 4
 };
 
 static const uint32_t VERTEX_TYPE_COUNTS[] =
 {
-    1, 1, 2, 2, 3, 3, 4, 4, 9, 16
+    1, 1, 2, 2, 3, 3, 4, 4, 9, 16,
+    2, 4, 4, 4, 2, 2, 4, 4, 4, 4
 };
 
-namespace rut
+static const uint32_t MATRIX_TYPE_DIMENSIONS[] =
 {
-    LayoutItem::LayoutItem() {}
-    LayoutItem::LayoutItem(const LayoutItem &item):
-        m_name(item.m_name),
-        m_type(item.m_type),
-        m_offset(item.m_offset),
-        m_size(item.m_size),
-        m_count(item.m_count),
-        m_length(item.m_length)
-    {}
-
-    const std::string &LayoutItem::GetName() const { return m_name; }
-    Type LayoutItem::GetType() const { return m_type; }
-    uint32_t LayoutItem::GetOffset() const { return m_offset; }
-    uint32_t LayoutItem::GetSize() const { return m_size; }
-    uint32_t LayoutItem::GetCount() const { return m_count; }
-    uint32_t LayoutItem::GetLength() const { return m_length; }
-    void LayoutItem::SetName(const std::string &name) { m_name = name; }
-    void LayoutItem::SetType(Type type) { m_type = type; }
-    void LayoutItem::SetOffset(uint32_t offset) { m_offset = offset; }
-    void LayoutItem::SetSize(uint32_t size) { m_size = size; }
-    void LayoutItem::SetCount(uint32_t count) { m_count = count; }
-    void LayoutItem::SetLength(uint32_t length) { m_length = length; }
-
-    void VertexLayoutItem::Read(void *dst, const void *src) const { std::memcpy(dst, src, GetSize()); }
-    void VertexLayoutItem::Write(void *dst, const void *src) const { std::memcpy(dst, src, GetSize()); }
-
-    LayoutItem *VertexLayoutItem::Copy() const { return new VertexLayoutItem(*this); }
-
-    UniformArrayLayoutItem::UniformArrayLayoutItem() {}
-    UniformArrayLayoutItem::UniformArrayLayoutItem(const UniformArrayLayoutItem &item):
-        LayoutItem(item),
-        m_item(item.m_item->Copy()),
-        m_stride(item.m_stride)
-    {}
-
-    UniformArrayLayoutItem::~UniformArrayLayoutItem()
-    {
-        delete m_item;
-    }
+    0, 0, 0, 0, 0, 0, 0, 0, 3, 4,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
 
-    LayoutItem *UniformArrayLayoutItem::GetItem() const { return m_item; }
-    uint32_t UniformArrayLayoutItem::GetStride() const { return m_stride; }
-    void UniformArrayLayoutItem::SetItem(LayoutItem *item) { m_item = item; }
-    void UniformArrayLayoutItem::SetStride(uint32_t stride) { m_stride = stride; }
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
 
-    void UniformArrayLayoutItem::Read(void *dst, const void *src) const
+namespace rut
+{
+    void ReadLayoutEntry(const LayoutEntry &entry, void *dst, const void *src)
     {
         uint8_t *dst_itr = reinterpret_cast<uint8_t*>(dst);
         const uint8_t *src_itr = reinterpret_cast<const uint8_t*>(src);
-        for (uint32_t i = 0; i < GetLength(); ++i)
+
+        switch (entry.copy)
         {
-            m_item->Read(dst_itr, src_itr);
-            dst_itr += m_item->GetSize();
-            src_itr += m_stride;
+            case LC_PACKED:
+                std::memcpy(dst_itr, src_itr, entry.client_size * entry.length);
+                break;
+            
+            case LC_STRIDED:
+                for (uint32_t i = 0; i < entry.length; ++i, dst_itr += entry.client_size, src_itr += entry.stride)
+                    std::memcpy(dst_itr, src_itr, entry.client_size);
+                break;
+            
+            case LC_MATRIX:
+            {
+                uint32_t dimension = MATRIX_TYPE_DIMENSIONS[entry.type];
+                uint32_t column_bytes = dimension * sizeof(float);
+                for (uint32_t i = 0; i < entry.length; ++i, src_itr += entry.stride)
+                {
+                    for (uint32_t c = 0; c < dimension; ++c, dst_itr += column_bytes)
+                        std::memcpy(dst_itr, src_itr + c * entry.column_stride, column_bytes);
+                }
+                break;
+            }
         }
     }
 
-    void UniformArrayLayoutItem::Write(void *dst, const void *src) const
+    void WriteLayoutEntry(const LayoutEntry &entry, void *dst, const void *src)
     {
         uint8_t *dst_itr = reinterpret_cast<uint8_t*>(dst);
         const uint8_t *src_itr = reinterpret_cast<const uint8_t*>(src);
-        for (uint32_t i = 0; i < GetLength(); ++i)
+
+        switch (entry.copy)
         {
-            m_item->Read(dst_itr, src_itr);
-            dst_itr += m_stride;
-            src_itr += m_item->GetSize();
+            case LC_PACKED:
+                std::memcpy(dst_itr, src_itr, entry.client_size * entry.length);
+                break;
+            
+            case LC_STRIDED:
+                for (uint32_t i = 0; i < entry.length; ++i, dst_itr += entry.stride, src_itr += entry.client_size)
+                    std::memcpy(dst_itr, src_itr, entry.client_size);
+                break;
+            
+            case LC_MATRIX:
+            {
+                uint32_t dimension = MATRIX_TYPE_DIMENSIONS[entry.type];
+                uint32_t column_bytes = dimension * sizeof(float);
+                for (uint32_t i = 0; i < entry.length; ++i, dst_itr += entry.stride)
+                {
+                    for (uint32_t c = 0; c < dimension; ++c, src_itr += column_bytes)
+                        std::memcpy(dst_itr + c * entry.column_stride, src_itr, column_bytes);
+                }
+                break;
+            }
         }
     }
 
-    LayoutItem *UniformArrayLayoutItem::Copy() const { return new UniformArrayLayoutItem(*this); }
-
-    UniformMatrixLayoutItem::UniformMatrixLayoutItem() {}
-    UniformMatrixLayoutItem::UniformMatrixLayoutItem(const UniformMatrixLayoutItem &item):
-        LayoutItem(item),
-        m_stride(item.m_stride),
-        m_dimension(item.m_dimension)
-    {}
+    Layout::VecType::const_iterator Layout::begin() const { return m_entries.begin(); }
+    Layout::VecType::const_iterator Layout::end() const { return m_entries.end(); }
 
-    uint32_t UniformMatrixLayoutItem::GetStride() const { return m_stride; }
-    uint32_t UniformMatrixLayoutItem::GetDimension() const { return m_dimension; }
-    void UniformMatrixLayoutItem::SetStride(uint32_t stride) { m_stride = stride; }
-    void UniformMatrixLayoutItem::SetDimension(uint32_t dimension) { m_dimension = dimension; }
+    size_t Layout::GetNumEntries() const { return m_entries.size(); }
+    const LayoutEntry &Layout::operator[](size_t index) const { return m_entries[index]; }
 
-    void UniformMatrixLayoutItem::Read(void *dst, const void *src) const
+    const LayoutEntry *Layout::Find(uint64_t name_hash) const
     {
-        uint8_t *dst_itr = reinterpret_cast<uint8_t*>(dst);
-        const uint8_t *src_itr = reinterpret_cast<const uint8_t*>(src);
-        for (uint32_t i = 0; i < m_dimension; ++i)
+        for (const LayoutEntry &entry : m_entries)
         {
-            std::memcpy(dst_itr, src_itr, m_dimension * sizeof(float));
-            dst_itr += m_dimension * sizeof(float);
-            src_itr += m_stride;
+            if (entry.name_hash == name_hash)
+                return &entry;
         }
-    }
 
-    void UniformMatrixLayoutItem::Write(void *dst, const void *src) const
-    {
-        uint8_t *dst_itr = reinterpret_cast<uint8_t*>(dst);
-        const uint8_t *src_itr = reinterpret_cast<const uint8_t*>(src);
-        for (uint32_t i = 0; i < m_dimension; ++i)
-        {
-            std::memcpy(dst_itr, src_itr, m_dimension * sizeof(float));
-            dst_itr += m_stride;
-            src_itr += m_dimension * sizeof(float);
-        }
+        return nullptr;
     }
 
-    LayoutItem *UniformMatrixLayoutItem::Copy() const { return new UniformMatrixLayoutItem(*this); }
+    const char *Layout::GetName(const LayoutEntry &entry) const { return m_names.c_str() + entry.name_offset; }
 
-    VertexLayout::VertexLayout(std::initializer_list<VertexLayoutElement> il):
-        m_items(il.size()),
-        m_stride(0)
+    uint32_t Layout::GetStride() const { return m_stride; }
+    bool Layout::IsEmpty() const { return m_entries.empty(); }
+
+    uint64_t Layout::GetFormatHash() const
     {
-        auto src_itr = il.begin();
-        for (size_t i = 0; i < il.size(); ++i, ++src_itr)
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto Combine = [&hash](uint32_t value)
         {
-            VertexLayoutItem &item = m_items[i];
-            item.SetName(src_itr->name);
-            item.SetType(src_itr->type);
-            item.SetOffset(m_stride);
-            item.SetSize(VERTEX_TYPE_BYTES[src_itr->type]);
-            item.SetCount(VERTEX_TYPE_COUNTS[src_itr->type]);
-
-            m_stride += item.GetSize();
-        }
-    }
+            for (uint32_t i = 0; i < 4; ++i, value >>= 8)
+                hash = (hash ^ (value & 0xff)) * 0x100000001b3ull;
+        };
 
-    VertexLayout::VertexLayout(const VertexLayout &layout):
-        m_items(layout.m_items),
-        m_stride(layout.m_stride)
-    {}
+        Combine(m_stride);
+        for (const LayoutEntry &entry : m_entries)
+        {
+            Combine(entry.type);
+            Combine(entry.offset);
+            Combine(entry.stream);
+            Combine(entry.length);
+        }
 
-    VertexLayout::VertexLayout(VertexLayout &&layout):
-        m_items(std::move(layout.m_items)),
-        m_stride(layout.m_stride)
-    {
-        layout.m_stride = 0;
+        return hash;
     }
 
-    VertexLayout &VertexLayout::operator=(const VertexLayout &layout)
+    bool Layout::HasSameFormat(const Layout &other) const
     {
-        m_items = layout.m_items;
-        m_stride = layout.m_stride;
-        return *this;
+        if (m_stride != other.m_stride || m_entries.size() != other.m_entries.size())
+            return false;
+        
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            const LayoutEntry &a = m_entries[i], &b = other.m_entries[i];
+            if (a.type != b.type || a.offset != b.offset || a.stream != b.stream || a.length != b.length)
+                return false;
+        }
+
+        return true;
     }
 
-    VertexLayout &VertexLayout::operator=(VertexLayout &&layout)
+    LayoutEntry &Layout::AddEntry(const std::string &name, Type type)
     {
-        m_items = std::move(layout.m_items);
-        m_stride = layout.m_stride;
-        layout.m_stride = 0;
-        return *this;
+        LayoutEntry entry{};
+        entry.name_hash = HashLayoutName(name.data(), name.size());
+        entry.name_offset = static_cast<uint32_t>(m_names.size());
+        entry.type = type;
+        entry.copy = LC_PACKED;
+        entry.count = VERTEX_TYPE_COUNTS[type];
+        entry.length = 1;
+        entry.client_size = VERTEX_TYPE_BYTES[type];
+
+        // Names are stored null-terminated in one pool so layouts copy without per-entry allocations
+        m_names.append(name.c_str(), name.size() + 1);
+
+        m_entries.push_back(entry);
+        return m_entries.back();
     }
 
-    VertexLayout::VecType::const_iterator VertexLayout::begin() const { return m_items.begin(); }
-    VertexLayout::VecType::const_iterator VertexLayout::end() const { return m_items.end(); }
-
-    uint32_t VertexLayout::GetStride() const { return m_stride; }
+    VertexLayout::VertexLayout(std::initializer_list<VertexLayoutElement> il) { Init(il.begin(), il.size()); }
+    VertexLayout::VertexLayout(const std::vector<VertexLayoutElement> &elements) { Init(elements.data(), elements.size()); }
 
-    UniformLayout::UniformLayout(std::initializer_list<UniformLayoutElement> il):
-        m_items(il.size()),
-        m_stride(0)
+    void VertexLayout::Init(const VertexLayoutElement *elements, size_t count)
     {
-        auto src_itr = il.begin();
-        for (size_t i = 0; i < il.size(); ++i, ++src_itr)
+        m_entries.reserve(count);
+        for (size_t i = 0; i < count; ++i)
         {
-            LayoutItem *&item = m_items[i];
-            LayoutItem *base_item;
-            switch (src_itr->type)
-            {
-                case VT_MAT3:
-                {
-                    UniformMatrixLayoutItem *mat_item = new UniformMatrixLayoutItem;
-                    mat_item->SetDimension(3);
-                    base_item = mat_item;
-                    break;
-                }
-
-                case VT_MAT4:
-                {
-                    UniformMatrixLayoutItem *mat_item = new UniformMatrixLayoutItem;
-                    mat_item->SetDimension(4);
-                    base_item = mat_item;
-                    break;
-                }
-
-                default:
-                {
-                    base_item = new VertexLayoutItem;
-                    break;
-                }
-            }
-
-            base_item->SetName(src_itr->name);
-            base_item->SetType(src_itr->type);
-            base_item->SetCount(VERTEX_TYPE_COUNTS[src_itr->type]);
-            base_item->SetLength(1);
-
-            if (src_itr->length > 1)
-            {
-                UniformArrayLayoutItem *arr_item = new UniformArrayLayoutItem;
-                arr_item->SetItem(base_item);
-                arr_item->SetLength(src_itr->length);
-                base_item = arr_item;
-            }
+            uint32_t stream = elements[i].stream;
+            if (stream >= MAX_STREAMS)
+                throw std::runtime_error("Error creating vertex layout: Stream of '" + elements[i].name + "' exceeds the maximum of " + std::to_string(MAX_STREAMS));
+            
+            if (stream >= m_stream_strides.size())
+                m_stream_strides.resize(stream + 1, 0);
+            
+            LayoutEntry &entry = AddEntry(elements[i].name, elements[i].type);
+            entry.stream = stream;
+            entry.offset = m_stream_strides[stream];
+            entry.size = entry.client_size;
+            entry.stride = entry.client_size;
+
+            m_stream_strides[stream] += entry.size;
+            m_stride += entry.size;
+        }
 
-            item = base_item;
+        for (uint32_t stride : m_stream_strides)
+        {
+            if (stride == 0)
+                throw std::runtime_error("Error creating vertex layout: Streams must be numbered without gaps");
         }
     }
 
-    UniformLayout::UniformLayout(const UniformLayout &layout):
-        m_items(layout.m_items),
-        m_stride(layout.m_stride)
-    {}
+    uint32_t VertexLayout::GetNumStreams() const { return static_cast<uint32_t>(m_stream_strides.size()); }
+    uint32_t VertexLayout::GetStreamStride(uint32_t stream) const { return m_stream_strides[stream]; }
 
-    UniformLayout::UniformLayout(UniformLayout &&layout):
-        m_items(std::move(layout.m_items)),
-        m_stride(layout.m_stride)
+    uint32_t VertexLayout::GetStreamBase(uint32_t stream) const
     {
-        layout.m_stride = 0;
+        uint32_t base = 0;
+        for (uint32_t i = 0; i < stream; ++i)
+            base += m_stream_strides[i];
+        
+        return base;
     }
 
-    UniformLayout::~UniformLayout()
+    std::vector<const LayoutEntry*> VertexLayout::MatchInputs(const VertexLayout &inputs) const
     {
-        for (LayoutItem *item : m_items)
-            delete item;
-    }
-
-    UniformLayout &UniformLayout::operator=(const UniformLayout &layout)
-    {
-        for (LayoutItem *item : m_items)
-            delete item;
-        m_items.clear();
-
-        for (LayoutItem *item : layout.m_items)
-            m_items.push_back(item->Copy());
+        std::vector<const LayoutEntry*> entries;
+        entries.reserve(inputs.GetNumEntries());
+        for (const LayoutEntry &input : inputs)
+        {
+            const LayoutEntry *entry = Find(input.name_hash);
+            if (!entry && entries.size() < m_entries.size())
+                entry = &m_entries[entries.size()];
+            
+            if (!entry)
+                throw std::runtime_error(std::string("Error matching vertex layout: No element for shader input '") + inputs.GetName(input) + "'");
+            
+            // Components may differ in number, but integer inputs can't read float attributes or the other way around
+            if (IsIntegerType(entry->type) != IsIntegerType(input.type))
+                throw std::runtime_error(std::string("Error matching vertex layout: Element '") + GetName(*entry) + "' doesn't match the type of shader input '" + inputs.GetName(input) + "'");
+            
+            entries.push_back(entry);
+        }
 
-        m_stride = layout.m_stride;
-        return *this;
+        return entries;
     }
 
-    UniformLayout &UniformLayout::operator=(UniformLayout &&layout)
-    {
-        m_items = std::move(layout.m_items);
-        m_stride = layout.m_stride;
-        layout.m_stride = 0;
-        return *this;
-    }
+    UniformLayout::UniformLayout(std::initializer_list<UniformLayoutElement> il) { Init(il.begin(), il.size()); }
+    UniformLayout::UniformLayout(const std::vector<UniformLayoutElement> &elements) { Init(elements.data(), elements.size()); }
 
-    UniformLayout::VecType::const_iterator UniformLayout::begin() const { return m_items.begin(); }
-    UniformLayout::VecType::const_iterator UniformLayout::end() const { return m_items.end(); }
-    UniformLayout::VecType::iterator UniformLayout::begin() { return m_items.begin(); }
-    UniformLayout::VecType::iterator UniformLayout::end() { return m_items.end(); }
+    void UniformLayout::Init(const UniformLayoutElement *elements, size_t count)
+    {
+        m_entries.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const UniformLayoutElement &element = elements[i];
+            if (IsVertexOnlyType(element.type))
+                throw std::runtime_error("Error creating uniform layout: '" + element.name + "' uses a vertex-only type");
+            
+            LayoutEntry &entry = AddEntry(element.name, element.type);
+            entry.length = element.length;
+            entry.size = GetStd140Size(element.type, element.length);
+            entry.stride = element.length > 1 ? entry.size / element.length : entry.size;
+            entry.column_stride = MATRIX_TYPE_DIMENSIONS[element.type] ? 4 * sizeof(float) : 0;
+
+            // Matrix columns and array elements are padded to vec4
+            if (entry.column_stride && MATRIX_TYPE_DIMENSIONS[element.type] * sizeof(float) != entry.column_stride)
+                entry.copy = LC_MATRIX;
+            else if (entry.stride != entry.client_size)
+                entry.copy = LC_STRIDED;
+
+            m_stride = AlignUp(m_stride, GetStd140Alignment(element.type, element.length));
+            entry.offset = m_stride;
+            m_stride += entry.size;
+        }
 
-    uint32_t UniformLayout::GetStride() const { return m_stride; }
-    void UniformLayout::SetStride(uint32_t stride) { m_stride = stride; }
+        m_stride = AlignUp(m_stride, 16);
+    }
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include"RUT/Mesh.h"
 #include"RUT/Config.h"
 #include"RUT/Api.h"
+#include"RUT/Layout.h"
+#include"RUT/MeshFile.h"
+#include"RUT/VertexConversion.h"
 
 #include<stdexcept>
+#include<vector>
 
 #ifdef RUT_HAS_OPENGL
 #include"impl/OpenGL/OpenGLMesh.h"
@@ -12,7 +16,7 @@
 #include"impl/Vulkan/VulkanMesh.h"
 #endif
 
-std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, const rut::VertexLayout &layout)
+std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, const rut::VertexLayout &layout, MeshUsage usage)
 {
     switch (Api::GetRenderApi())
     {
@@ -24,17 +28,17 @@ std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, const rut::Vertex
 
 #ifdef RUT_HAS_OPENGL
     case RENDER_API_OPENGL:
-        return std::make_shared<rut::impl::OpenGLMesh>(context, layout);
+        return std::make_shared<rut::impl::OpenGLMesh>(context, layout, usage);
 #endif
 
 #ifdef RUT_HAS_VULKAN
     case RENDER_API_VULKAN:
-        return std::make_shared<rut::impl::VulkanMesh>(context, layout);
+        return std::make_shared<rut::impl::VulkanMesh>(context, layout, usage);
 #endif
     }
 }
 
-std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, rut::VertexLayout &&layout)
+std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, rut::VertexLayout &&layout, MeshUsage usage)
 {
     switch (Api::GetRenderApi())
     {
@@ -46,12 +50,33 @@ std::shared_ptr<rut::Mesh> rut::Mesh::Create(Context *context, rut::VertexLayout
 
 #ifdef RUT_HAS_OPENGL
     case RENDER_API_OPENGL:
-        return std::make_shared<rut::impl::OpenGLMesh>(context, std::move(layout));
+        return std::make_shared<rut::impl::OpenGLMesh>(context, std::move(layout), usage);
 #endif
 
 #ifdef RUT_HAS_VULKAN
     case RENDER_API_VULKAN:
-        return std::make_shared<rut::impl::VulkanMesh>(context, std::move(layout));
+        return std::make_shared<rut::impl::VulkanMesh>(context, std::move(layout), usage);
 #endif
     }
+}
+
+void rut::Mesh::SetVerticesFrom(size_t num_vertices, const void *vertices, const VertexLayout &source_layout)
+{
+    const VertexLayout &layout = GetLayout();
+    std::vector<uint8_t> converted(num_vertices * layout.GetStride());
+    ConvertVertices(layout, converted.data(), source_layout, vertices, num_vertices);
+    SetVertices(num_vertices, converted.data());
+}
+
+std::shared_ptr<rut::Mesh> rut::Mesh::LoadFromFile(Context *context, const std::string &path, MeshUsage usage, bool validate_indices)
+{
+    MeshFile file(path, validate_indices);
+
+    std::shared_ptr<Mesh> mesh = Create(context, file.GetLayout(), usage);
+    mesh->SetVertices(file.GetNumVertices(), file.GetVertices());
+    if (file.GetNumIndices())
+        mesh->SetIndices(file.GetNumIndices(), file.GetIndices());
+    
+    mesh->SetLods(file.GetLods());
+    return mesh;
 }
\ No newline at end of file
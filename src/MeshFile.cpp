@@ -0,0 +1,282 @@
+#include"RUT/MeshFile.h"
+#include"RUT/Config.h"
+
+#include<cstring>
+#include<fstream>
+#include<stdexcept>
+
+#ifdef RUT_HAS_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include<windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + rut::MESH_FILE_ALIGNMENT - 1) / rut::MESH_FILE_ALIGNMENT * rut::MESH_FILE_ALIGNMENT;
+}
+
+// Written without overflow so corrupted sizes can't wrap around the check
+static bool RangeFits(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+namespace rut
+{
+    MeshFile::MeshFile(const std::string &path, bool validate_indices):
+        m_data(nullptr),
+        m_size(0),
+        m_handle(nullptr),
+        m_header(nullptr)
+    {
+        Map(path);
+
+        try
+        {
+            Parse(validate_indices);
+        }
+        catch (const std::runtime_error &e)
+        {
+            Unmap();
+            throw std::runtime_error(std::string(e.what()) + " in '" + path + "'");
+        }
+    }
+
+    MeshFile::~MeshFile()
+    {
+        Unmap();
+    }
+
+    void MeshFile::Map(const std::string &path)
+    {
+#ifdef RUT_HAS_WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Error loading mesh file: Failed to open '" + path + "'");
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(MeshFileHeader)))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Error loading mesh file: '" + path + "' is too small");
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            throw std::runtime_error("Error loading mesh file: Failed to map '" + path + "'");
+
+        void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data)
+        {
+            CloseHandle(mapping);
+            throw std::runtime_error("Error loading mesh file: Failed to map '" + path + "'");
+        }
+
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_handle = mapping;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Error loading mesh file: Failed to open '" + path + "'");
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(MeshFileHeader)))
+        {
+            close(fd);
+            throw std::runtime_error("Error loading mesh file: '" + path + "' is too small");
+        }
+
+        void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Error loading mesh file: Failed to map '" + path + "'");
+
+        // The whole file is read front to back by the upload, so let the kernel read ahead
+        madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        madvise(data, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = static_cast<size_t>(info.st_size);
+#endif
+    }
+
+    void MeshFile::Unmap()
+    {
+        if (!m_data)
+            return;
+
+#ifdef RUT_HAS_WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(static_cast<HANDLE>(m_handle));
+#else
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+
+        m_data = nullptr;
+        m_size = 0;
+        m_handle = nullptr;
+    }
+
+    void MeshFile::Parse(bool validate_indices)
+    {
+        m_header = reinterpret_cast<const MeshFileHeader*>(m_data);
+        const MeshFileHeader &header = *m_header;
+
+        if (std::memcmp(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC)) != 0)
+            throw std::runtime_error("Error loading mesh file: Not a .rutmesh file");
+
+        if (header.version != MESH_FILE_VERSION)
+            throw std::runtime_error("Error loading mesh file: Unsupported version " + std::to_string(header.version));
+
+        if (header.num_elements == 0
+            || !RangeFits(header.elements_offset, uint64_t(header.num_elements) * sizeof(MeshFileElement), m_size)
+            || !RangeFits(header.lods_offset, uint64_t(header.num_lods) * sizeof(MeshFileLod), m_size)
+            || !RangeFits(header.vertices_offset, header.vertices_size, m_size)
+            || !RangeFits(header.indices_offset, header.indices_size, m_size))
+            throw std::runtime_error("Error loading mesh file: Sections exceed the file size");
+
+        if (header.elements_offset % alignof(MeshFileElement) != 0
+            || header.lods_offset % alignof(MeshFileLod) != 0
+            || header.vertices_offset % MESH_FILE_ALIGNMENT != 0
+            || header.indices_offset % MESH_FILE_ALIGNMENT != 0)
+            throw std::runtime_error("Error loading mesh file: Misaligned sections");
+
+        const MeshFileElement *file_elements = reinterpret_cast<const MeshFileElement*>(m_data + header.elements_offset);
+        std::vector<VertexLayoutElement> elements;
+        elements.reserve(header.num_elements);
+        for (uint32_t i = 0; i < header.num_elements; ++i)
+        {
+            const MeshFileElement &element = file_elements[i];
+            if (element.type > VT_SNORM_10_10_10_2)
+                throw std::runtime_error("Error loading mesh file: Invalid vertex type " + std::to_string(element.type));
+
+            elements.push_back({ std::string(element.name, strnlen(element.name, sizeof(element.name))), static_cast<Type>(element.type), element.stream });
+        }
+
+        m_layout = std::make_unique<VertexLayout>(elements);
+
+        if (header.num_vertices > UINT64_MAX / m_layout->GetStride() || header.vertices_size != header.num_vertices * m_layout->GetStride())
+            throw std::runtime_error("Error loading mesh file: Vertex data does not match the layout");
+
+        if (header.num_indices > UINT64_MAX / sizeof(uint32_t) || header.indices_size != header.num_indices * sizeof(uint32_t))
+            throw std::runtime_error("Error loading mesh file: Invalid index data size");
+
+        if (validate_indices)
+        {
+            const uint32_t *indices = reinterpret_cast<const uint32_t*>(m_data + header.indices_offset);
+            for (uint64_t i = 0; i < header.num_indices; ++i)
+            {
+                if (indices[i] >= header.num_vertices)
+                    throw std::runtime_error("Error loading mesh file: Index " + std::to_string(i) + " exceeds the vertex count");
+            }
+        }
+
+        const MeshFileLod *file_lods = reinterpret_cast<const MeshFileLod*>(m_data + header.lods_offset);
+        m_lods.clear();
+        m_lods.reserve(header.num_lods);
+        for (uint32_t i = 0; i < header.num_lods; ++i)
+        {
+            const MeshFileLod &lod = file_lods[i];
+            if (uint64_t(lod.index_offset) + lod.index_count > header.num_indices)
+                throw std::runtime_error("Error loading mesh file: LOD " + std::to_string(i) + " exceeds the index data");
+
+            m_lods.push_back({ lod.index_offset, lod.index_count, lod.error });
+        }
+
+        m_bounds.valid = header.bounds_valid != 0;
+        m_bounds.box.min = glm::vec3(header.box_min[0], header.box_min[1], header.box_min[2]);
+        m_bounds.box.max = glm::vec3(header.box_max[0], header.box_max[1], header.box_max[2]);
+        m_bounds.sphere.center = glm::vec3(header.sphere_center[0], header.sphere_center[1], header.sphere_center[2]);
+        m_bounds.sphere.radius = header.sphere_radius;
+    }
+
+    const VertexLayout &MeshFile::GetLayout() const { return *m_layout; }
+
+    size_t MeshFile::GetNumVertices() const { return static_cast<size_t>(m_header->num_vertices); }
+    const void *MeshFile::GetVertices() const { return m_data + m_header->vertices_offset; }
+    size_t MeshFile::GetNumIndices() const { return static_cast<size_t>(m_header->num_indices); }
+    const uint32_t *MeshFile::GetIndices() const { return m_header->num_indices ? reinterpret_cast<const uint32_t*>(m_data + m_header->indices_offset) : nullptr; }
+
+    const std::vector<MeshLod> &MeshFile::GetLods() const { return m_lods; }
+    const MeshBounds &MeshFile::GetBounds() const { return m_bounds; }
+
+    void MeshFile::Write(const std::string &path, const VertexLayout &layout, size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices, const std::vector<MeshLod> &lods)
+    {
+        MeshBounds bounds;
+        const uint8_t *vertex_bytes = static_cast<const uint8_t*>(vertices);
+        for (uint32_t stream = 0; stream < layout.GetNumStreams(); ++stream)
+            UpdateMeshBounds(bounds, layout, stream, num_vertices, vertex_bytes + num_vertices * layout.GetStreamBase(stream));
+
+        MeshFileHeader header = {};
+        std::memcpy(header.magic, MESH_FILE_MAGIC, sizeof(MESH_FILE_MAGIC));
+        header.version = MESH_FILE_VERSION;
+        header.num_elements = static_cast<uint32_t>(layout.GetNumEntries());
+        header.num_vertices = num_vertices;
+        header.num_indices = num_indices;
+        header.num_lods = static_cast<uint32_t>(lods.size());
+
+        header.bounds_valid = bounds.valid;
+        for (int i = 0; i < 3; ++i)
+        {
+            header.box_min[i] = bounds.box.min[i];
+            header.box_max[i] = bounds.box.max[i];
+            header.sphere_center[i] = bounds.sphere.center[i];
+        }
+        header.sphere_radius = bounds.sphere.radius;
+
+        header.elements_offset = AlignOffset(sizeof(MeshFileHeader));
+        header.lods_offset = AlignOffset(header.elements_offset + header.num_elements * sizeof(MeshFileElement));
+        header.vertices_offset = AlignOffset(header.lods_offset + header.num_lods * sizeof(MeshFileLod));
+        header.vertices_size = uint64_t(num_vertices) * layout.GetStride();
+        header.indices_offset = AlignOffset(header.vertices_offset + header.vertices_size);
+        header.indices_size = uint64_t(num_indices) * sizeof(uint32_t);
+
+        std::vector<MeshFileElement> elements(header.num_elements);
+        for (uint32_t i = 0; i < header.num_elements; ++i)
+        {
+            const LayoutEntry &entry = layout[i];
+            const char *name = layout.GetName(entry);
+            size_t length = std::strlen(name);
+            if (length > sizeof(elements[i].name))
+                throw std::runtime_error("Error writing mesh file: Attribute name '" + std::string(name) + "' exceeds " + std::to_string(sizeof(elements[i].name)) + " characters");
+
+            std::memset(elements[i].name, 0, sizeof(elements[i].name));
+            std::memcpy(elements[i].name, name, length);
+            elements[i].type = entry.type;
+            elements[i].stream = entry.stream;
+        }
+
+        std::vector<MeshFileLod> file_lods(header.num_lods);
+        for (uint32_t i = 0; i < header.num_lods; ++i)
+            file_lods[i] = { lods[i].index_offset, lods[i].index_count, lods[i].error, 0 };
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            throw std::runtime_error("Error writing mesh file: Failed to open '" + path + "'");
+
+        uint64_t position = 0;
+        auto write = [&](uint64_t offset, const void *data, uint64_t size)
+        {
+            static const char padding[MESH_FILE_ALIGNMENT] = {};
+            file.write(padding, static_cast<std::streamsize>(offset - position));
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            position = offset + size;
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.elements_offset, elements.data(), elements.size() * sizeof(MeshFileElement));
+        write(header.lods_offset, file_lods.data(), file_lods.size() * sizeof(MeshFileLod));
+        write(header.vertices_offset, vertices, header.vertices_size);
+        write(header.indices_offset, indices, header.indices_size);
+
+        if (!file)
+            throw std::runtime_error("Error writing mesh file: Failed to write '" + path + "'");
+    }
+}
\ No newline at end of file
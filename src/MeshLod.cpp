@@ -0,0 +1,436 @@
+#include"RUT/MeshLod.h"
+
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<stdexcept>
+
+namespace
+{
+    struct Vec3
+    {
+        double x, y, z;
+
+        Vec3 operator-(const Vec3 &o) const { return { x - o.x, y - o.y, z - o.z }; }
+    };
+
+    double Dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 Cross(const Vec3 &a, const Vec3 &b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // Weighted sum of squared distances to a set of planes, stored as the upper triangle of a symmetric 4x4 matrix
+    struct Quadric
+    {
+        double weight = 0.0;
+        double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+        double yy = 0.0, yz = 0.0, yw = 0.0;
+        double zz = 0.0, zw = 0.0;
+        double ww = 0.0;
+
+        void AddPlane(const Vec3 &n, double d, double weight)
+        {
+            xx += weight * n.x * n.x; xy += weight * n.x * n.y; xz += weight * n.x * n.z; xw += weight * n.x * d;
+            yy += weight * n.y * n.y; yz += weight * n.y * n.z; yw += weight * n.y * d;
+            zz += weight * n.z * n.z; zw += weight * n.z * d;
+            ww += weight * d * d;
+            this->weight += weight;
+        }
+
+        Quadric &operator+=(const Quadric &o)
+        {
+            xx += o.xx; xy += o.xy; xz += o.xz; xw += o.xw;
+            yy += o.yy; yz += o.yz; yw += o.yw;
+            zz += o.zz; zw += o.zw;
+            ww += o.ww;
+            weight += o.weight;
+            return *this;
+        }
+
+        // Area weighted mean squared distance, never more than the largest squared distance to any of the planes
+        double Evaluate(const Vec3 &p) const
+        {
+            if (weight == 0.0)
+                return 0.0;
+
+            return (xx * p.x * p.x + 2.0 * xy * p.x * p.y + 2.0 * xz * p.x * p.z + 2.0 * xw * p.x
+                 + yy * p.y * p.y + 2.0 * yz * p.y * p.z + 2.0 * yw * p.y
+                 + zz * p.z * p.z + 2.0 * zw * p.z
+                 + ww) / weight;
+        }
+    };
+
+    struct Plane
+    {
+        Vec3 n;
+        double d;
+    };
+
+    struct Collapse
+    {
+        uint32_t from, to;
+        double cost;
+    };
+
+    struct Simplifier
+    {
+        const std::vector<Vec3> &positions;
+        const std::vector<bool> &locked;
+        std::vector<Quadric> quadrics;
+        double max_error, max_cost;
+
+        // Largest distance of a remaining vertex from the planes it has absorbed
+        double error = 0.0;
+
+        // Planes of the full mesh's triangles, and the ones each remaining vertex stands in for
+        std::vector<Plane> planes;
+        std::vector<std::vector<uint32_t>> vertex_planes;
+
+        std::vector<uint32_t> offsets, adjacency;
+
+        Simplifier(const std::vector<Vec3> &p, const std::vector<bool> &l, const std::vector<uint32_t> &indices, double max_error):
+            positions(p), locked(l), quadrics(p.size()), max_error(max_error), max_cost(max_error * max_error), vertex_planes(p.size())
+        {
+            // Area weighted planes of the full mesh, collapses carry them along so costs stay relative to the original surface
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                const Vec3 &p0 = positions[indices[i]], &p1 = positions[indices[i + 1]], &p2 = positions[indices[i + 2]];
+                Vec3 n = Cross(p1 - p0, p2 - p0);
+                double length = std::sqrt(Dot(n, n));
+                if (length == 0.0)
+                    continue;
+
+                n = { n.x / length, n.y / length, n.z / length };
+
+                Quadric q;
+                q.AddPlane(n, -Dot(n, p0), length * 0.5);
+
+                uint32_t plane = static_cast<uint32_t>(planes.size());
+                planes.push_back({ n, -Dot(n, p0) });
+                for (uint32_t j = 0; j < 3; ++j)
+                {
+                    quadrics[indices[i + j]] += q;
+                    vertex_planes[indices[i + j]].push_back(plane);
+                }
+            }
+        }
+
+        // The quadric only gives the mean distance, so collapses passing it are checked against every absorbed plane
+        double MaxDistance(const Collapse &collapse) const
+        {
+            const Vec3 &p = positions[collapse.to];
+
+            double distance = 0.0;
+            for (uint32_t vertex : { collapse.from, collapse.to })
+            {
+                for (uint32_t plane : vertex_planes[vertex])
+                    distance = std::max(distance, std::abs(Dot(planes[plane].n, p) + planes[plane].d));
+            }
+
+            return distance;
+        }
+
+        void MergePlanes(const Collapse &collapse)
+        {
+            std::vector<uint32_t> &dst = vertex_planes[collapse.to];
+            std::vector<uint32_t> &src = vertex_planes[collapse.from];
+            dst.insert(dst.end(), src.begin(), src.end());
+            std::sort(dst.begin(), dst.end());
+            dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+            src = {};
+        }
+
+        void BuildAdjacency(const std::vector<uint32_t> &indices)
+        {
+            offsets.assign(positions.size() + 1, 0);
+            adjacency.resize(indices.size());
+            for (uint32_t index : indices)
+                ++offsets[index + 1];
+
+            for (size_t i = 0; i < positions.size(); ++i)
+                offsets[i + 1] += offsets[i];
+
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Moving from onto to must not turn any remaining triangle around
+        bool Flips(const std::vector<uint32_t> &indices, const Collapse &collapse) const
+        {
+            for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; ++i)
+            {
+                const uint32_t *triangle = &indices[adjacency[i] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+
+                Vec3 before[3], after[3];
+                for (uint32_t j = 0; j < 3; ++j)
+                {
+                    before[j] = positions[triangle[j]];
+                    after[j] = positions[triangle[j] == collapse.from ? collapse.to : triangle[j]];
+                }
+
+                Vec3 n0 = Cross(before[1] - before[0], before[2] - before[0]);
+                Vec3 n1 = Cross(after[1] - after[0], after[2] - after[0]);
+                if (Dot(n0, n1) <= 0.25 * std::sqrt(Dot(n0, n0) * Dot(n1, n1)))
+                    return true;
+            }
+
+            return false;
+        }
+
+        // Collapses in passes of independent edges, cheapest first, until the target is reached or no edge is below the error limit
+        std::vector<uint32_t> Simplify(std::vector<uint32_t> indices, size_t target_triangles)
+        {
+            std::vector<Collapse> collapses;
+            std::vector<uint32_t> remap(positions.size());
+            std::vector<bool> touched(positions.size());
+
+            while (indices.size() / 3 > target_triangles)
+            {
+                BuildAdjacency(indices);
+
+                collapses.clear();
+                for (size_t i = 0; i < indices.size(); i += 3)
+                {
+                    for (uint32_t j = 0; j < 3; ++j)
+                    {
+                        uint32_t a = indices[i + j], b = indices[i + (j + 1) % 3];
+                        for (uint32_t k = 0; k < 2; ++k)
+                        {
+                            uint32_t from = k ? b : a, to = k ? a : b;
+                            if (locked[from])
+                                continue;
+
+                            Quadric q = quadrics[from];
+                            q += quadrics[to];
+                            double cost = std::max(q.Evaluate(positions[to]), 0.0);
+                            if (cost <= max_cost)
+                                collapses.push_back({ from, to, cost });
+                        }
+                    }
+                }
+
+                std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+                for (size_t i = 0; i < remap.size(); ++i)
+                    remap[i] = static_cast<uint32_t>(i);
+
+                touched.assign(positions.size(), false);
+
+                size_t removable = indices.size() / 3 - target_triangles, removed = 0;
+                for (const Collapse &collapse : collapses)
+                {
+                    if (removed >= removable)
+                        break;
+
+                    if (touched[collapse.from] || touched[collapse.to] || Flips(indices, collapse))
+                        continue;
+
+                    double distance = MaxDistance(collapse);
+                    if (distance > max_error)
+                        continue;
+
+                    // Neighbouring collapses in the same pass would invalidate the flip test
+                    for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; ++i)
+                    {
+                        const uint32_t *triangle = &indices[adjacency[i] * 3];
+                        touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                            ++removed;
+                    }
+
+                    remap[collapse.from] = collapse.to;
+                    quadrics[collapse.to] += quadrics[collapse.from];
+                    MergePlanes(collapse);
+                    error = std::max(error, distance);
+                }
+
+                if (removed == 0)
+                    break;
+
+                size_t count = 0;
+                for (size_t i = 0; i < indices.size(); i += 3)
+                {
+                    uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+                    if (a == b || b == c || c == a)
+                        continue;
+
+                    indices[count++] = a;
+                    indices[count++] = b;
+                    indices[count++] = c;
+                }
+
+                indices.resize(count);
+            }
+
+            return indices;
+        }
+    };
+}
+
+namespace rut
+{
+    LodGenerator::LodGenerator(const VertexLayout &layout, const LodGeneratorProperties &props):
+        m_layout(layout),
+        m_props(props)
+    {}
+
+    void LodGenerator::Generate(size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices)
+    {
+        if (num_indices % 3 != 0)
+            throw std::runtime_error("Error generating mesh LODs: Triangle lists need a multiple of 3 indices");
+
+        const LayoutEntry *entry = m_layout.Find(HashLayoutName(m_props.position_name.data(), m_props.position_name.size()));
+        if (!entry || (entry->type != VT_FVEC3 && entry->type != VT_FVEC4))
+            throw std::runtime_error("Error generating mesh LODs: Needs a float vec3 or vec4 attribute named '" + m_props.position_name + "'");
+
+        const uint8_t *stream = reinterpret_cast<const uint8_t*>(vertices) + num_vertices * m_layout.GetStreamBase(entry->stream);
+        uint32_t stride = m_layout.GetStreamStride(entry->stream);
+
+        std::vector<Vec3> positions(num_vertices);
+        Vec3 min{ INFINITY, INFINITY, INFINITY }, max{ -INFINITY, -INFINITY, -INFINITY };
+        for (size_t i = 0; i < num_vertices; ++i)
+        {
+            float p[3];
+            std::memcpy(p, stream + i * stride + entry->offset, sizeof(p));
+            positions[i] = { p[0], p[1], p[2] };
+
+            min = { std::min(min.x, positions[i].x), std::min(min.y, positions[i].y), std::min(min.z, positions[i].z) };
+            max = { std::max(max.x, positions[i].x), std::max(max.y, positions[i].y), std::max(max.z, positions[i].z) };
+        }
+
+        m_indices.assign(indices, indices + num_indices);
+        for (uint32_t index : m_indices)
+        {
+            if (index >= num_vertices)
+                throw std::runtime_error("Error generating mesh LODs: Index out of range");
+        }
+
+        m_lods.clear();
+        m_lods.push_back({ 0, static_cast<uint32_t>(num_indices), 0.0f });
+
+        std::vector<bool> locked(num_vertices, false);
+        std::vector<uint32_t> weld(num_vertices);
+        std::vector<uint32_t> order(num_vertices);
+        for (uint32_t i = 0; i < num_vertices; ++i)
+            weld[i] = order[i] = i;
+
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            const Vec3 &pa = positions[a], &pb = positions[b];
+            return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+        });
+
+        auto Identical = [&](uint32_t a, uint32_t b)
+        {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertices);
+            for (uint32_t i = 0; i < m_layout.GetNumStreams(); ++i)
+            {
+                uint32_t stream_stride = m_layout.GetStreamStride(i);
+                const uint8_t *base = bytes + num_vertices * m_layout.GetStreamBase(i);
+                if (std::memcmp(base + a * stream_stride, base + b * stream_stride, stream_stride) != 0)
+                    return false;
+            }
+
+            return true;
+        };
+
+        // Duplicates with equal attributes are welded so they simplify like one vertex. Vertices split along real attribute seams
+        // have to stay together, which collapses moving only one side would break
+        for (size_t begin = 0, end; begin < num_vertices; begin = end)
+        {
+            const Vec3 &p = positions[order[begin]];
+            for (end = begin + 1; end < num_vertices; ++end)
+            {
+                const Vec3 &q = positions[order[end]];
+                if (p.x != q.x || p.y != q.y || p.z != q.z)
+                    break;
+            }
+
+            size_t distinct = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                for (size_t j = begin; j < i; ++j)
+                {
+                    if (weld[order[j]] == order[j] && Identical(order[i], order[j]))
+                    {
+                        weld[order[i]] = order[j];
+                        break;
+                    }
+                }
+
+                if (weld[order[i]] == order[i])
+                    ++distinct;
+            }
+
+            for (size_t i = begin; i < end && distinct > 1; ++i)
+                locked[order[i]] = true;
+        }
+
+        std::vector<uint32_t> current(num_indices);
+        for (size_t i = 0; i < num_indices; ++i)
+            current[i] = weld[m_indices[i]];
+
+        // Border edges belong to a single triangle. Welding keeps duplicated vertices from looking like borders
+        if (m_props.lock_borders)
+        {
+            std::vector<uint64_t> edges;
+            edges.reserve(num_indices);
+            for (size_t i = 0; i < num_indices; i += 3)
+            {
+                for (uint32_t j = 0; j < 3; ++j)
+                {
+                    uint64_t a = current[i + j], b = current[i + (j + 1) % 3];
+                    edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+                }
+            }
+
+            std::sort(edges.begin(), edges.end());
+            for (size_t i = 0; i < edges.size(); ++i)
+            {
+                bool shared = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+                if (!shared)
+                    locked[edges[i] >> 32] = locked[edges[i] & 0xffffffff] = true;
+            }
+        }
+
+        Vec3 extent = max - min;
+        double max_error = num_vertices ? m_props.max_error * std::sqrt(Dot(extent, extent)) : 0.0;
+        Simplifier simplifier(positions, locked, current, max_error);
+
+        for (uint32_t lod = 1; lod < m_props.max_lods && !current.empty(); ++lod)
+        {
+            size_t target = static_cast<size_t>(current.size() / 3 * m_props.reduction);
+            std::vector<uint32_t> simplified = simplifier.Simplify(current, target);
+
+            // Stop once the error limit keeps the chain from making meaningful progress
+            if (simplified.empty() || simplified.size() / 3 > (current.size() / 3 + target) / 2)
+                break;
+
+            m_lods.push_back({ static_cast<uint32_t>(m_indices.size()), static_cast<uint32_t>(simplified.size()), static_cast<float>(simplifier.error) });
+            m_indices.insert(m_indices.end(), simplified.begin(), simplified.end());
+            current = std::move(simplified);
+        }
+    }
+
+    void LodGenerator::Upload(Mesh *mesh) const
+    {
+        mesh->SetIndices(m_indices.size(), m_indices.data());
+        mesh->SetLods(m_lods);
+    }
+
+    const std::vector<uint32_t> &LodGenerator::GetIndices() const { return m_indices; }
+    const std::vector<MeshLod> &LodGenerator::GetLods() const { return m_lods; }
+
+    uint32_t SelectLod(const std::vector<MeshLod> &lods, const LodProperties &props, float distance)
+    {
+        // World space size of a pixel at the given distance is 2 * distance / (projection[1][1] * viewport_height)
+        float pixels_per_unit = std::abs(props.projection[1][1]) * props.viewport_height * 0.5f / std::max(distance, 1e-6f);
+
+        uint32_t lod = 0;
+        while (lod + 1 < lods.size() && lods[lod + 1].error * pixels_per_unit <= props.pixel_error)
+            ++lod;
+
+        return lod;
+    }
+}
\ No newline at end of file
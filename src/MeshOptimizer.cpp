@@ -0,0 +1,464 @@
+#include"RUT/MeshOptimizer.h"
+#include"RUT/Mesh.h"
+#include"Parallel.h"
+
+#include<algorithm>
+#include<cstring>
+#include<cmath>
+#include<stdexcept>
+
+// Per vertex work is small, so only large meshes are split across threads
+static const size_t PARALLEL_MIN_ITEMS = 1 << 16;
+
+namespace
+{
+    struct StreamView
+    {
+        const uint8_t *data;
+        uint32_t stride;
+    };
+
+    // Fifo cache where the clock only advances on misses, so a vertex is cached while fewer than size misses happened since it was loaded
+    struct VertexCache
+    {
+        std::vector<uint32_t> times;
+        uint32_t time;
+        uint32_t size;
+
+        VertexCache(size_t num_vertices, uint32_t cache_size): times(num_vertices, 0), time(cache_size + 1), size(cache_size) {}
+
+        bool Access(uint32_t vertex)
+        {
+            if (time - times[vertex] <= size)
+                return false;
+
+            times[vertex] = time++;
+            return true;
+        }
+
+        void Flush() { time += size + 1; }
+    };
+
+    struct Vec3
+    {
+        float x, y, z;
+
+        Vec3 operator+(const Vec3 &o) const { return { x + o.x, y + o.y, z + o.z }; }
+        Vec3 operator-(const Vec3 &o) const { return { x - o.x, y - o.y, z - o.z }; }
+        Vec3 operator*(float s) const { return { x * s, y * s, z * s }; }
+    };
+}
+
+static float Dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static Vec3 Cross(const Vec3 &a, const Vec3 &b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+static uint64_t HashVertex(const std::vector<StreamView> &streams, uint32_t vertex)
+{
+    // FNV-1a over every stream
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const StreamView &stream : streams)
+    {
+        const uint8_t *bytes = stream.data + static_cast<size_t>(vertex) * stream.stride;
+        for (uint32_t i = 0; i < stream.stride; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    return hash;
+}
+
+static bool VerticesEqual(const std::vector<StreamView> &streams, uint32_t a, uint32_t b)
+{
+    for (const StreamView &stream : streams)
+    {
+        if (std::memcmp(stream.data + static_cast<size_t>(a) * stream.stride, stream.data + static_cast<size_t>(b) * stream.stride, stream.stride) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Maps every vertex to the first of its bitwise equal duplicates. Returns the source vertex of each unique vertex
+static std::vector<uint32_t> WeldVertices(const std::vector<StreamView> &streams, size_t num_vertices, uint32_t num_threads, std::vector<uint32_t> &remap)
+{
+    std::vector<uint64_t> hashes(num_vertices);
+    rut::ParallelFor(num_vertices, num_threads, PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            hashes[i] = HashVertex(streams, static_cast<uint32_t>(i));
+    });
+
+    size_t table_size = 1;
+    while (table_size < num_vertices * 2)
+        table_size <<= 1;
+
+    std::vector<uint32_t> table(table_size, UINT32_MAX);
+    std::vector<uint32_t> unique_sources;
+    remap.resize(num_vertices);
+
+    for (uint32_t i = 0; i < num_vertices; ++i)
+    {
+        size_t slot = hashes[i] & (table_size - 1);
+        while (true)
+        {
+            uint32_t unique = table[slot];
+            if (unique == UINT32_MAX)
+            {
+                table[slot] = remap[i] = static_cast<uint32_t>(unique_sources.size());
+                unique_sources.push_back(i);
+                break;
+            }
+
+            uint32_t source = unique_sources[unique];
+            if (hashes[source] == hashes[i] && VerticesEqual(streams, source, i))
+            {
+                remap[i] = unique;
+                break;
+            }
+
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+
+    return unique_sources;
+}
+
+// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007
+static std::vector<uint32_t> Tipsify(const std::vector<uint32_t> &indices, size_t num_vertices, uint32_t cache_size)
+{
+    size_t num_triangles = indices.size() / 3;
+
+    // Remaining triangles of each vertex and the triangles adjacent to it, stored contiguously
+    std::vector<uint32_t> live(num_vertices, 0), offsets(num_vertices + 1, 0), adjacency(indices.size());
+    for (uint32_t index : indices)
+        ++live[index];
+
+    for (size_t i = 0; i < num_vertices; ++i)
+        offsets[i + 1] = offsets[i] + live[i];
+
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<uint32_t> cache_times(num_vertices, 0);
+    std::vector<bool> emitted(num_triangles, false);
+    std::vector<uint32_t> dead_ends, candidates, result;
+    result.reserve(indices.size());
+
+    uint32_t time = cache_size + 1;
+    uint32_t cursor = 0;
+    int64_t fan = indices.empty() ? -1 : indices[0];
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint32_t i = offsets[fan]; i < offsets[fan + 1]; ++i)
+        {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle])
+                continue;
+
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                uint32_t vertex = indices[triangle * 3 + j];
+                result.push_back(vertex);
+                dead_ends.push_back(vertex);
+                candidates.push_back(vertex);
+                --live[vertex];
+
+                if (time - cache_times[vertex] > cache_size)
+                    cache_times[vertex] = time++;
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // Fan around the candidate that stays cached longest, unless its remaining triangles would push it out
+        fan = -1;
+        int64_t best_priority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (live[vertex] == 0)
+                continue;
+
+            int64_t priority = 0;
+            if (time - cache_times[vertex] + 2 * live[vertex] <= cache_size)
+                priority = time - cache_times[vertex];
+
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                fan = vertex;
+            }
+        }
+
+        if (fan >= 0)
+            continue;
+
+        // Dead end, continue with a recently used vertex or the next unprocessed one
+        while (!dead_ends.empty() && fan < 0)
+        {
+            uint32_t vertex = dead_ends.back();
+            dead_ends.pop_back();
+            if (live[vertex] > 0)
+                fan = vertex;
+        }
+
+        while (fan < 0 && cursor < num_vertices)
+        {
+            if (live[cursor] > 0)
+                fan = cursor;
+            else
+                ++cursor;
+        }
+    }
+
+    return result;
+}
+
+static void OptimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vec3> &positions, uint32_t cache_size, float threshold, uint32_t num_threads)
+{
+    size_t num_triangles = indices.size() / 3;
+    if (num_triangles == 0)
+        return;
+
+    VertexCache cache(positions.size(), cache_size);
+    std::vector<uint32_t> misses(num_triangles);
+    std::vector<uint32_t> hard_starts;
+    for (size_t i = 0; i < num_triangles; ++i)
+    {
+        misses[i] = cache.Access(indices[i * 3]) + cache.Access(indices[i * 3 + 1]) + cache.Access(indices[i * 3 + 2]);
+
+        // A triangle missing entirely usually starts a patch disjoint from the previous ones
+        if (misses[i] == 3)
+            hard_starts.push_back(static_cast<uint32_t>(i));
+    }
+
+    if (hard_starts.empty() || hard_starts[0] != 0)
+        hard_starts.insert(hard_starts.begin(), 0);
+
+    hard_starts.push_back(static_cast<uint32_t>(num_triangles));
+
+    // Split further where the cache has warmed up enough that restarting costs little
+    std::vector<uint32_t> starts;
+    for (size_t c = 0; c + 1 < hard_starts.size(); ++c)
+    {
+        uint32_t begin = hard_starts[c], end = hard_starts[c + 1];
+
+        uint32_t cluster_misses = 0;
+        for (uint32_t i = begin; i < end; ++i)
+            cluster_misses += misses[i];
+
+        float cluster_threshold = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+        starts.push_back(begin);
+        cache.Flush();
+
+        uint32_t local_start = begin, local_misses = 0;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            local_misses += cache.Access(indices[i * 3]) + cache.Access(indices[i * 3 + 1]) + cache.Access(indices[i * 3 + 2]);
+            if (i + 1 < end && static_cast<float>(local_misses) / static_cast<float>(i + 1 - local_start) <= cluster_threshold)
+            {
+                starts.push_back(i + 1);
+                cache.Flush();
+                local_start = i + 1;
+                local_misses = 0;
+            }
+        }
+    }
+
+    starts.push_back(static_cast<uint32_t>(num_triangles));
+    size_t num_clusters = starts.size() - 1;
+
+    Vec3 mesh_center{ 0.0f, 0.0f, 0.0f };
+    for (const Vec3 &position : positions)
+        mesh_center = mesh_center + position;
+
+    mesh_center = mesh_center * (1.0f / static_cast<float>(positions.size()));
+
+    // Clusters facing away from the mesh center are likely to occlude the rest, so they are drawn first
+    std::vector<float> sort_keys(num_clusters);
+    rut::ParallelFor(num_clusters, num_threads, PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+        {
+            Vec3 center{ 0.0f, 0.0f, 0.0f }, normal{ 0.0f, 0.0f, 0.0f };
+            float area = 0.0f;
+            for (uint32_t i = starts[c]; i < starts[c + 1]; ++i)
+            {
+                const Vec3 &p0 = positions[indices[i * 3]], &p1 = positions[indices[i * 3 + 1]], &p2 = positions[indices[i * 3 + 2]];
+                Vec3 n = Cross(p1 - p0, p2 - p0);
+                float a = std::sqrt(Dot(n, n));
+
+                center = center + (p0 + p1 + p2) * (a / 3.0f);
+                normal = normal + n;
+                area += a;
+            }
+
+            center = area > 0.0f ? center * (1.0f / area) : positions[indices[starts[c] * 3]];
+            sort_keys[c] = Dot(center - mesh_center, normal);
+        }
+    });
+
+    std::vector<uint32_t> order(num_clusters);
+    for (uint32_t c = 0; c < num_clusters; ++c)
+        order[c] = c;
+
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t c : order)
+        result.insert(result.end(), indices.begin() + starts[c] * 3, indices.begin() + starts[c + 1] * 3);
+
+    indices = std::move(result);
+}
+
+namespace rut
+{
+    MeshOptimizer::MeshOptimizer(const VertexLayout &layout, const MeshOptimizerProperties &props):
+        m_layout(layout),
+        m_props(props),
+        m_num_vertices(0),
+        m_stats{}
+    {}
+
+    void MeshOptimizer::Optimize(size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices)
+    {
+        if (num_vertices >= UINT32_MAX)
+            throw std::runtime_error("Error optimizing mesh: Too many vertices");
+
+        if ((indices ? num_indices : num_vertices) % 3 != 0)
+            throw std::runtime_error("Error optimizing mesh: Triangle lists need a multiple of 3 indices");
+
+        uint32_t num_threads = ResolveThreadCount(m_props.num_threads);
+
+        std::vector<StreamView> streams;
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertices);
+        for (uint32_t i = 0; i < m_layout.GetNumStreams(); ++i)
+            streams.push_back({ bytes + num_vertices * m_layout.GetStreamBase(i), m_layout.GetStreamStride(i) });
+
+        std::vector<uint32_t> input_indices;
+        if (indices)
+        {
+            input_indices.assign(indices, indices + num_indices);
+            for (uint32_t index : input_indices)
+            {
+                if (index >= num_vertices)
+                    throw std::runtime_error("Error optimizing mesh: Index out of range");
+            }
+        }
+        else
+        {
+            input_indices.resize(num_vertices);
+            for (uint32_t i = 0; i < num_vertices; ++i)
+                input_indices[i] = i;
+        }
+
+        m_stats.vertices_before = num_vertices;
+        m_stats.acmr_before = ComputeACMR(input_indices.data(), input_indices.size(), num_vertices, m_props.cache_size);
+
+        // Indices into the unique vertices from here on
+        std::vector<uint32_t> unique_sources;
+        if (m_props.generate_indices)
+        {
+            std::vector<uint32_t> remap;
+            unique_sources = WeldVertices(streams, num_vertices, num_threads, remap);
+            for (uint32_t &index : input_indices)
+                index = remap[index];
+        }
+        else
+        {
+            unique_sources.resize(num_vertices);
+            for (uint32_t i = 0; i < num_vertices; ++i)
+                unique_sources[i] = i;
+        }
+
+        if (m_props.optimize_vertex_cache)
+            input_indices = Tipsify(input_indices, unique_sources.size(), m_props.cache_size);
+
+        if (m_props.optimize_overdraw)
+        {
+            const LayoutEntry *entry = m_layout.Find(HashLayoutName(m_props.position_name.data(), m_props.position_name.size()));
+            if (!entry || (entry->type != VT_FVEC3 && entry->type != VT_FVEC4))
+                throw std::runtime_error("Error optimizing mesh: Overdraw optimization needs a float vec3 or vec4 attribute named '" + m_props.position_name + "'");
+
+            const StreamView &stream = streams[entry->stream];
+            std::vector<Vec3> positions(unique_sources.size());
+            ParallelFor(positions.size(), num_threads, PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    std::memcpy(&positions[i], stream.data + static_cast<size_t>(unique_sources[i]) * stream.stride + entry->offset, sizeof(Vec3));
+            });
+
+            OptimizeOverdraw(input_indices, positions, m_props.cache_size, m_props.overdraw_threshold, num_threads);
+        }
+
+        // Source vertex of every output vertex
+        std::vector<uint32_t> sources;
+        if (m_props.optimize_vertex_fetch)
+        {
+            std::vector<uint32_t> fetch_remap(unique_sources.size(), UINT32_MAX);
+            for (uint32_t &index : input_indices)
+            {
+                if (fetch_remap[index] == UINT32_MAX)
+                {
+                    fetch_remap[index] = static_cast<uint32_t>(sources.size());
+                    sources.push_back(unique_sources[index]);
+                }
+
+                index = fetch_remap[index];
+            }
+        }
+        else
+            sources = std::move(unique_sources);
+
+        m_num_vertices = sources.size();
+        m_vertices.resize(m_num_vertices * m_layout.GetStride());
+        for (uint32_t s = 0; s < streams.size(); ++s)
+        {
+            const StreamView &stream = streams[s];
+            uint8_t *dst = m_vertices.data() + m_num_vertices * m_layout.GetStreamBase(s);
+            ParallelFor(m_num_vertices, num_threads, PARALLEL_MIN_ITEMS, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; ++i)
+                    std::memcpy(dst + i * stream.stride, stream.data + static_cast<size_t>(sources[i]) * stream.stride, stream.stride);
+            });
+        }
+
+        m_indices = std::move(input_indices);
+
+        m_stats.vertices_after = m_num_vertices;
+        m_stats.acmr_after = ComputeACMR(m_indices.data(), m_indices.size(), m_num_vertices, m_props.cache_size);
+    }
+
+    void MeshOptimizer::Upload(Mesh *mesh) const
+    {
+        if (!mesh->GetLayout().HasSameFormat(m_layout))
+            throw std::runtime_error("Error uploading optimized mesh: Vertex format does not match");
+
+        mesh->SetVertices(m_num_vertices, m_vertices.data());
+        mesh->SetIndices(m_indices.size(), m_indices.data());
+    }
+
+    size_t MeshOptimizer::GetNumVertices() const { return m_num_vertices; }
+    const std::vector<uint8_t> &MeshOptimizer::GetVertices() const { return m_vertices; }
+    const std::vector<uint32_t> &MeshOptimizer::GetIndices() const { return m_indices; }
+    const MeshOptimizerStats &MeshOptimizer::GetStats() const { return m_stats; }
+
+    float MeshOptimizer::ComputeACMR(const uint32_t *indices, size_t num_indices, size_t num_vertices, uint32_t cache_size)
+    {
+        if (num_indices < 3)
+            return 0.0f;
+
+        VertexCache cache(num_vertices, cache_size);
+        size_t misses = 0;
+        for (size_t i = 0; i < num_indices; ++i)
+            misses += cache.Access(indices[i]);
+
+        return static_cast<float>(misses) / static_cast<float>(num_indices / 3);
+    }
+}
\ No newline at end of file
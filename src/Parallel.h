@@ -0,0 +1,38 @@
+#pragma once
+
+#include<algorithm>
+#include<cstddef>
+#include<cstdint>
+#include<future>
+#include<thread>
+#include<vector>
+
+namespace rut
+{
+    // 0 selects all hardware threads
+    inline uint32_t ResolveThreadCount(uint32_t num_threads)
+    {
+        return num_threads ? num_threads : std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Splits [0, count) into one contiguous range per thread. Below min_items the cost of spawning threads outweighs the work
+    template<typename F>
+    void ParallelFor(size_t count, uint32_t num_threads, size_t min_items, const F &func)
+    {
+        if (num_threads <= 1 || count < min_items)
+        {
+            func(0, count);
+            return;
+        }
+
+        size_t chunk = (count + num_threads - 1) / num_threads;
+
+        std::vector<std::future<void>> tasks;
+        for (size_t begin = chunk; begin < count; begin += chunk)
+            tasks.push_back(std::async(std::launch::async, func, begin, std::min(begin + chunk, count)));
+
+        func(0, chunk);
+        for (auto &task : tasks)
+            task.get();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include"RUT/RenderTarget.h"
+#include"RUT/Config.h"
+#include"RUT/Api.h"
+
+#include<stdexcept>
+
+#ifdef RUT_HAS_OPENGL
+#include"impl/OpenGL/OpenGLRenderTarget.h"
+#endif
+
+#ifdef RUT_HAS_VULKAN
+#include"impl/Vulkan/VulkanRenderTarget.h"
+#endif
+
+static const size_t FORMAT_PIXEL_SIZE[] =
+{
+    4,
+    8,
+    16
+};
+
+namespace rut
+{
+    size_t RenderTarget::GetPixelDataSize() const
+    {
+        const RenderTargetProperties &props = GetProperties();
+        return static_cast<size_t>(props.width) * props.height * FORMAT_PIXEL_SIZE[props.color_format];
+    }
+
+    std::shared_ptr<RenderTarget> RenderTarget::Create(Context *context, const RenderTargetProperties &props)
+    {
+        if (props.width == 0 || props.height == 0)
+            throw std::runtime_error("Error creating render target: Width and height must not be 0");
+
+        switch (Api::GetRenderApi())
+        {
+        case RENDER_API_NONE:
+            throw std::runtime_error("Error creating render target. RENDER_API_NONE selected");
+
+        default:
+            throw std::runtime_error("Error creating render target. Invalid api selected");
+
+#ifdef RUT_HAS_OPENGL
+        case RENDER_API_OPENGL:
+            return std::make_shared<impl::OpenGLRenderTarget>(context, props);
+#endif
+
+#ifdef RUT_HAS_VULKAN
+        case RENDER_API_VULKAN:
+            return std::make_shared<impl::VulkanRenderTarget>(context, props);
+#endif
+        }
+    }
+}
\ No newline at end of file
@@ -1,8 +1,11 @@
 #include"RUT/Renderer.h"
 #include"RUT/Config.h"
 #include"RUT/Api.h"
+#include"RUT/Bounds.h"
+#include"RUT/SceneIndex.h"
 
 #include<stdexcept>
+#include<cmath>
 
 #ifdef RUT_HAS_OPENGL
 #include"impl/OpenGL/OpenGLRenderer.h"
@@ -12,6 +15,22 @@
 #include"impl/Vulkan/VulkanRenderer.h"
 #endif
 
+namespace rut
+{
+    namespace impl
+    {
+        struct RendererCullState
+        {
+            FrustumCuller culler;
+            std::vector<BoundingSphere> spheres;
+            std::vector<uint32_t> visible;
+        };
+    }
+}
+
+rut::Renderer::Renderer() = default;
+rut::Renderer::~Renderer() = default;
+
 std::shared_ptr<rut::Renderer> rut::Renderer::Create(Context *context, const RendererProperties &props)
 {
     switch (Api::GetRenderApi())
@@ -32,4 +51,43 @@ std::shared_ptr<rut::Renderer> rut::Renderer::Create(Context *context, const Ren
         return std::make_shared<rut::impl::VulkanRenderer>(context, props);
 #endif
     }
+}
+
+void rut::Renderer::RenderAtDistance(std::shared_ptr<Mesh> mesh, float distance)
+{
+    RenderLod(mesh, SelectLod(mesh->GetLods(), GetProperties().lod_props, distance));
+}
+
+size_t rut::Renderer::RenderVisible(const std::vector<std::shared_ptr<Mesh>> &meshes, const Frustum &frustum)
+{
+    if (!m_cull_state)
+        m_cull_state = std::make_unique<impl::RendererCullState>();
+
+    // Meshes without bounds are never culled
+    std::vector<BoundingSphere> &spheres = m_cull_state->spheres;
+    spheres.resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        const MeshBounds &bounds = meshes[i]->GetBounds();
+        spheres[i] = bounds.valid ? bounds.sphere : BoundingSphere{ glm::vec3(0.0f), INFINITY };
+    }
+
+    const std::vector<uint32_t> &visible = m_cull_state->culler.Cull(frustum, spheres.data(), spheres.size());
+    for (uint32_t index : visible)
+        Render(meshes[index]);
+    
+    return visible.size();
+}
+
+size_t rut::Renderer::RenderVisible(const std::vector<std::shared_ptr<Mesh>> &meshes, const SceneIndex &index, const Frustum &frustum)
+{
+    if (!m_cull_state)
+        m_cull_state = std::make_unique<impl::RendererCullState>();
+
+    std::vector<uint32_t> &visible = m_cull_state->visible;
+    index.Cull(frustum, visible);
+    for (uint32_t id : visible)
+        Render(meshes[id]);
+    
+    return visible.size();
 }
\ No newline at end of file
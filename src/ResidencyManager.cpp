@@ -0,0 +1,198 @@
+#include"RUT/ResidencyManager.h"
+#include"RUT/Config.h"
+#include"RUT/Api.h"
+#include"RUT/Context.h"
+#include"RUT/Layout.h"
+#include"RUT/Mesh.h"
+#include"RUT/MeshFile.h"
+
+#ifdef RUT_HAS_VULKAN
+#include"impl/Vulkan/VulkanUtils.h"
+#endif
+
+namespace rut
+{
+    ResidencyManager::ResidencyManager(Context *context, const ResidencyManagerProperties &props):
+        m_context(context),
+        m_props(props),
+        m_frame(0),
+        m_resident_bytes(0),
+        m_num_evicted(0)
+    {
+        m_budget = QueryBudget();
+    }
+
+    size_t ResidencyManager::QueryBudget() const
+    {
+        if (m_props.budget_bytes)
+            return m_props.budget_bytes;
+
+        size_t device_budget = 0;
+        switch (Api::GetRenderApi())
+        {
+#ifdef RUT_HAS_VULKAN
+        case RENDER_API_VULKAN:
+            device_budget = static_cast<size_t>(impl::GetVulkanMemoryBudget(reinterpret_cast<impl::VulkanData*>(m_context->GetHandle())));
+            break;
+#endif
+
+        default:
+            break;
+        }
+
+        return device_budget ? static_cast<size_t>(device_budget * m_props.budget_fraction) : m_props.fallback_budget_bytes;
+    }
+
+    void ResidencyManager::Track(const std::shared_ptr<Mesh> &mesh, size_t num_vertices, const void *vertices, size_t num_indices, const uint32_t *indices)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t*>(vertices);
+
+        Entry entry;
+        entry.num_vertices = num_vertices;
+        entry.vertices.assign(bytes, bytes + num_vertices * mesh->GetLayout().GetStride());
+        if (num_indices)
+            entry.indices.assign(indices, indices + num_indices);
+
+        Insert(mesh, std::move(entry));
+    }
+
+    void ResidencyManager::Track(const std::shared_ptr<Mesh> &mesh, const std::string &path)
+    {
+        Entry entry;
+        entry.path = path;
+        entry.num_vertices = 0;
+
+        Insert(mesh, std::move(entry));
+    }
+
+    void ResidencyManager::Insert(const std::shared_ptr<Mesh> &mesh, Entry &&entry)
+    {
+        Untrack(mesh.get());
+
+        entry.mesh = mesh;
+        entry.key = mesh.get();
+        entry.gpu_size = mesh->GetGpuSize();
+        entry.last_used = m_frame;
+        entry.resident = true;
+
+        m_entries.push_front(std::move(entry));
+        m_lookup[mesh.get()] = m_entries.begin();
+        m_resident_bytes += m_entries.front().gpu_size;
+    }
+
+    void ResidencyManager::Untrack(const Mesh *mesh)
+    {
+        auto it = m_lookup.find(mesh);
+        if (it != m_lookup.end())
+            Erase(it->second);
+    }
+
+    void ResidencyManager::Erase(std::list<Entry>::iterator it)
+    {
+        if (it->resident)
+            m_resident_bytes -= it->gpu_size;
+        else
+            --m_num_evicted;
+
+        m_lookup.erase(it->key);
+        m_entries.erase(it);
+    }
+
+    void ResidencyManager::Use(Mesh *mesh)
+    {
+        auto it = m_lookup.find(mesh);
+        if (it == m_lookup.end())
+            return;
+
+        // A new mesh may have been allocated where a destroyed tracked one was
+        auto entry = it->second;
+        if (entry->mesh.lock().get() != mesh)
+        {
+            Erase(entry);
+            return;
+        }
+
+        if (!entry->resident)
+            Restore(*entry, mesh);
+
+        entry->last_used = m_frame;
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+    }
+
+    void ResidencyManager::Restore(Entry &entry, Mesh *mesh)
+    {
+        // Eviction keeps the LODs, but giving the mesh new indices drops them
+        std::vector<MeshLod> lods = mesh->GetLods();
+
+        if (!entry.path.empty())
+        {
+            MeshFile file(entry.path);
+            mesh->SetVertices(file.GetNumVertices(), file.GetVertices());
+            if (file.GetNumIndices())
+                mesh->SetIndices(file.GetNumIndices(), file.GetIndices());
+        }
+        else
+        {
+            mesh->SetVertices(entry.num_vertices, entry.vertices.data());
+            if (!entry.indices.empty())
+                mesh->SetIndices(entry.indices.size(), entry.indices.data());
+        }
+
+        if (!lods.empty())
+            mesh->SetLods(lods);
+
+        entry.resident = true;
+        entry.gpu_size = mesh->GetGpuSize();
+        m_resident_bytes += entry.gpu_size;
+        --m_num_evicted;
+    }
+
+    void ResidencyManager::Update()
+    {
+        ++m_frame;
+        m_budget = QueryBudget();
+
+        // Sizes change when meshes are given new data. Erasing expired entries subtracts their old size from the old total
+        size_t resident_bytes = 0;
+        for (auto it = m_entries.begin(); it != m_entries.end();)
+        {
+            std::shared_ptr<Mesh> mesh = it->mesh.lock();
+            if (!mesh)
+            {
+                auto expired = it++;
+                Erase(expired);
+                continue;
+            }
+
+            if (it->resident)
+            {
+                it->gpu_size = mesh->GetGpuSize();
+                resident_bytes += it->gpu_size;
+            }
+
+            ++it;
+        }
+
+        m_resident_bytes = resident_bytes;
+
+        // Evicted entries collect at the back, so walk backwards over them towards the least recently drawn resident ones
+        for (auto it = m_entries.rbegin(); it != m_entries.rend() && m_resident_bytes > m_budget; ++it)
+        {
+            if (m_frame - it->last_used < m_props.min_idle_frames)
+                break;
+
+            if (!it->resident)
+                continue;
+
+            it->mesh.lock()->Evict();
+            it->resident = false;
+            m_resident_bytes -= it->gpu_size;
+            ++m_num_evicted;
+        }
+    }
+
+    size_t ResidencyManager::GetBudget() const { return m_budget; }
+    size_t ResidencyManager::GetResidentBytes() const { return m_resident_bytes; }
+    size_t ResidencyManager::GetNumTracked() const { return m_entries.size(); }
+    size_t ResidencyManager::GetNumEvicted() const { return m_num_evicted; }
+}
\ No newline at end of file
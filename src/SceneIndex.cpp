@@ -0,0 +1,474 @@
+#include"RUT/SceneIndex.h"
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<functional>
+#include<stdexcept>
+
+#include<glm/common.hpp>
+
+static const uint32_t SAH_BINS = 16;
+static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+static const rut::BoundingBox EMPTY_BOX{ glm::vec3(INFINITY), glm::vec3(-INFINITY) };
+
+static void Grow(rut::BoundingBox &box, const rut::BoundingBox &other)
+{
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+static float SurfaceArea(const rut::BoundingBox &box)
+{
+    glm::vec3 extent = box.max - box.min;
+    if (extent.x < 0.0f)
+        return 0.0f;
+
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Frustum test against the box corners furthest along and against each plane normal. Planes the box is fully inside are cleared from the mask
+static bool TestPlanes(const rut::Frustum &frustum, const rut::BoundingBox &box, uint32_t &mask)
+{
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        if (!(mask & (1u << p)))
+            continue;
+
+        const glm::vec4 &plane = frustum.planes[p];
+        float far_distance = plane.w + plane.x * (plane.x >= 0.0f ? box.max.x : box.min.x) + plane.y * (plane.y >= 0.0f ? box.max.y : box.min.y) + plane.z * (plane.z >= 0.0f ? box.max.z : box.min.z);
+        if (far_distance < 0.0f)
+            return false;
+
+        float near_distance = plane.w + plane.x * (plane.x >= 0.0f ? box.min.x : box.max.x) + plane.y * (plane.y >= 0.0f ? box.min.y : box.max.y) + plane.z * (plane.z >= 0.0f ? box.min.z : box.max.z);
+        if (near_distance >= 0.0f)
+            mask &= ~(1u << p);
+    }
+
+    return true;
+}
+
+// Slab test, returns the entry distance or INFINITY on a miss
+static float IntersectRay(const rut::BoundingBox &box, const glm::vec3 &origin, const glm::vec3 &inv_direction, float max_distance)
+{
+    float t_min = 0.0f, t_max = max_distance;
+    for (int i = 0; i < 3; ++i)
+    {
+        float t0 = (box.min[i] - origin[i]) * inv_direction[i];
+        float t1 = (box.max[i] - origin[i]) * inv_direction[i];
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        t_min = std::max(t_min, t0);
+        t_max = std::min(t_max, t1);
+    }
+
+    return t_min <= t_max ? t_min : INFINITY;
+}
+
+namespace rut
+{
+    SceneIndex::SceneIndex(const SceneIndexProperties &props):
+        m_props(props),
+        m_num_alive(0),
+        m_num_changes(0)
+    {}
+
+    SceneIndex::~SceneIndex()
+    {
+        if (m_build.valid())
+            m_build.wait();
+    }
+
+    uint32_t SceneIndex::Insert(const BoundingBox &box)
+    {
+        uint32_t id;
+        if (m_free_ids.empty())
+        {
+            id = static_cast<uint32_t>(m_objects.size());
+            m_objects.push_back({});
+        }
+        else
+        {
+            id = m_free_ids.back();
+            m_free_ids.pop_back();
+        }
+
+        m_objects[id] = { box, INVALID_INDEX, true };
+        m_pending.push_back(id);
+
+        ++m_num_alive;
+        ++m_num_changes;
+        return id;
+    }
+
+    void SceneIndex::Update(uint32_t id, const BoundingBox &box)
+    {
+        Object &object = m_objects.at(id);
+        if (!object.alive)
+            throw std::runtime_error("Error updating scene index: Object was removed");
+
+        object.box = box;
+        if (object.leaf != INVALID_INDEX)
+            m_dirty_leaves.push_back(object.leaf);
+
+        ++m_num_changes;
+    }
+
+    void SceneIndex::Remove(uint32_t id)
+    {
+        Object &object = m_objects.at(id);
+        if (!object.alive)
+            throw std::runtime_error("Error removing from scene index: Object was already removed");
+
+        object.alive = false;
+        if (object.leaf != INVALID_INDEX)
+            m_dirty_leaves.push_back(object.leaf);
+        else
+            m_pending.erase(std::find(m_pending.begin(), m_pending.end(), id));
+
+        // Stale leaf references are skipped by queries and dropped with the next build
+        object.leaf = INVALID_INDEX;
+        m_free_ids.push_back(id);
+        --m_num_alive;
+    }
+
+    void SceneIndex::Refit()
+    {
+        if (m_build.valid() && m_build.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            Install(m_build.get());
+
+        // Ancestors of dirty leaves are marked first. Children always come after their parent, so refitting in reverse order sees updated children
+        m_refit_nodes.clear();
+        m_refit_marks.resize(m_tree.nodes.size(), false);
+        for (uint32_t leaf : m_dirty_leaves)
+        {
+            for (uint32_t node = leaf; node != INVALID_INDEX && !m_refit_marks[node]; node = m_tree.nodes[node].parent)
+            {
+                m_refit_marks[node] = true;
+                m_refit_nodes.push_back(node);
+            }
+        }
+
+        m_dirty_leaves.clear();
+        std::sort(m_refit_nodes.begin(), m_refit_nodes.end(), std::greater<uint32_t>());
+        for (uint32_t node : m_refit_nodes)
+        {
+            RefitNode(node);
+            m_refit_marks[node] = false;
+        }
+
+        if (!m_build.valid() && m_num_changes > m_props.rebuild_threshold * m_num_alive)
+            StartBuild(true);
+    }
+
+    void SceneIndex::Rebuild()
+    {
+        if (m_build.valid())
+            m_build.wait();
+
+        StartBuild(false);
+        Install(m_build.get());
+    }
+
+    void SceneIndex::StartBuild(bool background)
+    {
+        // The build works on a snapshot, changes made meanwhile are refit once it is installed
+        std::vector<BoundingBox> boxes;
+        std::vector<uint32_t> ids;
+        boxes.reserve(m_num_alive);
+        ids.reserve(m_num_alive);
+        for (uint32_t i = 0; i < m_objects.size(); ++i)
+        {
+            if (m_objects[i].alive)
+            {
+                boxes.push_back(m_objects[i].box);
+                ids.push_back(i);
+            }
+        }
+
+        m_num_changes = 0;
+        m_build = std::async(background ? std::launch::async : std::launch::deferred, &SceneIndex::Build, std::move(boxes), std::move(ids), std::max(m_props.max_leaf_size, 1u));
+    }
+
+    void SceneIndex::Install(Tree &&tree)
+    {
+        m_tree = std::move(tree);
+
+        for (Object &object : m_objects)
+            object.leaf = INVALID_INDEX;
+
+        for (uint32_t i = 0; i < m_tree.nodes.size(); ++i)
+        {
+            const Node &node = m_tree.nodes[i];
+            if (node.count == 0)
+                continue;
+
+            for (uint32_t j = node.first; j < node.first + node.count; ++j)
+            {
+                Object &object = m_objects[m_tree.objects[j]];
+                if (object.alive)
+                    object.leaf = i;
+            }
+        }
+
+        // Objects inserted during a background build stay pending, ids reused meanwhile are covered by the refit
+        m_pending.clear();
+        for (uint32_t i = 0; i < m_objects.size(); ++i)
+        {
+            if (m_objects[i].alive && m_objects[i].leaf == INVALID_INDEX)
+                m_pending.push_back(i);
+        }
+
+        m_dirty_leaves.clear();
+        m_refit_marks.assign(m_tree.nodes.size(), false);
+        for (size_t i = m_tree.nodes.size(); i > 0; --i)
+            RefitNode(static_cast<uint32_t>(i - 1));
+    }
+
+    void SceneIndex::RefitNode(uint32_t index)
+    {
+        Node &node = m_tree.nodes[index];
+        BoundingBox box = EMPTY_BOX;
+        if (node.count == 0)
+        {
+            Grow(box, m_tree.nodes[node.first].box);
+            Grow(box, m_tree.nodes[node.first + 1].box);
+        }
+        else
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                uint32_t id = m_tree.objects[i];
+                if (m_objects[id].leaf == index)
+                    Grow(box, m_objects[id].box);
+            }
+        }
+
+        node.box = box;
+    }
+
+    SceneIndex::Tree SceneIndex::Build(std::vector<BoundingBox> boxes, std::vector<uint32_t> ids, uint32_t max_leaf_size)
+    {
+        Tree tree;
+        if (ids.empty())
+            return tree;
+
+        std::vector<glm::vec3> centroids(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+            centroids[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+
+        // Ranges of the root and every node pending a split index into order, which is permuted in place
+        std::vector<uint32_t> order(ids.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+
+        BoundingBox root_box = EMPTY_BOX;
+        for (const BoundingBox &box : boxes)
+            Grow(root_box, box);
+
+        tree.nodes.reserve(ids.size() / max_leaf_size * 2 + 1);
+        tree.nodes.push_back({ root_box, 0, static_cast<uint32_t>(ids.size()), INVALID_INDEX });
+
+        std::vector<uint32_t> stack{ 0 };
+        while (!stack.empty())
+        {
+            uint32_t index = stack.back();
+            stack.pop_back();
+
+            Node node = tree.nodes[index];
+            if (node.count <= max_leaf_size)
+                continue;
+
+            BoundingBox centroid_box = EMPTY_BOX;
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                Grow(centroid_box, { centroids[order[i]], centroids[order[i]] });
+
+            glm::vec3 extent = centroid_box.max - centroid_box.min;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            if (extent[axis] <= 0.0f)
+                continue;
+
+            // Binned surface area heuristic along the widest centroid axis
+            float bin_scale = SAH_BINS / extent[axis];
+            auto bin_of = [&](uint32_t object)
+            {
+                uint32_t bin = static_cast<uint32_t>((centroids[object][axis] - centroid_box.min[axis]) * bin_scale);
+                return std::min(bin, SAH_BINS - 1);
+            };
+
+            uint32_t bin_counts[SAH_BINS] = {};
+            BoundingBox bin_boxes[SAH_BINS];
+            std::fill(bin_boxes, bin_boxes + SAH_BINS, EMPTY_BOX);
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                uint32_t bin = bin_of(order[i]);
+                ++bin_counts[bin];
+                Grow(bin_boxes[bin], boxes[order[i]]);
+            }
+
+            float right_costs[SAH_BINS];
+            BoundingBox right_boxes[SAH_BINS];
+            BoundingBox box = EMPTY_BOX;
+            uint32_t count = 0;
+            for (uint32_t i = SAH_BINS - 1; i > 0; --i)
+            {
+                Grow(box, bin_boxes[i]);
+                count += bin_counts[i];
+                right_boxes[i] = box;
+                right_costs[i] = SurfaceArea(box) * count;
+            }
+
+            uint32_t best_split = 0;
+            float best_cost = INFINITY;
+            BoundingBox best_left, left = EMPTY_BOX;
+            count = 0;
+            for (uint32_t i = 1; i < SAH_BINS; ++i)
+            {
+                Grow(left, bin_boxes[i - 1]);
+                count += bin_counts[i - 1];
+                if (count == 0 || count == node.count)
+                    continue;
+
+                float cost = SurfaceArea(left) * count + right_costs[i];
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_split = i;
+                    best_left = left;
+                }
+            }
+
+            // Splitting costs a traversal step, so leaves win when no split beats intersecting everything
+            if (best_split == 0 || (best_cost >= SurfaceArea(node.box) * node.count && node.count <= max_leaf_size * 4))
+                continue;
+
+            uint32_t *middle = std::partition(order.data() + node.first, order.data() + node.first + node.count, [&](uint32_t object) { return bin_of(object) < best_split; });
+            uint32_t left_count = static_cast<uint32_t>(middle - (order.data() + node.first));
+
+            uint32_t child = static_cast<uint32_t>(tree.nodes.size());
+            tree.nodes.push_back({ best_left, node.first, left_count, index });
+            tree.nodes.push_back({ right_boxes[best_split], node.first + left_count, node.count - left_count, index });
+            tree.nodes[index].first = child;
+            tree.nodes[index].count = 0;
+
+            stack.push_back(child);
+            stack.push_back(child + 1);
+        }
+
+        tree.objects.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            tree.objects[i] = ids[order[i]];
+
+        return tree;
+    }
+
+    void SceneIndex::Cull(const Frustum &frustum, std::vector<uint32_t> &visible) const
+    {
+        visible.clear();
+
+        struct Entry
+        {
+            uint32_t node;
+            uint32_t mask;
+        };
+
+        std::vector<Entry> stack;
+        if (!m_tree.nodes.empty())
+            stack.push_back({ 0, 0x3f });
+
+        while (!stack.empty())
+        {
+            Entry entry = stack.back();
+            stack.pop_back();
+
+            const Node &node = m_tree.nodes[entry.node];
+            if (entry.mask && !TestPlanes(frustum, node.box, entry.mask))
+                continue;
+
+            if (node.count == 0)
+            {
+                stack.push_back({ node.first + 1, entry.mask });
+                stack.push_back({ node.first, entry.mask });
+                continue;
+            }
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                uint32_t id = m_tree.objects[i];
+                if (m_objects[id].leaf != entry.node)
+                    continue;
+
+                uint32_t mask = entry.mask;
+                if (!mask || TestPlanes(frustum, m_objects[id].box, mask))
+                    visible.push_back(id);
+            }
+        }
+
+        for (uint32_t id : m_pending)
+        {
+            uint32_t mask = 0x3f;
+            if (TestPlanes(frustum, m_objects[id].box, mask))
+                visible.push_back(id);
+        }
+    }
+
+    bool SceneIndex::Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance, SceneRayHit &hit) const
+    {
+        glm::vec3 inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+        hit = { INVALID_INDEX, max_distance };
+        for (uint32_t id : m_pending)
+        {
+            float distance = IntersectRay(m_objects[id].box, origin, inv_direction, hit.distance);
+            if (distance != INFINITY && (hit.id == INVALID_INDEX || distance < hit.distance))
+                hit = { id, distance };
+        }
+
+        std::vector<uint32_t> stack;
+        if (!m_tree.nodes.empty() && IntersectRay(m_tree.nodes[0].box, origin, inv_direction, hit.distance) != INFINITY)
+            stack.push_back(0);
+
+        while (!stack.empty())
+        {
+            uint32_t index = stack.back();
+            const Node &node = m_tree.nodes[index];
+            stack.pop_back();
+
+            if (node.count == 0)
+            {
+                // Nearer child is visited first
+                float near_distance = IntersectRay(m_tree.nodes[node.first].box, origin, inv_direction, hit.distance);
+                float far_distance = IntersectRay(m_tree.nodes[node.first + 1].box, origin, inv_direction, hit.distance);
+                uint32_t near_child = node.first, far_child = node.first + 1;
+                if (far_distance < near_distance)
+                {
+                    std::swap(near_distance, far_distance);
+                    std::swap(near_child, far_child);
+                }
+
+                if (far_distance != INFINITY)
+                    stack.push_back(far_child);
+                if (near_distance != INFINITY)
+                    stack.push_back(near_child);
+                continue;
+            }
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                uint32_t id = m_tree.objects[i];
+                if (m_objects[id].leaf != index)
+                    continue;
+
+                float distance = IntersectRay(m_objects[id].box, origin, inv_direction, hit.distance);
+                if (distance != INFINITY && (hit.id == INVALID_INDEX || distance < hit.distance))
+                    hit = { id, distance };
+            }
+        }
+
+        return hit.id != INVALID_INDEX;
+    }
+
+    size_t SceneIndex::GetNumObjects() const { return m_num_alive; }
+}
\ No newline at end of file
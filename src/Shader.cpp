@@ -12,7 +12,7 @@
 #include"impl/Vulkan/VulkanShader.h"
 #endif
 
-std::shared_ptr<rut::ShaderUnit> rut::ShaderUnit::Create(Context *context, ShaderType type, const std::string &source)
+std::shared_ptr<rut::ShaderUnit> rut::ShaderUnit::Create(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines)
 {
     switch (Api::GetRenderApi())
     {
@@ -24,11 +24,11 @@ std::shared_ptr<rut::ShaderUnit> rut::ShaderUnit::Create(Context *context, Shade
     
 #ifdef RUT_HAS_OPENGL
     case RENDER_API_OPENGL:
-        return std::make_shared<rut::impl::OpenGLShaderUnit>(context, type, source);
+        return std::make_shared<rut::impl::OpenGLShaderUnit>(context, type, source, defines);
 #endif
 #ifdef RUT_HAS_VULKAN
     case RENDER_API_VULKAN:
-        return std::make_shared<rut::impl::VulkanShaderUnit>(context, type, source);
+        return std::make_shared<rut::impl::VulkanShaderUnit>(context, type, source, defines);
 #endif
     }
 }
@@ -0,0 +1,116 @@
+#include"RUT/ShaderPermutation.h"
+#include"RUT/Api.h"
+
+#include<stdexcept>
+#include<future>
+
+namespace rut
+{
+    ShaderPermutation::ShaderPermutation(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderKeyword> &keywords):
+        m_context(context),
+        m_type(type),
+        m_source(source),
+        m_keywords(keywords)
+    {
+        uint32_t shift = 0;
+        for (const auto &keyword : m_keywords)
+        {
+            uint32_t bits = 1;
+            while ((1ull << bits) < keyword.values.size())
+                ++bits;
+            
+            m_slots.push_back({ shift, bits });
+            shift += bits;
+        }
+
+        if (shift > 64)
+            throw std::runtime_error("Error creating shader permutation: keywords exceed 64 key bits");
+    }
+
+    uint64_t ShaderPermutation::GetKey(const std::string &keyword, uint32_t value) const
+    {
+        for (size_t i = 0; i < m_keywords.size(); ++i)
+        {
+            if (m_keywords[i].name != keyword)
+                continue;
+            
+            uint32_t count = m_keywords[i].values.empty() ? 2 : static_cast<uint32_t>(m_keywords[i].values.size());
+            if (value >= count)
+                throw std::runtime_error("Error creating shader permutation key: value out of range for keyword '" + keyword + "'");
+            
+            return static_cast<uint64_t>(value) << m_slots[i].shift;
+        }
+
+        throw std::runtime_error("Error creating shader permutation key: unknown keyword '" + keyword + "'");
+    }
+
+    std::shared_ptr<ShaderUnit> ShaderPermutation::Get(uint64_t key)
+    {
+        auto itr = m_variants.find(key);
+        if (itr != m_variants.end())
+            return itr->second;
+        
+        std::shared_ptr<ShaderUnit> unit = ShaderUnit::Create(m_context, m_type, m_source, GetDefines(key));
+        m_variants[key] = unit;
+        return unit;
+    }
+
+    void ShaderPermutation::Precompile(const std::vector<uint64_t> &keys)
+    {
+        // OpenGL objects may only be created on the thread owning the context
+        if (Api::GetRenderApi() != RENDER_API_VULKAN)
+        {
+            for (uint64_t key : keys)
+                Get(key);
+            
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, std::future<std::shared_ptr<ShaderUnit>>>> tasks;
+        for (uint64_t key : keys)
+        {
+            if (m_variants.find(key) != m_variants.end())
+                continue;
+            
+            std::vector<ShaderDefine> defines = GetDefines(key);
+            tasks.emplace_back(key, std::async(std::launch::async, [this, defines]()
+            {
+                return ShaderUnit::Create(m_context, m_type, m_source, defines);
+            }));
+        }
+
+        for (auto &task : tasks)
+            m_variants[task.first] = task.second.get();
+    }
+
+    std::shared_ptr<ShaderPermutation> ShaderPermutation::Create(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderKeyword> &keywords)
+    {
+        return std::make_shared<ShaderPermutation>(context, type, source, keywords);
+    }
+
+    std::vector<ShaderDefine> ShaderPermutation::GetDefines(uint64_t key) const
+    {
+        std::vector<ShaderDefine> defines;
+        for (size_t i = 0; i < m_keywords.size(); ++i)
+        {
+            const ShaderKeyword &keyword = m_keywords[i];
+            uint32_t value = static_cast<uint32_t>((key >> m_slots[i].shift) & ((1ull << m_slots[i].bits) - 1));
+
+            if (keyword.values.empty())
+            {
+                if (value)
+                    defines.push_back({ keyword.name, "1" });
+                
+                continue;
+            }
+
+            if (value >= keyword.values.size())
+                throw std::runtime_error("Error compiling shader permutation: invalid value for keyword '" + keyword.name + "'");
+            
+            defines.push_back({ keyword.name, std::to_string(value) });
+            defines.push_back({ keyword.name + "_" + keyword.values[value], "1" });
+        }
+
+        return defines;
+    }
+}
\ No newline at end of file
@@ -4,8 +4,10 @@
 
 #include<stdexcept>
 #include<cstring>
+#include<algorithm>
 
 #include<shaderc/shaderc.hpp>
+#include<spirv_cross.hpp>
 
 #ifdef RUT_HAS_OPENGL
 #include<spirv_glsl.hpp>
@@ -18,28 +20,198 @@ static shaderc_shader_kind SHADER_TYPE_TO_SHADERC_KIND[] =
     shaderc_geometry_shader
 };
 
-namespace rut
+static rut::CodeBlob CompileSpirv(const std::string &source, rut::ShaderType type, const std::vector<rut::ShaderDefine> &defines, shaderc::CompileOptions &options)
+{
+    for (const auto &define : defines)
+        options.AddMacroDefinition(define.name, define.value);
+
+    shaderc::Compiler compiler;
+    shaderc::CompilationResult result = compiler.CompileGlslToSpv(source, SHADER_TYPE_TO_SHADERC_KIND[type], "shader", options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+        throw std::runtime_error("Error compiling shader: " + result.GetErrorMessage());
+    
+    rut::CodeBlob blob;
+    blob.bytes = std::distance(result.begin(), result.end()) * sizeof(uint32_t);
+    blob.data = new char[blob.bytes];
+    std::memcpy(blob.data, result.begin(), blob.bytes);
+    return blob;
+}
+
+static bool GetLayoutType(const spirv_cross::SPIRType &type, rut::Type &result)
 {
-    rut::CodeBlob GenerateVulkanShader(const std::string &source, rut::ShaderType type)
+    if (type.basetype == spirv_cross::SPIRType::Float && type.columns == 3 && type.vecsize == 3)
+    {
+        result = rut::VT_MAT3;
+        return true;
+    }
+    
+    if (type.basetype == spirv_cross::SPIRType::Float && type.columns == 4 && type.vecsize == 4)
     {
-        shaderc::Compiler compiler;
-        shaderc::CompilationResult result = compiler.CompileGlslToSpv(source, SHADER_TYPE_TO_SHADERC_KIND[type], "shader");
-        if (result.GetCompilationStatus() != shaderc_compilation_status_success)
-            throw std::runtime_error("Error compiling shader: " + result.GetErrorMessage());
+        result = rut::VT_MAT4;
+        return true;
+    }
+    
+    if (type.columns == 1 && type.vecsize >= 1 && type.vecsize <= 4)
+    {
+        // Int and float types alternate in the Type enum
+        if (type.basetype == spirv_cross::SPIRType::Int)
+        {
+            result = static_cast<rut::Type>(rut::VT_INT + 2 * (type.vecsize - 1));
+            return true;
+        }
         
-        rut::CodeBlob blob;
-        blob.bytes = std::distance(result.begin(), result.end()) * sizeof(uint32_t);
-        blob.data = new char[blob.bytes];
-        std::memcpy(blob.data, result.begin(), blob.bytes);
-        return blob;
+        if (type.basetype == spirv_cross::SPIRType::Float)
+        {
+            result = static_cast<rut::Type>(rut::VT_FLOAT + 2 * (type.vecsize - 1));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+namespace rut
+{
+    uint64_t HashBytes(const void *data, size_t bytes, uint64_t hash)
+    {
+        // FNV-1a
+        const unsigned char *ptr = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            hash ^= ptr[i];
+            hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
+    void ReflectShader(const uint32_t *code, size_t words, ShaderType type, ShaderReflection &reflection)
+    {
+        spirv_cross::Compiler compiler(code, words);
+        spirv_cross::ShaderResources resources = compiler.get_shader_resources();
+
+        if (type == ST_VERTEX)
+        {
+            std::vector<std::pair<uint32_t, VertexLayoutElement>> inputs;
+            for (const auto &input : resources.stage_inputs)
+            {
+                Type input_type;
+                if (!GetLayoutType(compiler.get_type(input.type_id), input_type))
+                {
+                    reflection.unsupported_inputs = "vertex input '" + input.name + "' has an unsupported type";
+                    inputs.clear();
+                    break;
+                }
+
+                uint32_t location = compiler.get_decoration(input.id, spv::DecorationLocation);
+                inputs.push_back({ location, { input.name, input_type } });
+            }
+
+            std::sort(inputs.begin(), inputs.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+            for (const auto &input : inputs)
+                reflection.inputs.push_back(input.second);
+        }
+
+        for (const auto &uniform_buffer : resources.uniform_buffers)
+        {
+            const spirv_cross::SPIRType &block_type = compiler.get_type(uniform_buffer.base_type_id);
+
+            UniformBindingProperties binding;
+            binding.binding = compiler.get_decoration(uniform_buffer.id, spv::DecorationBinding);
+            binding.name = compiler.get_name(uniform_buffer.base_type_id);
+            binding.stage = type;
+
+            std::string unsupported;
+            std::vector<UniformLayoutElement> elements;
+            for (uint32_t i = 0; i < block_type.member_types.size() && unsupported.empty(); ++i)
+            {
+                const spirv_cross::SPIRType &member_type = compiler.get_type(block_type.member_types[i]);
+
+                UniformLayoutElement element;
+                element.name = compiler.get_member_name(uniform_buffer.base_type_id, i);
+                element.length = member_type.array.empty() ? 1 : member_type.array[0];
+                if (!GetLayoutType(member_type, element.type))
+                    unsupported = "member '" + element.name + "' has an unsupported type";
+                
+                elements.push_back(element);
+            }
+
+            if (unsupported.empty())
+            {
+                binding.layout = UniformLayout(elements);
+
+                // The shader compiler lays blocks out with std140 as well, so the offsets must agree
+                uint32_t index = 0;
+                for (const auto &entry : binding.layout)
+                {
+                    if (entry.offset != compiler.type_struct_member_offset(block_type, index++))
+                    {
+                        unsupported = "block does not use the std140 layout";
+                        break;
+                    }
+                }
+            }
+
+            if (!unsupported.empty())
+            {
+                reflection.unsupported_bindings.push_back({ binding.binding, binding.name, unsupported });
+                continue;
+            }
+
+            reflection.uniform_bindings.push_back(binding);
+        }
+    }
+
+    void MergeReflection(ShaderProgramProperties &props, const ShaderReflection *reflections[], size_t count)
+    {
+        bool fill_inputs = props.input_layout.IsEmpty();
+        bool fill_bindings = props.uniform_bindings.empty();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (fill_inputs && !reflections[i]->unsupported_inputs.empty())
+                throw std::runtime_error("Error reflecting shader: " + reflections[i]->unsupported_inputs + ". Give the input layout explicitly");
+
+            if (fill_inputs && !reflections[i]->inputs.empty())
+                props.input_layout = VertexLayout(reflections[i]->inputs);
+            
+            if (!fill_bindings)
+                continue;
+            
+            if (!reflections[i]->unsupported_bindings.empty())
+            {
+                const UnsupportedUniformBinding &binding = reflections[i]->unsupported_bindings.front();
+                throw std::runtime_error("Error reflecting shader: uniform block '" + binding.name + "': " + binding.reason + ". Give the uniform bindings explicitly");
+            }
+            
+            // Blocks shared between stages are listed once, under the first stage using them
+            for (const auto &binding : reflections[i]->uniform_bindings)
+            {
+                auto itr = std::find_if(props.uniform_bindings.begin(), props.uniform_bindings.end(), [&](const UniformBindingProperties &b) { return b.binding == binding.binding; });
+                if (itr == props.uniform_bindings.end())
+                    props.uniform_bindings.push_back(binding);
+            }
+        }
+    }
+
+    rut::CodeBlob GenerateVulkanShader(const std::string &source, rut::ShaderType type, const std::vector<ShaderDefine> &defines)
+    {
+        shaderc::CompileOptions options;
+        return CompileSpirv(source, type, defines, options);
     }
 
 #ifdef RUT_HAS_OPENGL
-    rut::CodeBlob GenerateOpenGLShader(const std::string &source, rut::ShaderType type)
+    rut::CodeBlob GenerateOpenGLShader(const std::string &source, rut::ShaderType type, const std::vector<ShaderDefine> &defines)
     {
-        rut::CodeBlob blob = GenerateVulkanShader(source, type);
+        rut::CodeBlob blob = GenerateVulkanShader(source, type, defines);
+        rut::CodeBlob res = CrossCompileOpenGLShader(reinterpret_cast<uint32_t*>(blob.data), blob.bytes / sizeof(uint32_t), {});
+        delete[] blob.data;
+        return res;
+    }
 
-        spirv_cross::CompilerGLSL compiler(reinterpret_cast<uint32_t*>(blob.data), blob.bytes / sizeof(uint32_t));
+    rut::CodeBlob CrossCompileOpenGLShader(const uint32_t *code, size_t words, const std::vector<SpecializationConstant> &constants)
+    {
+        spirv_cross::CompilerGLSL compiler(code, words);
         spirv_cross::ShaderResources resources = compiler.get_shader_resources();
 
         /*if (type != rut::ST_VERTEX)
@@ -58,24 +230,36 @@ namespace rut
                 compiler.unset_decoration(output.id, spv::DecorationDescriptorSet);
             }
         }*/
-        for (auto &uniform_buffers : resources.uniform_buffers)
-        {
-            compiler.set_decoration(uniform_buffers.id, spv::DecorationGLSLShared, 1);
-        }
-
         spirv_cross::CompilerGLSL::Options options{};
         options.version = 330;
         options.es = false;
         options.separate_shader_objects = false;
         compiler.set_common_options(options);
 
+        // Bake specialization values in as the constants' defaults
+        for (auto &spec_constant : compiler.get_specialization_constants())
+        {
+            for (const auto &constant : constants)
+            {
+                if (constant.id == spec_constant.constant_id)
+                    compiler.get_constant(spec_constant.id).m.c[0].r[0].u32 = constant.value;
+            }
+        }
+
         std::string res = compiler.compile();
-        delete[] blob.data;
 
+        rut::CodeBlob blob;
         blob.bytes = res.length();
         blob.data = new char[blob.bytes];
         std::memcpy(blob.data, res.data(), blob.bytes);
         return blob;
     }
+
+    rut::CodeBlob GenerateOpenGLSpirvShader(const std::string &source, rut::ShaderType type, const std::vector<ShaderDefine> &defines)
+    {
+        shaderc::CompileOptions options;
+        options.SetTargetEnvironment(shaderc_target_env_opengl, shaderc_env_version_opengl_4_5);
+        return CompileSpirv(source, type, defines, options);
+    }
 #endif
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
+#include"RUT/Config.h"
 #include"RUT/Api.h"
 #include"RUT/Shader.h"
 
+#include<cstddef>
 #include<string>
 
 namespace rut
@@ -13,10 +15,33 @@ namespace rut
         char *data;
     };
 
-#ifdef RUT_HAS_VULKAN
-    CodeBlob GenerateVulkanShader(const std::string &source, ShaderType type);
-#endif
+    // A uniform block whose members layouts can't express, such as uint, bool, double or struct members
+    struct UnsupportedUniformBinding
+    {
+        uint32_t binding;
+        std::string name;
+        std::string reason;
+    };
+
+    struct ShaderReflection
+    {
+        std::vector<VertexLayoutElement> inputs;
+        std::vector<UniformBindingProperties> uniform_bindings;
+
+        // Unsupported inputs and blocks are left out, and only fail programs that take their layouts from the reflection
+        std::string unsupported_inputs;
+        std::vector<UnsupportedUniformBinding> unsupported_bindings;
+    };
+
+    uint64_t HashBytes(const void *data, size_t bytes, uint64_t hash = 0xcbf29ce484222325ull);
+
+    CodeBlob GenerateVulkanShader(const std::string &source, ShaderType type, const std::vector<ShaderDefine> &defines = {});
+    void ReflectShader(const uint32_t *code, size_t words, ShaderType type, ShaderReflection &reflection);
+    void MergeReflection(ShaderProgramProperties &props, const ShaderReflection *reflections[], size_t count);
+
 #ifdef RUT_HAS_OPENGL
-    CodeBlob GenerateOpenGLShader(const std::string &source, ShaderType type);
+    CodeBlob GenerateOpenGLShader(const std::string &source, ShaderType type, const std::vector<ShaderDefine> &defines = {});
+    CodeBlob CrossCompileOpenGLShader(const uint32_t *code, size_t words, const std::vector<SpecializationConstant> &constants);
+    CodeBlob GenerateOpenGLSpirvShader(const std::string &source, ShaderType type, const std::vector<ShaderDefine> &defines = {});
 #endif
 }
\ No newline at end of file
@@ -13,6 +13,22 @@
 
 namespace rut
 {
+    UniformHandle UniformBuffer::GetVariableHandle(const std::string &name) const { return GetVariableHandle(UniformName{ HashLayoutName(name.data(), name.size()) }); }
+
+    UniformHandle UniformBuffer::GetVariableHandle(UniformName name) const
+    {
+        UniformHandle handle;
+        handle.entry = GetLayout().Find(name.hash);
+        if (handle.entry)
+        {
+            handle.offset = handle.entry->offset;
+            handle.size = handle.entry->size;
+            handle.packed = handle.entry->copy == LC_PACKED;
+        }
+
+        return handle;
+    }
+
     std::shared_ptr<rut::UniformBuffer> rut::UniformBuffer::Create(Context *context, const UniformLayout &layout)
     {
         switch (Api::GetRenderApi())
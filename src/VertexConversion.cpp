@@ -0,0 +1,255 @@
+#include"RUT/VertexConversion.h"
+
+#include<cstring>
+#include<cmath>
+#include<stdexcept>
+#include<algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RUT_HAS_SSE2
+#include<emmintrin.h>
+#endif
+
+static const uint32_t FLOAT_TYPE_COUNTS[] =
+{
+    0, 1, 0, 2, 0, 3, 0, 4
+};
+
+static uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // NaN and infinity
+    if (((bits >> 23) & 0xff) == 0xff)
+        return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    
+    if (exponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7c00);
+    
+    // Denormals, rounded to nearest even
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return static_cast<uint16_t>(sign);
+        
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;     // May carry into the exponent, which correctly rounds up to the next power of two or infinity
+    
+    return static_cast<uint16_t>(half);
+}
+
+template<typename T>
+static void QuantizeScalar(const float *src, T *dst, size_t count, float min, float max, float scale)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<T>(std::nearbyint(std::min(std::max(src[i], min), max) * scale));
+}
+
+#ifdef RUT_HAS_SSE2
+static inline __m128i QuantizeSSE(const float *src, __m128 min, __m128 max, __m128 scale)
+{
+    __m128 v = _mm_loadu_ps(src);
+    v = _mm_min_ps(_mm_max_ps(v, min), max);
+    return _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+}
+#endif
+
+static void QuantizeUnorm8(const float *src, uint8_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef RUT_HAS_SSE2
+    const __m128 min = _mm_setzero_ps(), max = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_packs_epi32(QuantizeSSE(src + i, min, max, scale), QuantizeSSE(src + i + 4, min, max, scale));
+        __m128i b = _mm_packs_epi32(QuantizeSSE(src + i + 8, min, max, scale), QuantizeSSE(src + i + 12, min, max, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    QuantizeScalar(src + i, dst + i, count - i, 0.0f, 1.0f, 255.0f);
+}
+
+static void QuantizeSnorm8(const float *src, int8_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef RUT_HAS_SSE2
+    const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f), scale = _mm_set1_ps(127.0f);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_packs_epi32(QuantizeSSE(src + i, min, max, scale), QuantizeSSE(src + i + 4, min, max, scale));
+        __m128i b = _mm_packs_epi32(QuantizeSSE(src + i + 8, min, max, scale), QuantizeSSE(src + i + 12, min, max, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi16(a, b));
+    }
+#endif
+    QuantizeScalar(src + i, dst + i, count - i, -1.0f, 1.0f, 127.0f);
+}
+
+static void QuantizeUnorm16(const float *src, uint16_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef RUT_HAS_SSE2
+    // SSE2 only packs with signed saturation, so values are biased into the signed range and the sign bit flipped back
+    const __m128 min = _mm_setzero_ps(), max = _mm_set1_ps(1.0f), scale = _mm_set1_ps(65535.0f);
+    const __m128i bias = _mm_set1_epi32(32768), flip = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_sub_epi32(QuantizeSSE(src + i, min, max, scale), bias);
+        __m128i b = _mm_sub_epi32(QuantizeSSE(src + i + 4, min, max, scale), bias);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(_mm_packs_epi32(a, b), flip));
+    }
+#endif
+    QuantizeScalar(src + i, dst + i, count - i, 0.0f, 1.0f, 65535.0f);
+}
+
+static void QuantizeSnorm16(const float *src, int16_t *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef RUT_HAS_SSE2
+    const __m128 min = _mm_set1_ps(-1.0f), max = _mm_set1_ps(1.0f), scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = QuantizeSSE(src + i, min, max, scale);
+        __m128i b = QuantizeSSE(src + i + 4, min, max, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+    }
+#endif
+    QuantizeScalar(src + i, dst + i, count - i, -1.0f, 1.0f, 32767.0f);
+}
+
+// x, y and z in the low 30 bits and w in the top 2, matching GL_*_2_10_10_10_REV and VK_FORMAT_A2B10G10R10_*_PACK32
+static void QuantizePacked1010102(const float *src, uint32_t *dst, size_t count, bool is_signed)
+{
+    const float min = is_signed ? -1.0f : 0.0f;
+    const float xyz_scale = is_signed ? 511.0f : 1023.0f;
+    const float w_scale = is_signed ? 1.0f : 3.0f;
+
+    for (size_t i = 0; i < count; ++i, src += 4)
+    {
+        int32_t c[4];
+#ifdef RUT_HAS_SSE2
+        __m128i q = QuantizeSSE(src, _mm_set1_ps(min), _mm_set1_ps(1.0f), _mm_setr_ps(xyz_scale, xyz_scale, xyz_scale, w_scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(c), q);
+#else
+        QuantizeScalar(src, c, 3, min, 1.0f, xyz_scale);
+        QuantizeScalar(src + 3, c + 3, 1, min, 1.0f, w_scale);
+#endif
+        dst[i] = (static_cast<uint32_t>(c[0]) & 0x3ff) | ((static_cast<uint32_t>(c[1]) & 0x3ff) << 10) | ((static_cast<uint32_t>(c[2]) & 0x3ff) << 20) | (static_cast<uint32_t>(c[3]) << 30);
+    }
+}
+
+namespace rut
+{
+    void ConvertVertexComponents(Type type, const float *src, void *dst, size_t num_values)
+    {
+        switch (type)
+        {
+            case VT_HVEC2:
+            case VT_HVEC4:
+            {
+                size_t count = num_values * (type == VT_HVEC2 ? 2 : 4);
+                uint16_t *halfs = reinterpret_cast<uint16_t*>(dst);
+                for (size_t i = 0; i < count; ++i)
+                    halfs[i] = FloatToHalf(src[i]);
+                break;
+            }
+
+            case VT_UNORM8_VEC4:
+                QuantizeUnorm8(src, reinterpret_cast<uint8_t*>(dst), num_values * 4);
+                break;
+            
+            case VT_SNORM8_VEC4:
+                QuantizeSnorm8(src, reinterpret_cast<int8_t*>(dst), num_values * 4);
+                break;
+            
+            case VT_UNORM16_VEC2:
+            case VT_UNORM16_VEC4:
+                QuantizeUnorm16(src, reinterpret_cast<uint16_t*>(dst), num_values * (type == VT_UNORM16_VEC2 ? 2 : 4));
+                break;
+            
+            case VT_SNORM16_VEC2:
+            case VT_SNORM16_VEC4:
+                QuantizeSnorm16(src, reinterpret_cast<int16_t*>(dst), num_values * (type == VT_SNORM16_VEC2 ? 2 : 4));
+                break;
+            
+            case VT_UNORM_10_10_10_2:
+            case VT_SNORM_10_10_10_2:
+                QuantizePacked1010102(src, reinterpret_cast<uint32_t*>(dst), num_values, type == VT_SNORM_10_10_10_2);
+                break;
+            
+            case VT_FLOAT:
+            case VT_FVEC2:
+            case VT_FVEC3:
+            case VT_FVEC4:
+                std::memcpy(dst, src, num_values * FLOAT_TYPE_COUNTS[type] * sizeof(float));
+                break;
+            
+            default:
+                throw std::runtime_error("Error converting vertex components: Type can not be converted from floats");
+        }
+    }
+
+    void ConvertVertices(const VertexLayout &dst_layout, void *dst, const VertexLayout &src_layout, const void *src, size_t num_vertices)
+    {
+        // Attributes are gathered into contiguous chunks so conversions run over flat arrays
+        static const size_t CHUNK_SIZE = 256;
+        float gathered[CHUNK_SIZE * 4];
+        uint8_t converted[CHUNK_SIZE * 16];
+
+        for (const LayoutEntry &dst_entry : dst_layout)
+        {
+            const LayoutEntry *src_entry = src_layout.Find(dst_entry.name_hash);
+            if (!src_entry)
+                throw std::runtime_error(std::string("Error converting vertices: Source layout has no attribute '") + dst_layout.GetName(dst_entry) + "'");
+            
+            // Streams are stored as consecutive blocks
+            const uint8_t *src_bytes = reinterpret_cast<const uint8_t*>(src) + num_vertices * src_layout.GetStreamBase(src_entry->stream) + src_entry->offset;
+            uint8_t *dst_bytes = reinterpret_cast<uint8_t*>(dst) + num_vertices * dst_layout.GetStreamBase(dst_entry.stream) + dst_entry.offset;
+            uint32_t src_stride = src_layout.GetStreamStride(src_entry->stream), dst_stride = dst_layout.GetStreamStride(dst_entry.stream);
+
+            if (src_entry->type == dst_entry.type)
+            {
+                for (size_t v = 0; v < num_vertices; ++v)
+                    std::memcpy(dst_bytes + v * dst_stride, src_bytes + v * src_stride, dst_entry.size);
+                continue;
+            }
+
+            if (src_entry->type > VT_FVEC4 || !FLOAT_TYPE_COUNTS[src_entry->type] || dst_entry.count > 4)
+                throw std::runtime_error(std::string("Error converting vertices: Attribute '") + dst_layout.GetName(dst_entry) + "' can not be converted");
+            
+            // Missing source components are zero
+            uint32_t src_count = std::min(FLOAT_TYPE_COUNTS[src_entry->type], dst_entry.count);
+            for (size_t begin = 0; begin < num_vertices; begin += CHUNK_SIZE)
+            {
+                size_t count = std::min(CHUNK_SIZE, num_vertices - begin);
+                for (size_t v = 0; v < count; ++v)
+                {
+                    float *values = gathered + v * dst_entry.count;
+                    std::memcpy(values, src_bytes + (begin + v) * src_stride, src_count * sizeof(float));
+                    std::fill(values + src_count, values + dst_entry.count, 0.0f);
+                }
+
+                ConvertVertexComponents(dst_entry.type, gathered, converted, count);
+
+                for (size_t v = 0; v < count; ++v)
+                    std::memcpy(dst_bytes + (begin + v) * dst_stride, converted + v * dst_entry.size, dst_entry.size);
+            }
+        }
+    }
+}
\ No newline at end of file
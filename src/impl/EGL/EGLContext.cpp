@@ -78,6 +78,7 @@ namespace rut
             m_version_minor = minor;
 
             LoadOpenGLFunctions(reinterpret_cast<Proc(*)(const char*)>(&eglGetProcAddress));
+            LoadOpenGLFeatures(&m_data);
 
             if (m_version_major < 3 || (m_version_major == 3 && m_version_minor < 3))
                 throw std::runtime_error("Device only supports OpenGL version " + std::to_string(m_version_major) + "." + std::to_string(m_version_major) + " - a minimum of 3.3 is required.");
@@ -85,6 +86,7 @@ namespace rut
 
         EGLContext::~EGLContext()
         {
+            DestroyOpenGLFeatures(&m_data);
             eglDestroyContext(m_data.display, m_data.context);
             eglDestroySurface(m_data.display, m_data.surface);
             eglTerminate(m_data.display);
@@ -99,6 +101,7 @@ namespace rut
         void EGLContext::End()
         {
             eglSwapBuffers(m_data.display, m_data.surface);
+            EndOpenGLFrame(&m_data);
         }
 
 
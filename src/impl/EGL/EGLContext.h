@@ -5,6 +5,7 @@
 #ifdef RUT_HAS_EGL
 
 #include"RUT/Context.h"
+#include"impl/OpenGL/OpenGLUtils.h"
 
 #include<EGL/egl.h>
 
@@ -12,7 +13,7 @@ namespace rut
 {
     namespace impl
     {
-        struct EGLData
+        struct EGLData : public OpenGLData
         {
             ::EGLDisplay display;
             ::EGLContext context;
@@ -35,6 +35,7 @@ namespace rut
             m_version_minor = minor;
 
             LoadOpenGLFunctions(reinterpret_cast<Proc(*)(const char*)>(&glXGetProcAddress));
+            LoadOpenGLFeatures(&m_data);
 
             if (m_version_major < 3 || (m_version_major == 3 && m_version_minor < 3))
                 throw std::runtime_error("Device only supports OpenGL version " + std::to_string(m_version_major) + "." + std::to_string(m_version_major) + " - a minimum of 3.3 is required.");
@@ -42,6 +43,7 @@ namespace rut
 
         GLXContext::~GLXContext()
         {
+            DestroyOpenGLFeatures(&m_data);
             glXDestroyContext(m_data.display, m_data.context);
         }
 
@@ -54,6 +56,7 @@ namespace rut
         void GLXContext::End()
         {
             glXSwapBuffers(m_data.display, m_data.window);
+            EndOpenGLFrame(&m_data);
         }
 
         uint64_t GLXContext::GetHandle() const { return reinterpret_cast<uint64_t>(&m_data); }
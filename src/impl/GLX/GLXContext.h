@@ -5,6 +5,7 @@
 #ifdef RUT_HAS_GLX
 
 #include"RUT/Context.h"
+#include"impl/OpenGL/OpenGLUtils.h"
 
 #include<X11/Xlib.h>
 #include<GL/glx.h>
@@ -13,7 +14,7 @@ namespace rut
 {
     namespace impl
     {
-        struct GLXData
+        struct GLXData : public OpenGLData
         {
             ::Display *display;
             ::Window window;
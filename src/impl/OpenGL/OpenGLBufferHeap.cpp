@@ -0,0 +1,94 @@
+#include"OpenGLBufferHeap.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"OpenGLStateCache.h"
+
+namespace rut
+{
+    namespace impl
+    {
+        OpenGLBufferHeap::OpenGLBufferHeap(OpenGLData *data):
+            BufferHeap({}),
+            m_gl_data(data)
+        {}
+
+        OpenGLBufferHeap::~OpenGLBufferHeap()
+        {
+            for (uint32_t i = 0; i < GetNumBlockSlots(); ++i)
+            {
+                if (IsBlockAlive(i))
+                    DestroyBlock(i);
+            }
+        }
+
+        GLuint OpenGLBufferHeap::GetBuffer(uint32_t block) const { return m_buffers[block]; }
+
+        void OpenGLBufferHeap::Write(Handle handle, uint64_t size, const void *data)
+        {
+            GLuint buffer = m_buffers[GetBlock(handle)];
+            if (m_gl_data->supports_dsa)
+                glNamedBufferSubData(buffer, GetOffset(handle), size, data);
+            else
+            {
+                m_gl_data->state_cache->BindBuffer(GL_ARRAY_BUFFER, buffer);
+                glBufferSubData(GL_ARRAY_BUFFER, GetOffset(handle), size, data);
+            }
+        }
+
+        void OpenGLBufferHeap::CreateBlock(uint32_t block, uint64_t size)
+        {
+            if (m_buffers.size() <= block)
+                m_buffers.resize(block + 1, 0);
+
+            GLuint &buffer = m_buffers[block];
+            if (m_gl_data->supports_dsa)
+                glCreateBuffers(1, &buffer);
+            else
+            {
+                glGenBuffers(1, &buffer);
+                m_gl_data->state_cache->BindBuffer(GL_ARRAY_BUFFER, buffer);
+            }
+
+            // Filled with sub data uploads and copies only
+            if (m_gl_data->supports_buffer_storage)
+            {
+                if (m_gl_data->supports_dsa)
+                    glNamedBufferStorage(buffer, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+                else
+                    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+            }
+            else if (m_gl_data->supports_dsa)
+                glNamedBufferData(buffer, size, nullptr, GL_STATIC_DRAW);
+            else
+                glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        }
+
+        void OpenGLBufferHeap::DestroyBlock(uint32_t block)
+        {
+            m_gl_data->state_cache->OnDeleteBuffer(m_buffers[block]);
+            glDeleteBuffers(1, &m_buffers[block]);
+            m_buffers[block] = 0;
+        }
+
+        void OpenGLBufferHeap::CopyRanges(const std::vector<Move> &moves)
+        {
+            for (const Move &move : moves)
+            {
+                GLuint src = m_buffers[move.src_block], dst = m_buffers[move.dst_block];
+                if (m_gl_data->supports_dsa)
+                {
+                    glCopyNamedBufferSubData(src, dst, move.src_offset, move.dst_offset, move.size);
+                    continue;
+                }
+
+                // The copy targets are not tracked by the state cache
+                glBindBuffer(GL_COPY_READ_BUFFER, src);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, move.src_offset, move.dst_offset, move.size);
+            }
+        }
+    }
+}
+
+#endif
\ No newline at end of file
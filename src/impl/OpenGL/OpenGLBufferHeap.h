@@ -0,0 +1,38 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"BufferHeap.h"
+#include"OpenGLUtils.h"
+
+#include<vector>
+
+namespace rut
+{
+    namespace impl
+    {
+        // Pools the buffers of static and immutable meshes. OpenGL orders copies and draws itself, so ranges are reused right away
+        class OpenGLBufferHeap : public BufferHeap
+        {
+        public:
+            OpenGLBufferHeap(OpenGLData *data);
+            virtual ~OpenGLBufferHeap();
+
+            GLuint GetBuffer(uint32_t block) const;
+            void Write(Handle handle, uint64_t size, const void *data);
+
+        protected:
+            virtual void CreateBlock(uint32_t block, uint64_t size) override;
+            virtual void DestroyBlock(uint32_t block) override;
+            virtual void CopyRanges(const std::vector<Move> &moves) override;
+
+        private:
+            OpenGLData *m_gl_data;
+            std::vector<GLuint> m_buffers;
+        };
+    }
+}
+
+#endif
\ No newline at end of file
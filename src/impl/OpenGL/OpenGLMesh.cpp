@@ -2,83 +2,380 @@
 
 #ifdef RUT_HAS_OPENGL
 
-static const bool VERTEX_TYPE_IS_FLOAT[] =
-{
-    false, true, false, true, false, true, false, true, true, true
-};
+#include"OpenGLStateCache.h"
+#include"OpenGLVertexFormatCache.h"
+#include"OpenGLStreamBuffer.h"
+#include"OpenGLBufferHeap.h"
+#include"RUT/Context.h"
+
+#include<stdexcept>
+#include<cstring>
 
-static GLenum VERTEX_TYPE_GLENUM[] =
+static bool HasSameInputs(const rut::VertexLayout &a, const rut::VertexLayout &b)
 {
-    GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_FLOAT, GL_FLOAT,
-};
+    if (!a.HasSameFormat(b))
+        return false;
+    
+    for (size_t i = 0; i < a.GetNumEntries(); ++i)
+    {
+        if (a[i].name_hash != b[i].name_hash)
+            return false;
+    }
+
+    return true;
+}
 
 namespace rut
 {
     namespace impl
     {
-        OpenGLMesh::OpenGLMesh(rut::Context *context, const rut::VertexLayout &layout):
-            m_layout(layout)
+        OpenGLMesh::OpenGLMesh(rut::Context *context, const rut::VertexLayout &layout, MeshUsage usage):
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
+            m_layout(layout),
+            m_usage(usage)
         { Init(); }
 
-        OpenGLMesh::OpenGLMesh(rut::Context *context, rut::VertexLayout &&layout):
-            m_layout(std::move(layout))
+        OpenGLMesh::OpenGLMesh(rut::Context *context, rut::VertexLayout &&layout, MeshUsage usage):
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
+            m_layout(std::move(layout)),
+            m_usage(usage)
         { Init(); }
 
         void OpenGLMesh::Init()
         {
+            m_num_vertices = 0;
+            m_num_indices = 0;
+
+            // Streaming binds buffer ranges, which needs separate vertex formats
+            m_streamed = m_usage == MU_STREAM && m_gl_data->stream_buffer && m_gl_data->vertex_formats;
+            m_pooled = (m_usage == MU_IMMUTABLE || m_usage == MU_STATIC) && m_gl_data->buffer_heap;
+
+            m_index_slot = m_layout.GetNumStreams();
+            std::vector<GLuint> buffers(m_index_slot + 1, 0);
+            if (!m_pooled)
+            {
+                if (m_gl_data->supports_dsa)
+                    glCreateBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+                else
+                    glGenBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+            }
+            
+            m_slots.resize(buffers.size());
+            for (size_t i = 0; i < buffers.size(); ++i)
+            {
+                BufferSlot &slot = m_slots[i];
+                slot.buffer = buffers[i];
+                slot.offset = 0;
+                slot.heap_handle = BufferHeap::INVALID_HANDLE;
+                slot.size = 0;
+                slot.has_data = false;
+                slot.stream_buffer = 0;
+                slot.stream_offset = 0;
+                slot.stream_frame = UINT64_MAX;
+            }
+
+            // Meshes with equal formats share a vertex array and only swap buffers. It is picked once the shader is known
+            m_vao_inputs = {};
+            m_num_attributes = 0;
+            if (m_gl_data->vertex_formats)
+            {
+                m_vao = 0;
+                return;
+            }
+
             glGenVertexArrays(1, &m_vao);
-            glGenBuffers(2, m_buffers);
 
-            glBindVertexArray(m_vao);
+            OpenGLStateCache *state_cache = m_gl_data->state_cache;
+            state_cache->BindVertexArray(m_vao);
+            state_cache->BindElementBuffer(m_slots[m_index_slot].buffer);
+        }
 
-            glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
+        void OpenGLMesh::SetupInputs(const VertexLayout &inputs)
+        {
+            std::vector<const LayoutEntry*> entries = m_layout.MatchInputs(inputs);
+            m_vao_inputs = inputs;
 
-            size_t index = 0;
-            for (const auto &item : m_layout)
+            if (m_gl_data->vertex_formats)
             {
-                if (VERTEX_TYPE_IS_FLOAT[item.GetType()])
-                    glVertexAttribPointer(index, item.GetCount(), VERTEX_TYPE_GLENUM[item.GetType()], GL_FALSE, m_layout.GetStride(), reinterpret_cast<void*>(item.GetOffset()));
+                m_vao = m_gl_data->vertex_formats->Get(entries);
+                return;
+            }
+
+            OpenGLStateCache *state_cache = m_gl_data->state_cache;
+            state_cache->BindVertexArray(m_vao);
+
+            GLuint index = 0;
+            for (const LayoutEntry *item : entries)
+            {
+                // Attribute pointers capture the array buffer bound at the time of the call
+                GLsizei stride = m_layout.GetStreamStride(item->stream);
+                state_cache->BindBuffer(GL_ARRAY_BUFFER, m_slots[item->stream].buffer);
+
+                if (VERTEX_TYPE_IS_FLOAT[item->type])
+                    glVertexAttribPointer(index, item->count, VERTEX_TYPE_GLENUM[item->type], VERTEX_TYPE_NORMALIZED[item->type], stride, reinterpret_cast<void*>(static_cast<uintptr_t>(item->offset)));
                 else
-                    glVertexAttribIPointer(index, item.GetCount(), VERTEX_TYPE_GLENUM[item.GetType()], m_layout.GetStride(), reinterpret_cast<void*>(item.GetOffset()));
+                    glVertexAttribIPointer(index, item->count, VERTEX_TYPE_GLENUM[item->type], stride, reinterpret_cast<void*>(static_cast<uintptr_t>(item->offset)));
                 
                 glEnableVertexAttribArray(index);
                 ++index;
             }
 
-            m_num_vertices = 0;
-            m_num_indices = 0;
+            // Attributes of a previous shader would still be fetched
+            for (; index < m_num_attributes; ++index)
+                glDisableVertexAttribArray(index);
+            
+            m_num_attributes = static_cast<uint32_t>(entries.size());
         }
 
         OpenGLMesh::~OpenGLMesh()
         {
-            glDeleteVertexArrays(1, &m_vao);
-            glDeleteBuffers(2, m_buffers);
+            Destroy();
+        }
+
+        void OpenGLMesh::Destroy()
+        {
+            OpenGLStateCache *state_cache = m_gl_data->state_cache;
+            if (!m_gl_data->vertex_formats)
+            {
+                state_cache->OnDeleteVertexArray(m_vao);
+                glDeleteVertexArrays(1, &m_vao);
+            }
+
+            for (const BufferSlot &slot : m_slots)
+            {
+                if (m_pooled)
+                {
+                    if (slot.heap_handle != BufferHeap::INVALID_HANDLE)
+                        m_gl_data->buffer_heap->Free(slot.heap_handle);
+                    
+                    continue;
+                }
+
+                state_cache->OnDeleteBuffer(slot.buffer);
+                glDeleteBuffers(1, &slot.buffer);
+            }
+
+            m_slots.clear();
         }
 
         const VertexLayout &OpenGLMesh::GetLayout() const { return m_layout; }
+        MeshUsage OpenGLMesh::GetUsage() const { return m_usage; }
 
         void OpenGLMesh::SetVertices(size_t num_vertices, const void *vertices)
         {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertices);
+            for (uint32_t i = 0; i < m_index_slot; ++i)
+                SetVertexStream(i, num_vertices, bytes + num_vertices * m_layout.GetStreamBase(i));
+        }
+
+        void OpenGLMesh::SetVertexStream(uint32_t stream, size_t num_vertices, const void *vertices)
+        {
+            if (stream >= m_index_slot)
+                throw std::runtime_error("Error setting OpenGL mesh data: Vertex stream out of range");
+            
+            Upload(stream, num_vertices * m_layout.GetStreamStride(stream), vertices);
             m_num_vertices = num_vertices;
 
-            glBindVertexArray(m_vao);
-            glBindBuffer(GL_ARRAY_BUFFER, m_buffers[0]);
-            glBufferData(GL_ARRAY_BUFFER, num_vertices * m_layout.GetStride(), vertices, GL_STATIC_DRAW);
+            UpdateMeshBounds(m_bounds, m_layout, stream, num_vertices, vertices);
         }
 
         void OpenGLMesh::SetIndices(size_t num_indices, const uint32_t *indices)
         {
+            Upload(m_index_slot, num_indices * sizeof(uint32_t), indices);
             m_num_indices = num_indices;
 
-            glBindVertexArray(m_vao);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers[1]);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+            // Ranges of the old indices
+            m_lods.clear();
+        }
+
+        void OpenGLMesh::SetLods(const std::vector<MeshLod> &lods)
+        {
+            for (const MeshLod &lod : lods)
+            {
+                if (static_cast<uint64_t>(lod.index_offset) + lod.index_count > m_num_indices)
+                    throw std::runtime_error("Error setting OpenGL mesh LODs: Range exceeds the indices");
+            }
+
+            m_lods = lods;
+        }
+        const std::vector<MeshLod> &OpenGLMesh::GetLods() const { return m_lods; }
+
+        const MeshBounds &OpenGLMesh::GetBounds() const { return m_bounds; }
+
+        size_t OpenGLMesh::GetGpuSize() const
+        {
+            // Streamed data lives in the context's shared stream buffer
+            size_t size = 0;
+            for (const BufferSlot &slot : m_slots)
+                size += slot.size;
+            
+            return size;
+        }
+
+        void OpenGLMesh::Evict()
+        {
+            // Immutable storage can't be shrunk, so the buffers are replaced by fresh ones
+            Destroy();
+            Init();
+        }
+
+        void OpenGLMesh::Upload(uint32_t index, size_t size, const void *data)
+        {
+            BufferSlot &slot = m_slots[index];
+            if (m_usage == MU_IMMUTABLE && slot.has_data)
+                throw std::runtime_error("Error setting OpenGL mesh data: Data of immutable meshes can only be set once");
+            
+            slot.has_data = true;
+
+            if (m_streamed)
+            {
+                const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+                slot.stream_data.assign(bytes, bytes + size);
+                Stream(index);
+                return;
+            }
+
+            // New data always gets a new range, the old one is reused once no draw reads it anymore
+            if (m_pooled)
+            {
+                OpenGLBufferHeap *heap = m_gl_data->buffer_heap;
+                if (slot.heap_handle != BufferHeap::INVALID_HANDLE)
+                    heap->Free(slot.heap_handle);
+                
+                slot.heap_handle = heap->Allocate(size, [this, index](uint32_t block, uint64_t offset)
+                {
+                    m_slots[index].buffer = m_gl_data->buffer_heap->GetBuffer(block);
+                    m_slots[index].offset = static_cast<GLintptr>(offset);
+                });
+
+                slot.buffer = heap->GetBuffer(heap->GetBlock(slot.heap_handle));
+                slot.offset = static_cast<GLintptr>(heap->GetOffset(slot.heap_handle));
+                slot.size = heap->GetSize(slot.heap_handle);
+                heap->Write(slot.heap_handle, size, data);
+                return;
+            }
+
+            // Buffers are typeless, so uploads use the array buffer target and leave the vertex array alone
+            GLuint buffer = slot.buffer;
+            if (!m_gl_data->supports_dsa)
+                m_gl_data->state_cache->BindBuffer(GL_ARRAY_BUFFER, buffer);
+            
+            switch (m_usage)
+            {
+                case MU_IMMUTABLE:
+                    if (m_gl_data->supports_buffer_storage)
+                    {
+                        if (m_gl_data->supports_dsa)
+                            glNamedBufferStorage(buffer, size, data, 0);
+                        else
+                            glBufferStorage(GL_ARRAY_BUFFER, size, data, 0);
+                        break;
+                    }
+                    // fallthrough
+                
+                case MU_STATIC:
+                    if (m_gl_data->supports_dsa)
+                        glNamedBufferData(buffer, size, data, GL_STATIC_DRAW);
+                    else
+                        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+                    break;
+                
+                // Updates of unchanged size reuse the existing store
+                case MU_DYNAMIC:
+                    if (size == slot.size)
+                    {
+                        if (m_gl_data->supports_dsa)
+                            glNamedBufferSubData(buffer, 0, size, data);
+                        else
+                            glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+                    }
+                    else if (m_gl_data->supports_dsa)
+                        glNamedBufferData(buffer, size, data, GL_DYNAMIC_DRAW);
+                    else
+                        glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+                    break;
+                
+                case MU_STREAM:
+                    if (m_gl_data->supports_dsa)
+                        glNamedBufferData(buffer, size, data, GL_STREAM_DRAW);
+                    else
+                        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+                    break;
+            }
+
+            slot.size = size;
+        }
+
+        void OpenGLMesh::Stream(uint32_t index)
+        {
+            OpenGLStreamBuffer *stream_buffer = m_gl_data->stream_buffer;
+            BufferSlot &slot = m_slots[index];
+            const std::vector<uint8_t> &data = slot.stream_data;
+            slot.stream_frame = stream_buffer->GetFrame();
+
+            uint32_t offset;
+            void *ptr = data.empty() ? nullptr : stream_buffer->Allocate(static_cast<uint32_t>(data.size()), sizeof(uint32_t), offset);
+            if (ptr)
+            {
+                std::memcpy(ptr, data.data(), data.size());
+                slot.stream_buffer = stream_buffer->GetId();
+                slot.stream_offset = offset;
+                return;
+            }
+
+            // Region is exhausted, fall back to the mesh's own buffer
+            GLuint buffer = slot.buffer;
+            if (m_gl_data->supports_dsa)
+                glNamedBufferData(buffer, data.size(), data.data(), GL_STREAM_DRAW);
+            else
+            {
+                m_gl_data->state_cache->BindBuffer(GL_ARRAY_BUFFER, buffer);
+                glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STREAM_DRAW);
+            }
+
+            slot.stream_buffer = buffer;
+            slot.stream_offset = 0;
+        }
+
+        void OpenGLMesh::Bind(const VertexLayout &inputs)
+        {
+            if (m_vao == 0 || !HasSameInputs(m_vao_inputs, inputs))
+                SetupInputs(inputs);
+            
+            OpenGLStateCache *state_cache = m_gl_data->state_cache;
+            state_cache->BindVertexArray(m_vao);
+
+            if (!m_gl_data->vertex_formats)
+                return;
+            
+            if (!m_streamed)
+            {
+                for (uint32_t i = 0; i < m_index_slot; ++i)
+                    state_cache->BindVertexBuffer(i, m_slots[i].buffer, m_slots[i].offset, m_layout.GetStreamStride(i));
+                
+                state_cache->BindElementBuffer(m_slots[m_index_slot].buffer);
+                return;
+            }
+
+            // Stream regions are recycled once their frame is over, so data from earlier frames is written again
+            uint64_t frame = m_gl_data->stream_buffer->GetFrame();
+            for (uint32_t i = 0; i < m_slots.size(); ++i)
+            {
+                if (m_slots[i].stream_frame != frame)
+                    Stream(i);
+            }
+
+            for (uint32_t i = 0; i < m_index_slot; ++i)
+                state_cache->BindVertexBuffer(i, m_slots[i].stream_buffer, m_slots[i].stream_offset, m_layout.GetStreamStride(i));
+            
+            state_cache->BindElementBuffer(m_slots[m_index_slot].stream_buffer);
         }
 
         uint64_t OpenGLMesh::GetHandle() const { return m_vao; }
 
         size_t OpenGLMesh::GetNumVertices() const { return m_num_vertices; }
         size_t OpenGLMesh::GetNumIndices() const { return m_num_indices; }
+        uintptr_t OpenGLMesh::GetIndexOffset() const { return m_streamed ? m_slots[m_index_slot].stream_offset : m_slots[m_index_slot].offset; }
     }
 }
 
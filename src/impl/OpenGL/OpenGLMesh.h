@@ -6,7 +6,11 @@
 
 #include"RUT/Mesh.h"
 #include"RUT/Layout.h"
+#include"RUT/Bounds.h"
 #include"OpenGLUtils.h"
+#include"BufferHeap.h"
+
+#include<vector>
 
 namespace rut
 {
@@ -15,29 +19,82 @@ namespace rut
         class OpenGLMesh : public Mesh
         {
         public:
-            OpenGLMesh(Context *context, const VertexLayout &layout);
-            OpenGLMesh(Context *context, VertexLayout &&layout);
+            OpenGLMesh(Context *context, const VertexLayout &layout, MeshUsage usage);
+            OpenGLMesh(Context *context, VertexLayout &&layout, MeshUsage usage);
             virtual ~OpenGLMesh();
 
             virtual const VertexLayout &GetLayout() const override;
+            virtual MeshUsage GetUsage() const override;
 
             virtual void SetVertices(size_t num_vertices, const void *vertices) override;
+            virtual void SetVertexStream(uint32_t stream, size_t num_vertices, const void *vertices) override;
             virtual void SetIndices(size_t num_indices, const uint32_t *indices) override;
 
+            virtual void SetLods(const std::vector<MeshLod> &lods) override;
+            virtual const std::vector<MeshLod> &GetLods() const override;
+
+            virtual const MeshBounds &GetBounds() const override;
+
+            virtual size_t GetGpuSize() const override;
+            virtual void Evict() override;
+
             virtual uint64_t GetHandle() const override;
 
+            // Attaches the mesh's buffers to the attributes of the shader inputs, see VertexLayout::MatchInputs
+            void Bind(const VertexLayout &inputs);
+
             size_t GetNumVertices() const;
             size_t GetNumIndices() const;
 
+            // Byte offset of the indices in the bound element buffer
+            uintptr_t GetIndexOffset() const;
+
         private:
+            OpenGLData *m_gl_data;
             VertexLayout m_layout;
+            MeshUsage m_usage;
             
+            struct BufferSlot
+            {
+                // Pooled slots point into a block of the context's buffer heap, which may move them between frames
+                GLuint buffer;
+                GLintptr offset;
+                BufferHeap::Handle heap_handle;
+                size_t size;
+                bool has_data;
+
+                std::vector<uint8_t> stream_data;
+                GLuint stream_buffer;
+                GLintptr stream_offset;
+                uint64_t stream_frame;
+            };
+
             GLuint m_vao;
-            GLuint m_buffers[2];
             size_t m_num_vertices, m_num_indices;
 
+            // Shader inputs the vertex array was set up for, and the number of attributes it has enabled
+            VertexLayout m_vao_inputs = {};
+            uint32_t m_num_attributes;
+            std::vector<MeshLod> m_lods;
+            MeshBounds m_bounds;
+
+            // One slot per vertex stream, followed by the index buffer
+            std::vector<BufferSlot> m_slots;
+            uint32_t m_index_slot;
+
+            // Stream meshes are written to the context's stream buffer each frame they are drawn in
+            bool m_streamed;
+
+            // Static and immutable meshes share the blocks of the context's buffer heap
+            bool m_pooled;
+
             void Init();
+            void Destroy();
+            void Upload(uint32_t index, size_t size, const void *data);
+            void Stream(uint32_t index);
+            void SetupInputs(const VertexLayout &inputs);
         };
     }
 }
+
 #endif
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include"OpenGLRenderTarget.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"OpenGLStateCache.h"
+#include"RUT/Context.h"
+
+#include<cstring>
+#include<stdexcept>
+#include<vector>
+
+// Indexed by rut::RenderTargetFormat
+static const GLenum FORMAT_INTERNAL_FORMAT[] =
+{
+    GL_RGBA8,
+    GL_RGBA16F,
+    GL_RGBA32F
+};
+
+static const GLenum FORMAT_READ_TYPE[] =
+{
+    GL_UNSIGNED_BYTE,
+    GL_HALF_FLOAT,
+    GL_FLOAT
+};
+
+namespace rut
+{
+    namespace impl
+    {
+        OpenGLRenderTarget::OpenGLRenderTarget(Context *context, const RenderTargetProperties &props):
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
+            m_props(props),
+            m_depth_renderbuffer(0)
+        {
+            // Nothing samples the attachments, so renderbuffers suffice
+            glGenRenderbuffers(1, &m_color_renderbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, m_color_renderbuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, FORMAT_INTERNAL_FORMAT[m_props.color_format], m_props.width, m_props.height);
+
+            if (m_props.has_depth)
+            {
+                glGenRenderbuffers(1, &m_depth_renderbuffer);
+                glBindRenderbuffer(GL_RENDERBUFFER, m_depth_renderbuffer);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_props.width, m_props.height);
+            }
+
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            glGenFramebuffers(1, &m_framebuffer);
+            m_gl_data->state_cache->BindFramebuffer(m_framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_renderbuffer);
+            if (m_props.has_depth)
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_renderbuffer);
+
+            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            m_gl_data->state_cache->BindFramebuffer(0);
+
+            if (status != GL_FRAMEBUFFER_COMPLETE)
+            {
+                m_gl_data->state_cache->OnDeleteFramebuffer(m_framebuffer);
+                glDeleteFramebuffers(1, &m_framebuffer);
+                glDeleteRenderbuffers(1, &m_color_renderbuffer);
+                if (m_depth_renderbuffer)
+                    glDeleteRenderbuffers(1, &m_depth_renderbuffer);
+
+                throw std::runtime_error("Error creating OpenGL render target: Framebuffer is incomplete");
+            }
+        }
+
+        OpenGLRenderTarget::~OpenGLRenderTarget()
+        {
+            m_gl_data->state_cache->OnDeleteFramebuffer(m_framebuffer);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteRenderbuffers(1, &m_color_renderbuffer);
+            if (m_depth_renderbuffer)
+                glDeleteRenderbuffers(1, &m_depth_renderbuffer);
+        }
+
+        const RenderTargetProperties &OpenGLRenderTarget::GetProperties() const { return m_props; }
+
+        void OpenGLRenderTarget::ReadPixels(void *dst)
+        {
+            m_gl_data->state_cache->BindFramebuffer(m_framebuffer);
+            glReadPixels(0, 0, m_props.width, m_props.height, GL_RGBA, FORMAT_READ_TYPE[m_props.color_format], dst);
+
+            // OpenGL returns the bottom row first
+            size_t row_size = GetPixelDataSize() / m_props.height;
+            std::vector<uint8_t> row(row_size);
+            uint8_t *bytes = static_cast<uint8_t*>(dst);
+            for (uint32_t y = 0; y < m_props.height / 2; ++y)
+            {
+                uint8_t *top = bytes + y * row_size;
+                uint8_t *bottom = bytes + (m_props.height - 1 - y) * row_size;
+                std::memcpy(row.data(), top, row_size);
+                std::memcpy(top, bottom, row_size);
+                std::memcpy(bottom, row.data(), row_size);
+            }
+        }
+
+        uint64_t OpenGLRenderTarget::GetHandle() const { return static_cast<uint64_t>(m_framebuffer); }
+
+        void OpenGLRenderTarget::Bind()
+        {
+            m_gl_data->state_cache->BindFramebuffer(m_framebuffer);
+            m_gl_data->state_cache->Viewport(0, 0, m_props.width, m_props.height);
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"RUT/RenderTarget.h"
+#include"OpenGLUtils.h"
+
+namespace rut
+{
+    namespace impl
+    {
+        class OpenGLRenderTarget : public RenderTarget
+        {
+        public:
+            OpenGLRenderTarget(Context *context, const RenderTargetProperties &props);
+            virtual ~OpenGLRenderTarget();
+
+            virtual const RenderTargetProperties &GetProperties() const override;
+
+            virtual void ReadPixels(void *dst) override;
+
+            virtual uint64_t GetHandle() const override;
+
+            void Bind();
+
+        private:
+            OpenGLData *m_gl_data;
+            RenderTargetProperties m_props;
+            GLuint m_framebuffer;
+            GLuint m_color_renderbuffer, m_depth_renderbuffer;
+        };
+    }
+}
+
+#endif
\ No newline at end of file
@@ -4,15 +4,23 @@
 
 #include"OpenGLMesh.h"
 #include"OpenGLShader.h"
+#include"OpenGLUniformBuffer.h"
+#include"OpenGLStateCache.h"
+#include"OpenGLRenderTarget.h"
 #include"OpenGLUtils.h"
+#include"RUT/UniformBuffer.h"
+#include"RUT/Context.h"
+#include"RUT/ResidencyManager.h"
 
 #include<cassert>
+#include<algorithm>
 
 namespace rut
 {
     namespace impl
     {
         OpenGLRenderer::OpenGLRenderer(Context *context, const RendererProperties &props):
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
             m_props(props)
         {}
 
@@ -21,90 +29,136 @@ namespace rut
 
         const RendererProperties &OpenGLRenderer::GetProperties() const { return m_props; }
 
-        void OpenGLRenderer::Begin()
+        RendererStats OpenGLRenderer::GetStats() const
         {
+            const OpenGLStateCacheStats &cache_stats = m_gl_data->state_cache->GetStats();
+
+            RendererStats stats;
+            stats.state_changes_issued = cache_stats.issued;
+            stats.state_changes_elided = cache_stats.elided;
+            return stats;
+        }
+
+        void OpenGLRenderer::ResetStats() { m_gl_data->state_cache->ResetStats(); }
+
+        void OpenGLRenderer::Begin() { Begin(nullptr); }
+
+        void OpenGLRenderer::Begin(std::shared_ptr<RenderTarget> target)
+        {
+            OpenGLStateCache *state_cache = m_gl_data->state_cache;
+
+            if (target)
+                std::static_pointer_cast<OpenGLRenderTarget>(target)->Bind();
+            else
+            {
+                state_cache->BindFramebuffer(0);
+                state_cache->Viewport(0, 0, m_gl_data->default_framebuffer_width, m_gl_data->default_framebuffer_height);
+            }
+
             // Culling
             if (m_props.cull_mode == CM_NONE)
-                glDisable(GL_CULL_FACE);
+                state_cache->SetEnabled(GL_CULL_FACE, false);
             else
             {
-                glEnable(GL_CULL_FACE);
-                glFrontFace(GL_CCW);
+                state_cache->SetEnabled(GL_CULL_FACE, true);
+                state_cache->FrontFace(GL_CCW);
 
                 switch (m_props.cull_mode)
                 {
                     case CM_CLOCKWISE:
-                        glCullFace(GL_BACK);
+                        state_cache->CullFace(GL_BACK);
                         break;
                     
                     case CM_COUNTER_CLOCKWISE:
-                        glCullFace(GL_FRONT);
+                        state_cache->CullFace(GL_FRONT);
                         break;
                     
                     case CM_BOTH:
-                        glCullFace(GL_FRONT_AND_BACK);
+                        state_cache->CullFace(GL_FRONT_AND_BACK);
                         break;
                 }
             }
 
             // Blending
             if (m_props.blend_mode == BM_NONE)
-                glDisable(GL_BLEND);
+                state_cache->SetEnabled(GL_BLEND, false);
             else
             {
-                glEnable(GL_BLEND);
+                state_cache->SetEnabled(GL_BLEND, true);
 
                 switch (m_props.blend_mode)
                 {
                     case BM_SRC_ALPHA:
-                        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                        state_cache->BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                         break;
                     
                     case BM_ADDITIVE:
-                        glBlendFunc(GL_ONE, GL_ONE);
+                        state_cache->BlendFunc(GL_ONE, GL_ONE);
                         break;
                 }
             }
 
             // Depth testing
             if (m_props.depth_props.mode == DM_NONE)
-                glDisable(GL_DEPTH_TEST);
+                state_cache->SetEnabled(GL_DEPTH_TEST, false);
             else
             {
-                glDepthMask(m_props.depth_props.enable_write);
+                state_cache->SetEnabled(GL_DEPTH_TEST, true);
+                state_cache->DepthMask(m_props.depth_props.enable_write);
 
                 switch (m_props.depth_props.mode)
                 {
                     case DM_LESS:
-                        glDepthFunc(GL_LESS);
+                        state_cache->DepthFunc(GL_LESS);
                         break;
                     
                     case DM_GREATER:
-                        glDepthFunc(GL_GREATER);
+                        state_cache->DepthFunc(GL_GREATER);
                         break;
                 }
             }
 
             const glm::vec4 &clear_color = m_props.clear_props.clear_color;
-            glClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
-            glClearDepth(m_props.clear_props.clear_depth);
+            state_cache->ClearColor(clear_color.r, clear_color.g, clear_color.b, clear_color.a);
+            state_cache->ClearDepth(m_props.clear_props.clear_depth);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-            glUseProgram(static_cast<GLuint>(m_props.shader->GetHandle()));
+            state_cache->UseProgram(static_cast<GLuint>(m_props.shader->GetHandle()));
+
+            // Binding points are shared between programs, so buffers are attached when the program is used
+            std::shared_ptr<OpenGLShaderProgram> gl_shader = std::dynamic_pointer_cast<OpenGLShaderProgram>(m_props.shader);
+            for (const auto &entry : gl_shader->GetBoundBuffers())
+                std::static_pointer_cast<OpenGLUniformBuffer>(entry.second)->Bind(entry.first);
         }
 
-        void OpenGLRenderer::Render(std::shared_ptr<Mesh> mesh)
+        void OpenGLRenderer::Render(std::shared_ptr<Mesh> mesh) { RenderLod(mesh, 0); }
+
+        void OpenGLRenderer::RenderLod(std::shared_ptr<Mesh> mesh, uint32_t lod)
         {
             std::shared_ptr<OpenGLMesh> gl_mesh = std::dynamic_pointer_cast<OpenGLMesh>(mesh);
             assert(gl_mesh != nullptr);
 
-            GLuint vao = static_cast<GLuint>(gl_mesh->GetHandle());
-            glBindVertexArray(vao);
+            if (m_props.residency)
+                m_props.residency->Use(gl_mesh.get());
+
+            gl_mesh->Bind(m_props.shader->GetProperties().input_layout);
 
             if (gl_mesh->GetNumIndices() == 0)
+            {
                 glDrawArrays(GL_TRIANGLES, 0, gl_mesh->GetNumVertices());
-            else
-                glDrawElements(GL_TRIANGLES, gl_mesh->GetNumIndices(), GL_UNSIGNED_INT, nullptr);
+                return;
+            }
+
+            size_t first = 0, count = gl_mesh->GetNumIndices();
+            const std::vector<MeshLod> &lods = gl_mesh->GetLods();
+            if (!lods.empty())
+            {
+                const MeshLod &range = lods[std::min<size_t>(lod, lods.size() - 1)];
+                first = range.index_offset;
+                count = range.index_count;
+            }
+
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, reinterpret_cast<void*>(gl_mesh->GetIndexOffset() + first * sizeof(uint32_t)));
         }
 
         void OpenGLRenderer::End()
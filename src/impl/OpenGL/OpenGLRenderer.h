@@ -4,6 +4,7 @@
 
 #ifdef RUT_HAS_OPENGL
 #include"RUT/Renderer.h"
+#include"OpenGLUtils.h"
 
 namespace rut
 {
@@ -17,11 +18,17 @@ namespace rut
 
             virtual const RendererProperties &GetProperties() const override;
 
+            virtual RendererStats GetStats() const override;
+            virtual void ResetStats() override;
+
             virtual void Begin() override;
+            virtual void Begin(std::shared_ptr<RenderTarget> target) override;
             virtual void Render(std::shared_ptr<Mesh> mesh) override;
+            virtual void RenderLod(std::shared_ptr<Mesh> mesh, uint32_t lod) override;
             virtual void End() override;
         
         private:
+            OpenGLData *m_gl_data;
             RendererProperties m_props;
         };
     }
@@ -3,10 +3,20 @@
 #ifdef RUT_HAS_OPENGL
 
 #include"OpenGLUniformBuffer.h"
+#include"RUT/Context.h"
 #include"ShaderTools.h"
+#include"OpenGLStateCache.h"
 
 #include<stdexcept>
 #include<string_view>
+#include<fstream>
+#include<cstdio>
+
+struct ProgramBinaryHeader
+{
+    uint64_t key;
+    GLenum format;
+};
 
 static const GLenum SHADER_TYPE_GLENUM[] =
 {
@@ -15,42 +25,39 @@ static const GLenum SHADER_TYPE_GLENUM[] =
     GL_GEOMETRY_SHADER
 };
 
-static const uint32_t VERTEX_TYPE_BYTES[] =
-{
-    4, 4, 8, 8, 12, 12, 16, 16
-};
-
-static const uint32_t VERTEX_TYPE_COUNTS[] =
-{
-    1, 1, 2, 2, 3, 3, 4, 4, 9, 16
-};
-
 namespace rut
 {
     namespace impl
     {
-        OpenGLShaderUnit::OpenGLShaderUnit(Context *context, ShaderType type, const std::string &source):
-            m_type(type)
+        OpenGLShaderUnit::OpenGLShaderUnit(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines):
+            m_type(type),
+            m_spirv(false)
         {
-            m_id = glCreateShader(SHADER_TYPE_GLENUM[type]);
+            m_hash = HashBytes(&type, sizeof(type));
+            m_hash = HashBytes(source.data(), source.size(), m_hash);
+            for (const auto &define : defines)
+            {
+                m_hash = HashBytes(define.name.data(), define.name.size() + 1, m_hash);
+                m_hash = HashBytes(define.value.data(), define.value.size() + 1, m_hash);
+            }
 
-            CodeBlob blob = GenerateOpenGLShader(source, type);
-            GLint length = blob.bytes;
-            glShaderSource(m_id, 1, &blob.data, &length);
+            OpenGLData *data = reinterpret_cast<OpenGLData*>(context->GetHandle());
+
+            // Hand SPIR-V straight to the driver when it can consume it, skipping spirv-cross
+            CodeBlob blob = data->supports_gl_spirv ? GenerateOpenGLSpirvShader(source, type, defines) : GenerateVulkanShader(source, type, defines);
+            m_code.assign(reinterpret_cast<uint32_t*>(blob.data), reinterpret_cast<uint32_t*>(blob.data + blob.bytes));
             delete[] blob.data;
 
-            glCompileShader(m_id);
+            ReflectShader(m_code.data(), m_code.size(), type, m_reflection);
 
-            GLint status;
-            glGetShaderiv(m_id, GL_COMPILE_STATUS, &status);
-            if (!status)
-            {
-                GLint length;
-                glGetShaderiv(m_id, GL_INFO_LOG_LENGTH, &length);
-                std::string msg(length, '\0');
-                glGetShaderInfoLog(m_id, length, nullptr, &msg[0]);
+            m_spirv = data->supports_gl_spirv;
+            m_id = CreateShader({});
 
-                throw std::runtime_error("Error compiling shader unit: " + msg);
+            // Driver rejected the module, fall back to cross-compiled GLSL
+            if (!m_id)
+            {
+                m_spirv = false;
+                m_id = CreateShader({});
             }
         }
 
@@ -63,15 +70,87 @@ namespace rut
 
         uint64_t OpenGLShaderUnit::GetHandle() const { return m_id; }
 
+        bool OpenGLShaderUnit::IsSpirv() const { return m_spirv; }
+
+        uint64_t OpenGLShaderUnit::GetHash() const { return m_hash; }
+
+        const ShaderReflection &OpenGLShaderUnit::GetReflection() const { return m_reflection; }
+
+        GLuint OpenGLShaderUnit::CreateShader(const std::vector<SpecializationConstant> &constants) const
+        {
+            GLuint id = glCreateShader(SHADER_TYPE_GLENUM[m_type]);
+
+            if (m_spirv)
+            {
+                std::vector<GLuint> indices, values;
+                for (const auto &constant : constants)
+                {
+                    indices.push_back(constant.id);
+                    values.push_back(constant.value);
+                }
+
+                glShaderBinary(1, &id, GL_SHADER_BINARY_FORMAT_SPIR_V, m_code.data(), static_cast<GLsizei>(m_code.size() * sizeof(uint32_t)));
+                glSpecializeShader(id, "main", static_cast<GLuint>(constants.size()), indices.data(), values.data());
+
+                GLint status;
+                glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+                if (!status)
+                {
+                    glDeleteShader(id);
+                    return 0;
+                }
+
+                return id;
+            }
+
+            CodeBlob blob = CrossCompileOpenGLShader(m_code.data(), m_code.size(), constants);
+            GLint length = blob.bytes;
+            glShaderSource(id, 1, &blob.data, &length);
+            delete[] blob.data;
+
+            glCompileShader(id);
+
+            GLint status;
+            glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+            if (!status)
+            {
+                GLint length;
+                glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+                std::string msg(length, '\0');
+                glGetShaderInfoLog(id, length, nullptr, &msg[0]);
+                glDeleteShader(id);
+
+                throw std::runtime_error("Error compiling shader unit: " + msg);
+            }
+
+            return id;
+        }
+
         OpenGLShaderProgram::OpenGLShaderProgram(Context *context, const ShaderProgramCreateProperties &create_props):
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
             m_props(create_props.props)
         {
-            m_id = glCreateProgram();
+            OpenGLData *data = m_gl_data;
 
-            std::vector<GLuint> shaders;
+            std::vector<std::shared_ptr<OpenGLShaderUnit>> units;
+            std::vector<const ShaderReflection*> reflections;
+            bool spirv = false;
+            uint64_t key = HashBytes(create_props.specialization_constants.data(), create_props.specialization_constants.size() * sizeof(SpecializationConstant));
             auto ProcessShader = [&](std::shared_ptr<ShaderUnit> unit)
             {
-                shaders.push_back(static_cast<GLuint>(unit->GetHandle()));
+                std::shared_ptr<OpenGLShaderUnit> gl_unit = std::dynamic_pointer_cast<OpenGLShaderUnit>(unit);
+                // A unit the driver rejected as SPIR-V fell back to GLSL, and the two can't be linked into one program
+                if (!units.empty() && gl_unit->IsSpirv() != spirv)
+                    throw std::runtime_error("Error creating shader program: Units mix SPIR-V and GLSL shaders. The driver rejected the SPIR-V module of some units");
+
+                units.push_back(gl_unit);
+                reflections.push_back(&gl_unit->GetReflection());
+                spirv = gl_unit->IsSpirv();
+
+                uint64_t unit_hash = gl_unit->GetHash();
+                bool unit_spirv = gl_unit->IsSpirv();
+                key = HashBytes(&unit_hash, sizeof(unit_hash), key);
+                key = HashBytes(&unit_spirv, sizeof(unit_spirv), key);
             };
 
             if (create_props.vertex_shader)
@@ -83,99 +162,140 @@ namespace rut
             if (create_props.geometry_shader)
                 ProcessShader(create_props.geometry_shader);
             
-            for (GLuint shader : shaders)
-                glAttachShader(m_id, shader);
-            
-            // Link program
-            glLinkProgram(m_id);
+            // Layouts not given by the user are taken from the shaders themselves
+            MergeReflection(m_props, reflections.data(), reflections.size());
 
-            GLint status;
-            glGetProgramiv(m_id, GL_LINK_STATUS, &status);
-            if (!status)
+            m_id = glCreateProgram();
+
+            // Binaries are only valid for the driver that produced them
+            std::string cache_path;
+            if (data->supports_program_binary && !create_props.binary_cache_directory.empty())
             {
-                GLint length;
-                glGetProgramiv(m_id, GL_INFO_LOG_LENGTH, &length);
-                std::string msg(length, '\0');
-                glGetProgramInfoLog(m_id, length, nullptr, &msg[0]);
+                std::string driver = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+                driver += reinterpret_cast<const char*>(glGetString(GL_VERSION));
+                key = HashBytes(driver.data(), driver.size(), key);
 
-                throw std::runtime_error("Error linking shader program: " + msg);
+                char name[32];
+                std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+                cache_path = create_props.binary_cache_directory + "/" + name;
             }
 
-            for (const auto &uniform_binding : m_props.uniform_bindings)
+            if (cache_path.empty() || !LoadBinary(cache_path, key))
             {
-                GLint index = glGetUniformBlockIndex(m_id, uniform_binding.name.c_str());
-                glUniformBlockBinding(m_id, index, uniform_binding.binding);
-                m_binding_point_indices[uniform_binding.binding] = index;
+                // Specialized variants are compiled per program, otherwise the units' own shaders are linked
+                const auto &constants = create_props.specialization_constants;
+                std::vector<GLuint> shaders;
+                for (const auto &unit : units)
+                {
+                    GLuint shader = constants.empty() ? static_cast<GLuint>(unit->GetHandle()) : unit->CreateShader(constants);
+                    if (!shader)
+                        throw std::runtime_error("Error specializing shader unit: glSpecializeShader failed");
+
+                    shaders.push_back(shader);
+                }
+
+                for (GLuint shader : shaders)
+                    glAttachShader(m_id, shader);
+                
+                if (!cache_path.empty())
+                    glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+                // Link program
+                glLinkProgram(m_id);
+
+                for (GLuint shader : shaders)
+                {
+                    glDetachShader(m_id, shader);
+                    if (!constants.empty())
+                        glDeleteShader(shader);
+                }
+
+                GLint status;
+                glGetProgramiv(m_id, GL_LINK_STATUS, &status);
+                if (!status)
+                {
+                    GLint length;
+                    glGetProgramiv(m_id, GL_INFO_LOG_LENGTH, &length);
+                    std::string msg(length, '\0');
+                    glGetProgramInfoLog(m_id, length, nullptr, &msg[0]);
+
+                    throw std::runtime_error("Error linking shader program: " + msg);
+                }
+
+                if (!cache_path.empty())
+                    SaveBinary(cache_path, key);
             }
 
-            for (GLuint shader : shaders)
-                glDetachShader(m_id, shader);
+            // SPIR-V programs carry no block names, but their bindings are already fixed by the module
+            if (!spirv)
+            {
+                for (const auto &uniform_binding : m_props.uniform_bindings)
+                {
+                    GLuint index = glGetUniformBlockIndex(m_id, uniform_binding.name.c_str());
+                    if (index != GL_INVALID_INDEX)
+                        glUniformBlockBinding(m_id, index, uniform_binding.binding);
+                }
+            }
         }
 
         OpenGLShaderProgram::~OpenGLShaderProgram()
         {
+            m_gl_data->state_cache->OnDeleteProgram(m_id);
             glDeleteProgram(m_id);
         }
 
         const ShaderProgramProperties &OpenGLShaderProgram::GetProperties() const { return m_props; }
 
-        void OpenGLShaderProgram::BindUniformBuffer(uint32_t binding, std::shared_ptr<UniformBuffer> buffer)
-        {
-            // Update binding
-            glBindBufferBase(GL_UNIFORM_BUFFER, binding, static_cast<GLuint>(buffer->GetHandle()));
-
-            // Update layout
-            GLint num_uniforms;
-            glGetActiveUniformBlockiv(m_id, m_binding_point_indices[binding], GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &num_uniforms);
-            std::vector<GLint> uniform_indices(num_uniforms);
-            glGetActiveUniformBlockiv(m_id, m_binding_point_indices[binding], GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, &uniform_indices[0]);
-
-            uint32_t index = 0;
-            std::shared_ptr<OpenGLUniformBuffer> gl_buffer = std::dynamic_pointer_cast<OpenGLUniformBuffer>(buffer);
-            for (auto &item : gl_buffer->m_layout)
-            {
-                GLuint uniform_index = static_cast<GLuint>(uniform_indices[index]);
-                GLint offset;
-                glGetActiveUniformsiv(m_id, 1, &uniform_index, GL_UNIFORM_OFFSET, &offset);
-                item->SetOffset(offset);
+        void OpenGLShaderProgram::BindUniformBuffer(uint32_t binding, std::shared_ptr<UniformBuffer> buffer) { m_bound_buffers[binding] = buffer; }
 
-                LayoutItem *base_item = item;
-                if (base_item->GetLength() > 1)
-                {
-                    GLint stride;
-                    glGetActiveUniformsiv(m_id, 1, &uniform_index, GL_UNIFORM_ARRAY_STRIDE, &stride);
-                    UniformArrayLayoutItem *arr_item = dynamic_cast<UniformArrayLayoutItem*>(item);
-                    arr_item->SetStride(stride);
-                    arr_item->SetSize(stride * arr_item->GetLength());
-                    base_item = arr_item->GetItem();
-                }
+        uint64_t OpenGLShaderProgram::GetHandle() const { return m_id; }
 
-                if (base_item->GetType() == VT_MAT3 || base_item->GetType() == VT_MAT4)
-                {
-                    GLint stride;
-                    glGetActiveUniformsiv(m_id, 1, &uniform_index, GL_UNIFORM_MATRIX_STRIDE, &stride);
-                    UniformMatrixLayoutItem *mat_item = dynamic_cast<UniformMatrixLayoutItem*>(base_item);
-                    mat_item->SetStride(stride);
-                    base_item->SetSize(stride * mat_item->GetDimension());
-                }
-                else
-                {
-                    base_item->SetSize(VERTEX_TYPE_BYTES[base_item->GetType()]);
-                }
+        const std::unordered_map<uint32_t, std::shared_ptr<UniformBuffer>> &OpenGLShaderProgram::GetBoundBuffers() const { return m_bound_buffers; }
 
-                ++index;
-            }
+        bool OpenGLShaderProgram::LoadBinary(const std::string &path, uint64_t key)
+        {
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file)
+                return false;
+
+            std::streamoff size = file.tellg();
+            if (size < static_cast<std::streamoff>(sizeof(ProgramBinaryHeader)))
+                return false;
+            
+            ProgramBinaryHeader header;
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(&header), sizeof(header));
 
-            GLint stride;
-            glGetActiveUniformBlockiv(m_id, m_binding_point_indices[binding], GL_UNIFORM_BLOCK_DATA_SIZE, &stride);
-            gl_buffer->m_layout.SetStride(stride);
+            std::vector<char> binary(static_cast<size_t>(size) - sizeof(header));
+            file.read(binary.data(), binary.size());
+            if (!file || header.key != key)
+                return false;
 
-            glBindBuffer(GL_UNIFORM_BUFFER, gl_buffer->m_id);
-            glBufferData(GL_UNIFORM_BUFFER, stride, nullptr, GL_DYNAMIC_DRAW);
-            gl_buffer->m_data.resize(stride);
+            glProgramBinary(m_id, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+            // Drivers reject binaries after updates or hardware changes. The program is then relinked from source
+            GLint status;
+            glGetProgramiv(m_id, GL_LINK_STATUS, &status);
+            return status;
         }
 
-        uint64_t OpenGLShaderProgram::GetHandle() const { return m_id; }
+        void OpenGLShaderProgram::SaveBinary(const std::string &path, uint64_t key) const
+        {
+            GLint length;
+            glGetProgramiv(m_id, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length <= 0)
+                return;
+
+            ProgramBinaryHeader header;
+            header.key = key;
+            std::vector<char> binary(length);
+            glGetProgramBinary(m_id, length, nullptr, &header.format, binary.data());
+
+            // Failing to write the cache is not an error, the program will simply be linked again next run
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), binary.size());
+        }
     }
 }
 
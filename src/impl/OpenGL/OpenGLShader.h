@@ -6,8 +6,10 @@
 
 #include"RUT/Shader.h"
 #include"OpenGLUtils.h"
+#include"ShaderTools.h"
 
 #include<unordered_map>
+#include<vector>
 
 namespace rut
 {
@@ -16,16 +18,27 @@ namespace rut
         class OpenGLShaderUnit : public ShaderUnit
         {
         public:
-            OpenGLShaderUnit(Context *context, ShaderType type, const std::string &source);
+            OpenGLShaderUnit(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines);
             virtual ~OpenGLShaderUnit();
 
             virtual ShaderType GetType() const override;
 
             virtual uint64_t GetHandle() const override;
+
+            bool IsSpirv() const;
+            uint64_t GetHash() const;
+
+            const ShaderReflection &GetReflection() const;
+
+            GLuint CreateShader(const std::vector<SpecializationConstant> &constants) const;
         
         private:
             ShaderType m_type;
             GLuint m_id;
+            bool m_spirv;
+            uint64_t m_hash;
+            std::vector<uint32_t> m_code;
+            ShaderReflection m_reflection;
         };
 
         class OpenGLShaderProgram : public ShaderProgram
@@ -39,11 +52,17 @@ namespace rut
             virtual void BindUniformBuffer(uint32_t binding, std::shared_ptr<UniformBuffer> buffer) override;
 
             virtual uint64_t GetHandle() const override;
+
+            const std::unordered_map<uint32_t, std::shared_ptr<UniformBuffer>> &GetBoundBuffers() const;
         
         private:
+            bool LoadBinary(const std::string &path, uint64_t key);
+            void SaveBinary(const std::string &path, uint64_t key) const;
+
+            OpenGLData *m_gl_data;
             ShaderProgramProperties m_props;
             GLuint m_id;
-            std::unordered_map<GLint, GLint> m_binding_point_indices;
+            std::unordered_map<uint32_t, std::shared_ptr<UniformBuffer>> m_bound_buffers;
         };
     }
 }
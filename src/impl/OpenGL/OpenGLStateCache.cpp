@@ -0,0 +1,327 @@
+#include"OpenGLStateCache.h"
+
+#ifdef RUT_HAS_OPENGL
+
+namespace rut
+{
+    namespace impl
+    {
+        // Initial values as defined by the OpenGL specification
+        OpenGLStateCache::OpenGLStateCache():
+            m_program(0),
+            m_vao(0),
+            m_array_buffer(0),
+            m_uniform_buffer(0),
+            m_element_buffer(0),
+            m_framebuffer(0),
+            m_viewport{ 0, 0, 0, 0 },
+            m_cull_face(false),
+            m_blend(false),
+            m_depth_test(false),
+            m_cull_mode(GL_BACK),
+            m_front_face(GL_CCW),
+            m_blend_src(GL_ONE),
+            m_blend_dst(GL_ZERO),
+            m_depth_func(GL_LESS),
+            m_depth_mask(true),
+            m_clear_color{ 0.0f, 0.0f, 0.0f, 0.0f },
+            m_clear_depth(1.0)
+        {
+            GLint num_bindings = 0;
+            glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &num_bindings);
+            m_uniform_bindings.resize(num_bindings, { 0, 0, 0 });
+
+            ResetVertexArrayState();
+        }
+
+        void OpenGLStateCache::ResetVertexArrayState()
+        {
+            for (IndexedBinding &binding : m_vertex_bindings)
+                binding = { 0, 0, 0 };
+            
+            m_element_buffer = 0;
+        }
+
+        bool OpenGLStateCache::Update(bool changed)
+        {
+            if (changed)
+                ++m_stats.issued;
+            else
+                ++m_stats.elided;
+            
+            return changed;
+        }
+
+        GLuint *OpenGLStateCache::GetBufferBinding(GLenum target)
+        {
+            switch (target)
+            {
+                case GL_ARRAY_BUFFER:   return &m_array_buffer;
+                case GL_UNIFORM_BUFFER: return &m_uniform_buffer;
+                default:                return nullptr;
+            }
+        }
+
+        void OpenGLStateCache::UseProgram(GLuint program)
+        {
+            if (Update(m_program != program))
+            {
+                glUseProgram(program);
+                m_program = program;
+            }
+        }
+
+        void OpenGLStateCache::BindVertexArray(GLuint vao)
+        {
+            if (Update(m_vao != vao))
+            {
+                glBindVertexArray(vao);
+                m_vao = vao;
+                ResetVertexArrayState();
+            }
+        }
+
+        void OpenGLStateCache::BindBuffer(GLenum target, GLuint buffer)
+        {
+            GLuint *binding = GetBufferBinding(target);
+            if (!binding)
+            {
+                Update(true);
+                glBindBuffer(target, buffer);
+                return;
+            }
+
+            if (Update(*binding != buffer))
+            {
+                glBindBuffer(target, buffer);
+                *binding = buffer;
+            }
+        }
+
+        void OpenGLStateCache::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+        {
+            BindBufferRange(target, index, buffer, 0, 0);
+        }
+
+        void OpenGLStateCache::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+        {
+            // A size of zero stands for the whole buffer
+            if (target != GL_UNIFORM_BUFFER || index >= m_uniform_bindings.size())
+            {
+                Update(true);
+                if (size == 0)
+                    glBindBufferBase(target, index, buffer);
+                else
+                    glBindBufferRange(target, index, buffer, offset, size);
+                return;
+            }
+
+            IndexedBinding &binding = m_uniform_bindings[index];
+            if (Update(binding.buffer != buffer || binding.offset != offset || binding.size != size))
+            {
+                if (size == 0)
+                    glBindBufferBase(target, index, buffer);
+                else
+                    glBindBufferRange(target, index, buffer, offset, size);
+                
+                binding = { buffer, offset, size };
+                m_uniform_buffer = buffer;
+            }
+        }
+
+        bool OpenGLStateCache::IsUniformRangeBound(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) const
+        {
+            if (index >= m_uniform_bindings.size())
+                return false;
+            
+            const IndexedBinding &binding = m_uniform_bindings[index];
+            return binding.buffer == buffer && binding.offset == offset && binding.size == size;
+        }
+
+        void OpenGLStateCache::BindVertexBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizei stride)
+        {
+            IndexedBinding &binding = m_vertex_bindings[index];
+            if (Update(binding.buffer != buffer || binding.offset != offset || binding.size != stride))
+            {
+                glBindVertexBuffer(index, buffer, offset, stride);
+                binding = { buffer, offset, stride };
+            }
+        }
+
+        void OpenGLStateCache::BindElementBuffer(GLuint buffer)
+        {
+            if (Update(m_element_buffer != buffer))
+            {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+                m_element_buffer = buffer;
+            }
+        }
+
+        void OpenGLStateCache::BindFramebuffer(GLuint framebuffer)
+        {
+            if (Update(m_framebuffer != framebuffer))
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                m_framebuffer = framebuffer;
+            }
+        }
+
+        void OpenGLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            // The initial viewport is the window's size, which the all zero shadow never matches
+            if (Update(m_viewport[0] != x || m_viewport[1] != y || m_viewport[2] != width || m_viewport[3] != height))
+            {
+                glViewport(x, y, width, height);
+                m_viewport[0] = x;
+                m_viewport[1] = y;
+                m_viewport[2] = width;
+                m_viewport[3] = height;
+            }
+        }
+
+        void OpenGLStateCache::SetEnabled(GLenum cap, bool enabled)
+        {
+            bool *state;
+            switch (cap)
+            {
+                case GL_CULL_FACE:  state = &m_cull_face; break;
+                case GL_BLEND:      state = &m_blend; break;
+                case GL_DEPTH_TEST: state = &m_depth_test; break;
+                default:
+                    Update(true);
+                    if (enabled)
+                        glEnable(cap);
+                    else
+                        glDisable(cap);
+                    return;
+            }
+
+            if (Update(*state != enabled))
+            {
+                if (enabled)
+                    glEnable(cap);
+                else
+                    glDisable(cap);
+                
+                *state = enabled;
+            }
+        }
+
+        void OpenGLStateCache::CullFace(GLenum mode)
+        {
+            if (Update(m_cull_mode != mode))
+            {
+                glCullFace(mode);
+                m_cull_mode = mode;
+            }
+        }
+
+        void OpenGLStateCache::FrontFace(GLenum mode)
+        {
+            if (Update(m_front_face != mode))
+            {
+                glFrontFace(mode);
+                m_front_face = mode;
+            }
+        }
+
+        void OpenGLStateCache::BlendFunc(GLenum src, GLenum dst)
+        {
+            if (Update(m_blend_src != src || m_blend_dst != dst))
+            {
+                glBlendFunc(src, dst);
+                m_blend_src = src;
+                m_blend_dst = dst;
+            }
+        }
+
+        void OpenGLStateCache::DepthFunc(GLenum func)
+        {
+            if (Update(m_depth_func != func))
+            {
+                glDepthFunc(func);
+                m_depth_func = func;
+            }
+        }
+
+        void OpenGLStateCache::DepthMask(bool enabled)
+        {
+            if (Update(m_depth_mask != enabled))
+            {
+                glDepthMask(enabled);
+                m_depth_mask = enabled;
+            }
+        }
+
+        void OpenGLStateCache::ClearColor(float r, float g, float b, float a)
+        {
+            if (Update(m_clear_color[0] != r || m_clear_color[1] != g || m_clear_color[2] != b || m_clear_color[3] != a))
+            {
+                glClearColor(r, g, b, a);
+                m_clear_color[0] = r;
+                m_clear_color[1] = g;
+                m_clear_color[2] = b;
+                m_clear_color[3] = a;
+            }
+        }
+
+        void OpenGLStateCache::ClearDepth(double depth)
+        {
+            if (Update(m_clear_depth != depth))
+            {
+                glClearDepth(depth);
+                m_clear_depth = depth;
+            }
+        }
+
+        void OpenGLStateCache::OnDeleteProgram(GLuint program)
+        {
+            // A deleted program stays in use until another one is installed, but its name may be reused
+            if (m_program == program)
+            {
+                glUseProgram(0);
+                m_program = 0;
+            }
+        }
+
+        void OpenGLStateCache::OnDeleteVertexArray(GLuint vao)
+        {
+            if (m_vao == vao)
+            {
+                m_vao = 0;
+                ResetVertexArrayState();
+            }
+        }
+
+        void OpenGLStateCache::OnDeleteBuffer(GLuint buffer)
+        {
+            if (m_array_buffer == buffer)
+                m_array_buffer = 0;
+            if (m_uniform_buffer == buffer)
+                m_uniform_buffer = 0;
+            
+            if (m_element_buffer == buffer)
+                m_element_buffer = 0;
+            
+            for (IndexedBinding &binding : m_uniform_bindings)
+                if (binding.buffer == buffer)
+                    binding = { 0, 0, 0 };
+            
+            for (IndexedBinding &binding : m_vertex_bindings)
+                if (binding.buffer == buffer)
+                    binding = { 0, 0, 0 };
+        }
+
+        void OpenGLStateCache::OnDeleteFramebuffer(GLuint framebuffer)
+        {
+            // Deleting the bound framebuffer reverts the binding to the window's
+            if (m_framebuffer == framebuffer)
+                m_framebuffer = 0;
+        }
+
+        const OpenGLStateCacheStats &OpenGLStateCache::GetStats() const { return m_stats; }
+        void OpenGLStateCache::ResetStats() { m_stats = {}; }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"OpenGLUtils.h"
+
+#include<cstdint>
+#include<vector>
+
+namespace rut
+{
+    namespace impl
+    {
+        struct OpenGLStateCacheStats
+        {
+            uint64_t issued = 0;
+            uint64_t elided = 0;
+        };
+
+        // Shadows the bound state of one context so that redundant calls are never issued.
+        // All state changes of the backend have to go through it, otherwise the shadow goes stale
+        class OpenGLStateCache
+        {
+        public:
+            OpenGLStateCache();
+
+            void UseProgram(GLuint program);
+            void BindVertexArray(GLuint vao);
+            void BindBuffer(GLenum target, GLuint buffer);
+            void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+            void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+            // Whether the shadow has exactly this range bound to the uniform binding point
+            bool IsUniformRangeBound(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) const;
+
+            // Vertex and element buffer bindings belong to the bound vertex array and are forgotten when it changes
+            void BindVertexBuffer(GLuint index, GLuint buffer, GLintptr offset, GLsizei stride);
+            void BindElementBuffer(GLuint buffer);
+
+            // Binds both the draw and the read framebuffer
+            void BindFramebuffer(GLuint framebuffer);
+            void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+            void SetEnabled(GLenum cap, bool enabled);
+            void CullFace(GLenum mode);
+            void FrontFace(GLenum mode);
+            void BlendFunc(GLenum src, GLenum dst);
+            void DepthFunc(GLenum func);
+            void DepthMask(bool enabled);
+            void ClearColor(float r, float g, float b, float a);
+            void ClearDepth(double depth);
+
+            // Deleted objects are unbound by the driver
+            void OnDeleteProgram(GLuint program);
+            void OnDeleteVertexArray(GLuint vao);
+            void OnDeleteBuffer(GLuint buffer);
+            void OnDeleteFramebuffer(GLuint framebuffer);
+
+            const OpenGLStateCacheStats &GetStats() const;
+            void ResetStats();
+
+            static constexpr uint32_t MAX_VERTEX_BINDINGS = 16;
+
+        private:
+            struct IndexedBinding
+            {
+                GLuint buffer;
+                GLintptr offset;
+                GLsizeiptr size;
+            };
+
+            GLuint m_program;
+            GLuint m_vao;
+            GLuint m_array_buffer, m_uniform_buffer;
+            std::vector<IndexedBinding> m_uniform_bindings;
+            IndexedBinding m_vertex_bindings[MAX_VERTEX_BINDINGS];
+            GLuint m_element_buffer;
+            GLuint m_framebuffer;
+            GLint m_viewport[4];
+
+            bool m_cull_face, m_blend, m_depth_test;
+            GLenum m_cull_mode, m_front_face;
+            GLenum m_blend_src, m_blend_dst;
+            GLenum m_depth_func;
+            bool m_depth_mask;
+            float m_clear_color[4];
+            double m_clear_depth;
+
+            OpenGLStateCacheStats m_stats;
+
+            bool Update(bool changed);
+            GLuint *GetBufferBinding(GLenum target);
+            void ResetVertexArrayState();
+        };
+    }
+}
+
+#endif
\ No newline at end of file
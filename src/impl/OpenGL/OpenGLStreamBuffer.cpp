@@ -0,0 +1,82 @@
+#include"OpenGLStreamBuffer.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include<stdexcept>
+
+namespace rut
+{
+    namespace impl
+    {
+        OpenGLStreamBuffer::OpenGLStreamBuffer(uint32_t region_size, uint32_t num_regions):
+            m_region_size(region_size),
+            m_num_regions(num_regions),
+            m_region(0),
+            m_head(0),
+            m_frame(0),
+            m_fences(num_regions, nullptr)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GLsizeiptr size = static_cast<GLsizeiptr>(region_size) * num_regions;
+
+            glGenBuffers(1, &m_id);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_id);
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            m_mapped_data = reinterpret_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+
+            if (!m_mapped_data)
+            {
+                glDeleteBuffers(1, &m_id);
+                throw std::runtime_error("Error creating OpenGL stream buffer: glMapBufferRange failed");
+            }
+        }
+
+        OpenGLStreamBuffer::~OpenGLStreamBuffer()
+        {
+            for (GLsync fence : m_fences)
+                if (fence)
+                    glDeleteSync(fence);
+            
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_id);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glDeleteBuffers(1, &m_id);
+        }
+
+        void *OpenGLStreamBuffer::Allocate(uint32_t size, uint32_t alignment, uint32_t &offset)
+        {
+            uint32_t head = (m_head + alignment - 1) / alignment * alignment;
+            if (head + size > m_region_size)
+                return nullptr;
+            
+            m_head = head + size;
+            offset = m_region * m_region_size + head;
+            return m_mapped_data + offset;
+        }
+
+        void *OpenGLStreamBuffer::GetPointer(uint32_t offset) const { return m_mapped_data + offset; }
+
+        void OpenGLStreamBuffer::EndFrame()
+        {
+            m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_region = (m_region + 1) % m_num_regions;
+            m_head = 0;
+            ++m_frame;
+
+            GLsync &fence = m_fences[m_region];
+            if (fence)
+            {
+                GLenum res;
+                do res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                while (res == GL_TIMEOUT_EXPIRED);
+
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+
+        GLuint OpenGLStreamBuffer::GetId() const { return m_id; }
+        uint64_t OpenGLStreamBuffer::GetFrame() const { return m_frame; }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"OpenGLUtils.h"
+
+#include<cstdint>
+#include<vector>
+
+namespace rut
+{
+    namespace impl
+    {
+        // Persistently mapped ring of per-frame regions. Memory returned by Allocate is only valid in the frame it was allocated in
+        class OpenGLStreamBuffer
+        {
+        public:
+            OpenGLStreamBuffer(uint32_t region_size, uint32_t num_regions);
+            ~OpenGLStreamBuffer();
+
+            // Returns nullptr if the current region is exhausted
+            void *Allocate(uint32_t size, uint32_t alignment, uint32_t &offset);
+
+            // Mapped memory of an offset returned by Allocate this frame
+            void *GetPointer(uint32_t offset) const;
+
+            // Fences the current region and waits until the gpu has released the next one
+            void EndFrame();
+
+            GLuint GetId() const;
+            uint64_t GetFrame() const;
+
+        private:
+            GLuint m_id;
+            uint8_t *m_mapped_data;
+            uint32_t m_region_size, m_num_regions;
+            uint32_t m_region, m_head;
+            uint64_t m_frame;
+            std::vector<GLsync> m_fences;
+        };
+    }
+}
+
+#endif
\ No newline at end of file
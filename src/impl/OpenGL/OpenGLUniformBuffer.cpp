@@ -2,6 +2,11 @@
 
 #ifdef RUT_HAS_OPENGL
 
+#include"OpenGLStreamBuffer.h"
+#include"OpenGLStateCache.h"
+#include"RUT/Context.h"
+
+#include<algorithm>
 #include<cstring>
 
 namespace rut
@@ -9,20 +14,43 @@ namespace rut
     namespace impl
     {
         OpenGLUniformBuffer::OpenGLUniformBuffer(Context *context, const UniformLayout &layout):
-            m_layout(layout)
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
+            m_layout(layout),
+            m_stream_offset(0),
+            m_stream_frame(UINT64_MAX),
+            m_stream_bound(false),
+            m_fallback_frame(UINT64_MAX)
         { Init(); }
 
         OpenGLUniformBuffer::OpenGLUniformBuffer(Context *context, UniformLayout &&layout):
-            m_layout(std::move(layout))
+            m_gl_data(reinterpret_cast<OpenGLData*>(context->GetHandle())),
+            m_layout(std::move(layout)),
+            m_stream_offset(0),
+            m_stream_frame(UINT64_MAX),
+            m_stream_bound(false),
+            m_fallback_frame(UINT64_MAX)
         { Init(); }
 
         void OpenGLUniformBuffer::Init()
         {
+            m_data.resize(m_layout.GetStride());
+            m_mapped_data = reinterpret_cast<uint8_t*>(m_data.data());
+
+            if (m_gl_data->supports_dsa)
+            {
+                glCreateBuffers(1, &m_id);
+                glNamedBufferData(m_id, m_data.size(), m_data.data(), GL_DYNAMIC_DRAW);
+                return;
+            }
+
             glGenBuffers(1, &m_id);
+            m_gl_data->state_cache->BindBuffer(GL_UNIFORM_BUFFER, m_id);
+            glBufferData(GL_UNIFORM_BUFFER, m_data.size(), m_data.data(), GL_DYNAMIC_DRAW);
         }
 
         OpenGLUniformBuffer::~OpenGLUniformBuffer()
         {
+            m_gl_data->state_cache->OnDeleteBuffer(m_id);
             glDeleteBuffers(1, &m_id);
         }
 
@@ -31,35 +59,99 @@ namespace rut
         void OpenGLUniformBuffer::Map() {}
         void OpenGLUniformBuffer::Unmap()
         {
-            glBindBuffer(GL_UNIFORM_BUFFER, m_id);
-            glBufferData(GL_UNIFORM_BUFFER, m_data.size(), m_data.data(), GL_DYNAMIC_DRAW);
+            if (!IsDirty())
+                return;
+            
+            OpenGLStreamBuffer *stream_buffer = m_gl_data->stream_buffer;
+            if (!stream_buffer || m_fallback_frame == stream_buffer->GetFrame())
+                Upload(m_dirty_begin, m_dirty_end - m_dirty_begin);
+            else if (m_stream_frame == stream_buffer->GetFrame())
+            {
+                if (!m_stream_bound)
+                {
+                    // No draw has read this frame's copy yet, so only the dirty range is written into it
+                    std::memcpy(stream_buffer->GetPointer(m_stream_offset + m_dirty_begin), m_data.data() + m_dirty_begin, m_dirty_end - m_dirty_begin);
+                }
+                else
+                {
+                    // Draws issued so far read the old copy, the following ones get a new one
+                    uint32_t old_offset = m_stream_offset;
+                    Stream();
+                    Rebind(old_offset);
+                }
+            }
+
+            // Copies of earlier frames are recycled, Bind streams a new one
+            ClearDirty();
+        }
+
+        void OpenGLUniformBuffer::Rebind(uint32_t old_offset)
+        {
+            OpenGLStreamBuffer *stream_buffer = m_gl_data->stream_buffer;
+            for (GLuint binding : m_bindings)
+            {
+                // Binding points another buffer was bound to since are left alone
+                if (!m_gl_data->state_cache->IsUniformRangeBound(binding, stream_buffer->GetId(), old_offset, m_data.size()))
+                    continue;
+                
+                Bind(binding);
+            }
+        }
+
+        void OpenGLUniformBuffer::Upload(uint32_t offset, uint32_t size)
+        {
+            if (m_gl_data->supports_dsa)
+            {
+                glNamedBufferSubData(m_id, offset, size, m_data.data() + offset);
+                return;
+            }
+
+            m_gl_data->state_cache->BindBuffer(GL_UNIFORM_BUFFER, m_id);
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, size, m_data.data() + offset);
+        }
+
+        bool OpenGLUniformBuffer::Stream()
+        {
+            OpenGLStreamBuffer *stream_buffer = m_gl_data->stream_buffer;
+            m_stream_frame = UINT64_MAX;
+
+            void *ptr = stream_buffer->Allocate(static_cast<uint32_t>(m_data.size()), m_gl_data->uniform_buffer_offset_alignment, m_stream_offset);
+            if (!ptr)
+                return false;
+            
+            std::memcpy(ptr, m_data.data(), m_data.size());
+            m_stream_frame = stream_buffer->GetFrame();
+            m_stream_bound = false;
+            return true;
         }
 
-#define SET_UNIFORM(name, value)\
-auto itr = std::find_if(m_layout.begin(), m_layout.end(), [&](LayoutItem *item){ return item->GetName() == name; });\
-if (itr == m_layout.end()) return;\
-(*itr)->Write(&m_data[(*itr)->GetOffset()], value);
-
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, int i)               { SET_UNIFORM(name, &i) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, float f)             { SET_UNIFORM(name, &f) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec2 &v) { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec2 &v)  { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec3 &v) { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec3 &v)  { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec4 &v) { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec4 &v)  { SET_UNIFORM(name, &v) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::mat3 &m)  { SET_UNIFORM(name, &m) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::mat4 &m)  { SET_UNIFORM(name, &m) }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const int *i)        { SET_UNIFORM(name, i); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const float *f)      { SET_UNIFORM(name, f); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec2 *v) { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec2 *v)  { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec3 *v) { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec3 *v)  { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::ivec4 *v) { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::vec4 *v)  { SET_UNIFORM(name, v); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::mat3 *m)  { SET_UNIFORM(name, m); }
-        void OpenGLUniformBuffer::SetVariable(const std::string &name, const glm::mat4 *m)  { SET_UNIFORM(name, m); }
+        void OpenGLUniformBuffer::Bind(GLuint binding)
+        {
+            OpenGLStreamBuffer *stream_buffer = m_gl_data->stream_buffer;
+            if (!stream_buffer)
+            {
+                m_gl_data->state_cache->BindBufferBase(GL_UNIFORM_BUFFER, binding, m_id);
+                return;
+            }
+
+            if (std::find(m_bindings.begin(), m_bindings.end(), binding) == m_bindings.end())
+                m_bindings.push_back(binding);
+
+            // Stream regions are recycled once their frame is over, so blocks from earlier frames are written again
+            if (m_stream_frame == stream_buffer->GetFrame() || Stream())
+            {
+                m_gl_data->state_cache->BindBufferRange(GL_UNIFORM_BUFFER, binding, stream_buffer->GetId(), m_stream_offset, m_data.size());
+                m_stream_bound = true;
+                return;
+            }
+
+            // Region is exhausted, fall back to the buffer's own storage
+            if (m_fallback_frame != stream_buffer->GetFrame())
+                Upload(0, static_cast<uint32_t>(m_data.size()));
+            
+            m_fallback_frame = stream_buffer->GetFrame();
+            m_gl_data->state_cache->BindBufferBase(GL_UNIFORM_BUFFER, binding, m_id);
+        }
 
         uint64_t OpenGLUniformBuffer::GetHandle() const { return static_cast<uint64_t>(m_id); }
     }
@@ -16,7 +16,6 @@ namespace rut
     {
         class OpenGLUniformBuffer : public UniformBuffer
         {
-            friend class OpenGLShaderProgram;
         public:
             OpenGLUniformBuffer(Context *context, const UniformLayout &layout);
             OpenGLUniformBuffer(Context *context, UniformLayout &&layout);
@@ -26,36 +25,34 @@ namespace rut
 
             virtual void Map() override;
             virtual void Unmap() override;
-            virtual void SetVariable(const std::string &name, int i) override;
-            virtual void SetVariable(const std::string &name, float f) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec2 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec2 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec3 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec3 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec4 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec4 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::mat3 &m) override;
-            virtual void SetVariable(const std::string &name, const glm::mat4 &m) override;
-            virtual void SetVariable(const std::string &name, const int *i) override;
-            virtual void SetVariable(const std::string &name, const float *f) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec2 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec2 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec3 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec3 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec4 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec4 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::mat3 *m) override;
-            virtual void SetVariable(const std::string &name, const glm::mat4 *m) override;
 
             virtual uint64_t GetHandle() const override;
+
+            void Bind(GLuint binding);
         
         private:
+            OpenGLData *m_gl_data;
             UniformLayout m_layout;
             GLuint m_id;
 
             std::vector<char> m_data;
 
+            uint32_t m_stream_offset;
+            uint64_t m_stream_frame;
+
+            // Whether a draw may have read this frame's stream copy, which then must not be written again
+            bool m_stream_bound;
+
+            // Frame the buffer's own storage was last bound in, because the stream region was exhausted
+            uint64_t m_fallback_frame;
+
+            // Binding points the buffer was bound to, to bind a new copy to when it changes between draws
+            std::vector<GLuint> m_bindings;
+
             void Init();
+            void Upload(uint32_t offset, uint32_t size);
+            bool Stream();
+            void Rebind(uint32_t old_offset);
         };
     }
 }
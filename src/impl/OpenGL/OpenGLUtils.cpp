@@ -2,21 +2,58 @@
 
 #ifdef RUT_HAS_OPENGL
 
+#include"OpenGLStreamBuffer.h"
+#include"OpenGLStateCache.h"
+#include"OpenGLVertexFormatCache.h"
+#include"OpenGLBufferHeap.h"
+
+#include<string>
+#include<unordered_set>
+
 #define LOAD_FUNC(func) func = reinterpret_cast<decltype(func)>(load_proc(#func))
 
+PFNGLGETSTRINGIPROC glGetStringi;
+
 PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
 PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+PFNGLCREATEVERTEXARRAYSPROC glCreateVertexArrays;
+PFNGLVERTEXARRAYVERTEXBUFFERPROC glVertexArrayVertexBuffer;
+PFNGLVERTEXARRAYELEMENTBUFFERPROC glVertexArrayElementBuffer;
+PFNGLVERTEXARRAYATTRIBFORMATPROC glVertexArrayAttribFormat;
+PFNGLVERTEXARRAYATTRIBIFORMATPROC glVertexArrayAttribIFormat;
+PFNGLVERTEXARRAYATTRIBBINDINGPROC glVertexArrayAttribBinding;
+PFNGLENABLEVERTEXARRAYATTRIBPROC glEnableVertexArrayAttrib;
 
 PFNGLGENBUFFERSPROC glGenBuffers;
 PFNGLDELETEBUFFERSPROC glDeleteBuffers;
 PFNGLBINDBUFFERPROC glBindBuffer;
 PFNGLBUFFERDATAPROC glBufferData;
+PFNGLBUFFERSUBDATAPROC glBufferSubData;
 PFNGLBINDBUFFERBASEPROC glBindBufferBase;
+PFNGLBINDBUFFERRANGEPROC glBindBufferRange;
+PFNGLBUFFERSTORAGEPROC glBufferStorage;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+PFNGLCREATEBUFFERSPROC glCreateBuffers;
+PFNGLNAMEDBUFFERDATAPROC glNamedBufferData;
+PFNGLNAMEDBUFFERSUBDATAPROC glNamedBufferSubData;
+PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorage;
+PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData;
+PFNGLCOPYNAMEDBUFFERSUBDATAPROC glCopyNamedBufferSubData;
 
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
 PFNGLVERTEXATTRIBIPOINTERPROC glVertexAttribIPointer;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
+PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
+PFNGLBINDVERTEXBUFFERPROC glBindVertexBuffer;
+PFNGLVERTEXATTRIBFORMATPROC glVertexAttribFormat;
+PFNGLVERTEXATTRIBIFORMATPROC glVertexAttribIFormat;
+PFNGLVERTEXATTRIBBINDINGPROC glVertexAttribBinding;
+
+PFNGLFENCESYNCPROC glFenceSync;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+PFNGLDELETESYNCPROC glDeleteSync;
 
 PFNGLCREATESHADERPROC glCreateShader;
 PFNGLDELETESHADERPROC glDeleteShader;
@@ -24,6 +61,8 @@ PFNGLSHADERSOURCEPROC glShaderSource;
 PFNGLCOMPILESHADERPROC glCompileShader;
 PFNGLGETSHADERIVPROC glGetShaderiv;
 PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+PFNGLSHADERBINARYPROC glShaderBinary;
+PFNGLSPECIALIZESHADERPROC glSpecializeShader;
 PFNGLCREATEPROGRAMPROC glCreateProgram;
 PFNGLDELETEPROGRAMPROC glDeleteProgram;
 PFNGLUSEPROGRAMPROC glUseProgram;
@@ -39,6 +78,9 @@ PFNGLGETACTIVEUNIFORMBLOCKIVPROC glGetActiveUniformBlockiv;
 PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
 PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
 PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+PFNGLPROGRAMBINARYPROC glProgramBinary;
 
 PFNGLUNIFORM1IPROC glUniform1i;
 PFNGLUNIFORM1FPROC glUniform1f;
@@ -64,28 +106,85 @@ PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
 PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
 PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
 PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer;
+PFNGLGENRENDERBUFFERSPROC glGenRenderbuffers;
+PFNGLDELETERENDERBUFFERSPROC glDeleteRenderbuffers;
+PFNGLBINDRENDERBUFFERPROC glBindRenderbuffer;
+PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorage;
 
 namespace rut
 {
     namespace impl
     {
+        const bool VERTEX_TYPE_IS_FLOAT[] =
+        {
+            false, true, false, true, false, true, false, true, true, true,
+            true, true, true, true, true, true, true, true, true, true
+        };
+
+        const GLboolean VERTEX_TYPE_NORMALIZED[] =
+        {
+            GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE,
+            GL_FALSE, GL_FALSE, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE
+        };
+
+        const GLenum VERTEX_TYPE_GLENUM[] =
+        {
+            GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_INT, GL_FLOAT, GL_FLOAT, GL_FLOAT,
+            GL_HALF_FLOAT, GL_HALF_FLOAT, GL_UNSIGNED_BYTE, GL_BYTE, GL_UNSIGNED_SHORT, GL_SHORT, GL_UNSIGNED_SHORT, GL_SHORT, GL_UNSIGNED_INT_2_10_10_10_REV, GL_INT_2_10_10_10_REV
+        };
+
+        static constexpr uint32_t STREAM_BUFFER_REGION_SIZE = 4 * 1024 * 1024;
+        static constexpr uint32_t STREAM_BUFFER_NUM_REGIONS = 3;
+
         void LoadOpenGLFunctions(const std::function<Proc(const char*)> &load_proc)
         {
+            // Queries
+            LOAD_FUNC(glGetStringi);
+
             // Vertex arrays
             LOAD_FUNC(glGenVertexArrays);
             LOAD_FUNC(glDeleteVertexArrays);
             LOAD_FUNC(glBindVertexArray);
+            LOAD_FUNC(glCreateVertexArrays);
+            LOAD_FUNC(glVertexArrayVertexBuffer);
+            LOAD_FUNC(glVertexArrayElementBuffer);
+            LOAD_FUNC(glVertexArrayAttribFormat);
+            LOAD_FUNC(glVertexArrayAttribIFormat);
+            LOAD_FUNC(glVertexArrayAttribBinding);
+            LOAD_FUNC(glEnableVertexArrayAttrib);
 
             // Buffers
             LOAD_FUNC(glGenBuffers);
             LOAD_FUNC(glDeleteBuffers);
             LOAD_FUNC(glBindBuffer);
             LOAD_FUNC(glBufferData);
+            LOAD_FUNC(glBufferSubData);
             LOAD_FUNC(glBindBufferBase);
+            LOAD_FUNC(glBindBufferRange);
+            LOAD_FUNC(glBufferStorage);
+            LOAD_FUNC(glMapBufferRange);
+            LOAD_FUNC(glUnmapBuffer);
+            LOAD_FUNC(glCreateBuffers);
+            LOAD_FUNC(glNamedBufferData);
+            LOAD_FUNC(glNamedBufferSubData);
+            LOAD_FUNC(glNamedBufferStorage);
+            LOAD_FUNC(glCopyBufferSubData);
+            LOAD_FUNC(glCopyNamedBufferSubData);
 
             LOAD_FUNC(glVertexAttribPointer);
             LOAD_FUNC(glVertexAttribIPointer);
             LOAD_FUNC(glEnableVertexAttribArray);
+            LOAD_FUNC(glDisableVertexAttribArray);
+            LOAD_FUNC(glBindVertexBuffer);
+            LOAD_FUNC(glVertexAttribFormat);
+            LOAD_FUNC(glVertexAttribIFormat);
+            LOAD_FUNC(glVertexAttribBinding);
+
+            // Sync objects
+            LOAD_FUNC(glFenceSync);
+            LOAD_FUNC(glClientWaitSync);
+            LOAD_FUNC(glDeleteSync);
 
             // Shaders
             LOAD_FUNC(glCreateShader);
@@ -94,6 +193,10 @@ namespace rut
             LOAD_FUNC(glCompileShader);
             LOAD_FUNC(glGetShaderiv);
             LOAD_FUNC(glGetShaderInfoLog);
+            LOAD_FUNC(glShaderBinary);
+            LOAD_FUNC(glSpecializeShader);
+            if (!glSpecializeShader)
+                glSpecializeShader = reinterpret_cast<PFNGLSPECIALIZESHADERPROC>(load_proc("glSpecializeShaderARB"));
 
             LOAD_FUNC(glCreateProgram);
             LOAD_FUNC(glDeleteProgram);
@@ -110,6 +213,9 @@ namespace rut
             LOAD_FUNC(glGetUniformLocation);
             LOAD_FUNC(glGetUniformBlockIndex);
             LOAD_FUNC(glUniformBlockBinding);
+            LOAD_FUNC(glProgramParameteri);
+            LOAD_FUNC(glGetProgramBinary);
+            LOAD_FUNC(glProgramBinary);
 
             LOAD_FUNC(glUniform1i);
             LOAD_FUNC(glUniform1f);
@@ -136,6 +242,85 @@ namespace rut
             LOAD_FUNC(glBindFramebuffer);
             LOAD_FUNC(glFramebufferTexture2D);
             LOAD_FUNC(glCheckFramebufferStatus);
+            LOAD_FUNC(glFramebufferRenderbuffer);
+            LOAD_FUNC(glGenRenderbuffers);
+            LOAD_FUNC(glDeleteRenderbuffers);
+            LOAD_FUNC(glBindRenderbuffer);
+            LOAD_FUNC(glRenderbufferStorage);
+        }
+
+        void LoadOpenGLFeatures(OpenGLData *data)
+        {
+            GLint major, minor;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            data->version_major = major;
+            data->version_minor = minor;
+
+            GLint num_extensions;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+            std::unordered_set<std::string> extensions;
+            for (GLint i = 0; i < num_extensions; ++i)
+                extensions.insert(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)));
+
+            auto HasVersion = [data](uint32_t major, uint32_t minor)
+            {
+                return data->version_major > major || (data->version_major == major && data->version_minor >= minor);
+            };
+
+            auto HasExtension = [&extensions](const char *name)
+            {
+                return extensions.find(name) != extensions.end();
+            };
+
+            data->supports_gl_spirv = (HasVersion(4, 6) || HasExtension("GL_ARB_gl_spirv")) && glShaderBinary && glSpecializeShader;
+
+            GLint num_binary_formats = 0;
+            if (HasVersion(4, 1) || HasExtension("GL_ARB_get_program_binary"))
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+            data->supports_program_binary = num_binary_formats > 0 && glProgramParameteri && glGetProgramBinary && glProgramBinary;
+
+            data->supports_buffer_storage = (HasVersion(4, 4) || HasExtension("GL_ARB_buffer_storage")) && glBufferStorage;
+            data->supports_dsa = (HasVersion(4, 5) || HasExtension("GL_ARB_direct_state_access")) && glCreateBuffers && glCreateVertexArrays;
+            data->supports_vertex_attrib_binding = (HasVersion(4, 3) || HasExtension("GL_ARB_vertex_attrib_binding")) && glBindVertexBuffer && glVertexAttribFormat;
+
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &data->uniform_buffer_offset_alignment);
+
+            data->state_cache = new OpenGLStateCache();
+
+            // Pooled meshes bind their ranges at an offset, which needs separate vertex formats
+            if (data->supports_vertex_attrib_binding)
+            {
+                data->vertex_formats = new OpenGLVertexFormatCache(data);
+                data->buffer_heap = new OpenGLBufferHeap(data);
+            }
+
+            if (data->supports_buffer_storage)
+                data->stream_buffer = new OpenGLStreamBuffer(STREAM_BUFFER_REGION_SIZE, STREAM_BUFFER_NUM_REGIONS);
+        }
+
+        void DestroyOpenGLFeatures(OpenGLData *data)
+        {
+            delete data->stream_buffer;
+            data->stream_buffer = nullptr;
+
+            delete data->buffer_heap;
+            data->buffer_heap = nullptr;
+
+            delete data->vertex_formats;
+            data->vertex_formats = nullptr;
+
+            delete data->state_cache;
+            data->state_cache = nullptr;
+        }
+
+        void EndOpenGLFrame(OpenGLData *data)
+        {
+            if (data->stream_buffer)
+                data->stream_buffer->EndFrame();
+            
+            if (data->buffer_heap)
+                data->buffer_heap->Update();
         }
     }
 }
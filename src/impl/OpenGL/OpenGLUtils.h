@@ -17,21 +17,52 @@
 #include<GL/glext.h>
 #endif
 
+// Queries
+extern PFNGLGETSTRINGIPROC glGetStringi;
+
 // Vertex arrays
 extern PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 extern PFNGLDELETEVERTEXARRAYSPROC glDeleteVertexArrays;
 extern PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
+extern PFNGLCREATEVERTEXARRAYSPROC glCreateVertexArrays;
+extern PFNGLVERTEXARRAYVERTEXBUFFERPROC glVertexArrayVertexBuffer;
+extern PFNGLVERTEXARRAYELEMENTBUFFERPROC glVertexArrayElementBuffer;
+extern PFNGLVERTEXARRAYATTRIBFORMATPROC glVertexArrayAttribFormat;
+extern PFNGLVERTEXARRAYATTRIBIFORMATPROC glVertexArrayAttribIFormat;
+extern PFNGLVERTEXARRAYATTRIBBINDINGPROC glVertexArrayAttribBinding;
+extern PFNGLENABLEVERTEXARRAYATTRIBPROC glEnableVertexArrayAttrib;
 
 // Buffers
 extern PFNGLGENBUFFERSPROC glGenBuffers;
 extern PFNGLDELETEBUFFERSPROC glDeleteBuffers;
 extern PFNGLBINDBUFFERPROC glBindBuffer;
 extern PFNGLBUFFERDATAPROC glBufferData;
+extern PFNGLBUFFERSUBDATAPROC glBufferSubData;
 extern PFNGLBINDBUFFERBASEPROC glBindBufferBase;
+extern PFNGLBINDBUFFERRANGEPROC glBindBufferRange;
+extern PFNGLBUFFERSTORAGEPROC glBufferStorage;
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC glUnmapBuffer;
+extern PFNGLCREATEBUFFERSPROC glCreateBuffers;
+extern PFNGLNAMEDBUFFERDATAPROC glNamedBufferData;
+extern PFNGLNAMEDBUFFERSUBDATAPROC glNamedBufferSubData;
+extern PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorage;
+extern PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData;
+extern PFNGLCOPYNAMEDBUFFERSUBDATAPROC glCopyNamedBufferSubData;
 
 extern PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
 extern PFNGLVERTEXATTRIBIPOINTERPROC glVertexAttribIPointer;
 extern PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
+extern PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
+extern PFNGLBINDVERTEXBUFFERPROC glBindVertexBuffer;
+extern PFNGLVERTEXATTRIBFORMATPROC glVertexAttribFormat;
+extern PFNGLVERTEXATTRIBIFORMATPROC glVertexAttribIFormat;
+extern PFNGLVERTEXATTRIBBINDINGPROC glVertexAttribBinding;
+
+// Sync objects
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
 
 // Shaders
 extern PFNGLCREATESHADERPROC glCreateShader;
@@ -40,6 +71,8 @@ extern PFNGLSHADERSOURCEPROC glShaderSource;
 extern PFNGLCOMPILESHADERPROC glCompileShader;
 extern PFNGLGETSHADERIVPROC glGetShaderiv;
 extern PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+extern PFNGLSHADERBINARYPROC glShaderBinary;
+extern PFNGLSPECIALIZESHADERPROC glSpecializeShader;
 
 extern PFNGLCREATEPROGRAMPROC glCreateProgram;
 extern PFNGLDELETEPROGRAMPROC glDeleteProgram;
@@ -56,6 +89,9 @@ extern PFNGLGETACTIVEUNIFORMBLOCKIVPROC glGetActiveUniformBlockiv;
 extern PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
 extern PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
 extern PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+extern PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+extern PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glProgramBinary;
 
 extern PFNGLUNIFORM1IPROC glUniform1i;
 extern PFNGLUNIFORM1FPROC glUniform1f;
@@ -82,6 +118,11 @@ extern PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
 extern PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
 extern PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
 extern PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
+extern PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer;
+extern PFNGLGENRENDERBUFFERSPROC glGenRenderbuffers;
+extern PFNGLDELETERENDERBUFFERSPROC glDeleteRenderbuffers;
+extern PFNGLBINDRENDERBUFFERPROC glBindRenderbuffer;
+extern PFNGLRENDERBUFFERSTORAGEPROC glRenderbufferStorage;
 
 namespace rut
 {
@@ -89,7 +130,44 @@ namespace rut
 	{
 		typedef void(*Proc)();
 
+		class OpenGLStreamBuffer;
+		class OpenGLStateCache;
+		class OpenGLVertexFormatCache;
+		class OpenGLBufferHeap;
+
+		struct OpenGLData
+		{
+			uint32_t version_major = 0, version_minor = 0;
+			bool supports_gl_spirv = false;
+			bool supports_program_binary = false;
+			bool supports_buffer_storage = false;
+			bool supports_dsa = false;
+			bool supports_vertex_attrib_binding = false;
+			GLint uniform_buffer_offset_alignment = 256;
+
+			// Size of the window's framebuffer, kept up to date by the window
+			GLsizei default_framebuffer_width = 0, default_framebuffer_height = 0;
+
+			OpenGLStateCache *state_cache = nullptr;
+
+			// Only created when separate attribute formats are supported
+			OpenGLVertexFormatCache *vertex_formats = nullptr;
+			OpenGLBufferHeap *buffer_heap = nullptr;
+
+			// Only created when buffer storage is supported
+			OpenGLStreamBuffer *stream_buffer = nullptr;
+		};
+
+		// Indexed by rut::Type
+		extern const bool VERTEX_TYPE_IS_FLOAT[];
+		extern const GLboolean VERTEX_TYPE_NORMALIZED[];
+		extern const GLenum VERTEX_TYPE_GLENUM[];
+
 		void LoadOpenGLFunctions(const std::function<Proc(const char*)> &load_proc);
+		void LoadOpenGLFeatures(OpenGLData *data);
+		void DestroyOpenGLFeatures(OpenGLData *data);
+
+		void EndOpenGLFrame(OpenGLData *data);
 	}
 }
 
@@ -0,0 +1,96 @@
+#include"OpenGLVertexFormatCache.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"OpenGLStateCache.h"
+
+namespace rut
+{
+    namespace impl
+    {
+        OpenGLVertexFormatCache::OpenGLVertexFormatCache(OpenGLData *data):
+            m_gl_data(data)
+        {}
+
+        OpenGLVertexFormatCache::~OpenGLVertexFormatCache()
+        {
+            for (const auto &entry : m_formats)
+            {
+                m_gl_data->state_cache->OnDeleteVertexArray(entry.second.vao);
+                glDeleteVertexArrays(1, &entry.second.vao);
+            }
+        }
+
+        GLuint OpenGLVertexFormatCache::Get(const std::vector<const LayoutEntry*> &entries)
+        {
+            std::vector<uint32_t> key;
+            key.reserve(entries.size() * 3);
+            for (const LayoutEntry *entry : entries)
+            {
+                key.push_back(entry->stream);
+                key.push_back(entry->offset);
+                key.push_back(entry->type);
+            }
+
+            // FNV-1a
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (uint32_t value : key)
+                hash = (hash ^ value) * 0x100000001b3ull;
+
+            auto range = m_formats.equal_range(hash);
+            for (auto itr = range.first; itr != range.second; ++itr)
+            {
+                if (itr->second.key == key)
+                    return itr->second.vao;
+            }
+
+            GLuint vao = Create(entries);
+            m_formats.emplace(hash, Format{ std::move(key), vao });
+            return vao;
+        }
+
+        GLuint OpenGLVertexFormatCache::Create(const std::vector<const LayoutEntry*> &entries)
+        {
+            GLuint vao;
+            if (m_gl_data->supports_dsa)
+            {
+                glCreateVertexArrays(1, &vao);
+
+                GLuint index = 0;
+                for (const LayoutEntry *item : entries)
+                {
+                    if (VERTEX_TYPE_IS_FLOAT[item->type])
+                        glVertexArrayAttribFormat(vao, index, item->count, VERTEX_TYPE_GLENUM[item->type], VERTEX_TYPE_NORMALIZED[item->type], item->offset);
+                    else
+                        glVertexArrayAttribIFormat(vao, index, item->count, VERTEX_TYPE_GLENUM[item->type], item->offset);
+                    
+                    glVertexArrayAttribBinding(vao, index, item->stream);
+                    glEnableVertexArrayAttrib(vao, index);
+                    ++index;
+                }
+
+                return vao;
+            }
+
+            glGenVertexArrays(1, &vao);
+            m_gl_data->state_cache->BindVertexArray(vao);
+
+            GLuint index = 0;
+            for (const LayoutEntry *item : entries)
+            {
+                if (VERTEX_TYPE_IS_FLOAT[item->type])
+                    glVertexAttribFormat(index, item->count, VERTEX_TYPE_GLENUM[item->type], VERTEX_TYPE_NORMALIZED[item->type], item->offset);
+                else
+                    glVertexAttribIFormat(index, item->count, VERTEX_TYPE_GLENUM[item->type], item->offset);
+                
+                glVertexAttribBinding(index, item->stream);
+                glEnableVertexAttribArray(index);
+                ++index;
+            }
+
+            return vao;
+        }
+    }
+}
+
+#endif
\ No newline at end of file
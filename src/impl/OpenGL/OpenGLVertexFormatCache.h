@@ -0,0 +1,45 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_OPENGL
+
+#include"RUT/Layout.h"
+#include"OpenGLUtils.h"
+
+#include<unordered_map>
+#include<vector>
+
+namespace rut
+{
+    namespace impl
+    {
+        // One vertex array per distinct vertex format of the attributes a shader reads, see VertexLayout::MatchInputs.
+        // Each vertex stream gets its own binding, meshes attach their buffers before drawing
+        class OpenGLVertexFormatCache
+        {
+        public:
+            OpenGLVertexFormatCache(OpenGLData *data);
+            ~OpenGLVertexFormatCache();
+
+            GLuint Get(const std::vector<const LayoutEntry*> &entries);
+
+        private:
+            struct Format
+            {
+                // Stream, offset and type of the entry at each location
+                std::vector<uint32_t> key;
+                GLuint vao;
+            };
+
+            OpenGLData *m_gl_data;
+
+            // Keyed by a hash of the key, colliding formats are told apart by comparing keys
+            std::unordered_multimap<uint64_t, Format> m_formats;
+
+            GLuint Create(const std::vector<const LayoutEntry*> &entries);
+        };
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include"VulkanBufferHeap.h"
+
+#ifdef RUT_HAS_VULKAN
+
+#include<cstring>
+
+static rut::BufferHeapProperties GetVulkanBufferHeapProperties()
+{
+    rut::BufferHeapProperties props;
+    props.retire_frames = MAX_FRAMES_IN_FLIGHT;
+    return props;
+}
+
+namespace rut
+{
+    namespace impl
+    {
+        VulkanBufferHeap::VulkanBufferHeap(VulkanData *data):
+            BufferHeap(GetVulkanBufferHeapProperties()),
+            m_data(data)
+        {}
+
+        VulkanBufferHeap::~VulkanBufferHeap()
+        {
+            for (uint32_t i = 0; i < GetNumBlockSlots(); ++i)
+            {
+                if (IsBlockAlive(i))
+                    DestroyBlock(i);
+            }
+        }
+
+        VkBuffer VulkanBufferHeap::GetBuffer(uint32_t block) const { return m_buffers[block]; }
+
+        void VulkanBufferHeap::Write(Handle handle, VkDeviceSize size, const void *data)
+        {
+            if (size == 0)
+                return;
+            
+            VkBuffer staging_buffer;
+            VkDeviceMemory staging_mem;
+            CreateVulkanBuffer(m_data, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_mem);
+
+            void *mapped;
+            vkMapMemory(m_data->device, staging_mem, 0, size, 0, &mapped);
+            std::memcpy(mapped, data, size);
+            vkUnmapMemory(m_data->device, staging_mem);
+
+            try
+            {
+                CopyVulkanBuffer(m_data, staging_buffer, m_buffers[GetBlock(handle)], size, GetOffset(handle));
+            }
+            catch (...)
+            {
+                vkDestroyBuffer(m_data->device, staging_buffer, nullptr);
+                vkFreeMemory(m_data->device, staging_mem, nullptr);
+                throw;
+            }
+
+            vkDestroyBuffer(m_data->device, staging_buffer, nullptr);
+            vkFreeMemory(m_data->device, staging_mem, nullptr);
+        }
+
+        void VulkanBufferHeap::CreateBlock(uint32_t block, uint64_t size)
+        {
+            if (m_buffers.size() <= block)
+            {
+                m_buffers.resize(block + 1, VK_NULL_HANDLE);
+                m_mems.resize(block + 1, VK_NULL_HANDLE);
+            }
+
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            CreateVulkanBuffer(m_data, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffers[block], m_mems[block]);
+        }
+
+        void VulkanBufferHeap::DestroyBlock(uint32_t block)
+        {
+            // Blocks are only released once none of their ranges may be read by frames in flight
+            vkDestroyBuffer(m_data->device, m_buffers[block], nullptr);
+            vkFreeMemory(m_data->device, m_mems[block], nullptr);
+            m_buffers[block] = VK_NULL_HANDLE;
+            m_mems[block] = VK_NULL_HANDLE;
+        }
+
+        void VulkanBufferHeap::CopyRanges(const std::vector<Move> &moves)
+        {
+            std::vector<VulkanBufferCopy> copies(moves.size());
+            for (size_t i = 0; i < moves.size(); ++i)
+            {
+                copies[i].src = m_buffers[moves[i].src_block];
+                copies[i].dst = m_buffers[moves[i].dst_block];
+                copies[i].region.srcOffset = moves[i].src_offset;
+                copies[i].region.dstOffset = moves[i].dst_offset;
+                copies[i].region.size = moves[i].size;
+            }
+
+            CopyVulkanBuffers(m_data, copies.data(), static_cast<uint32_t>(copies.size()));
+        }
+    }
+}
+
+#endif
\ No newline at end of file
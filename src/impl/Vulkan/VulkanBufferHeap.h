@@ -0,0 +1,39 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_VULKAN
+
+#include"BufferHeap.h"
+#include"VulkanUtils.h"
+
+#include<vector>
+
+namespace rut
+{
+    namespace impl
+    {
+        // Pools the device local buffers of static and immutable meshes. Ranges are reused once the frames in flight that may read them are done
+        class VulkanBufferHeap : public BufferHeap
+        {
+        public:
+            VulkanBufferHeap(VulkanData *data);
+            virtual ~VulkanBufferHeap();
+
+            VkBuffer GetBuffer(uint32_t block) const;
+            void Write(Handle handle, VkDeviceSize size, const void *data);
+
+        protected:
+            virtual void CreateBlock(uint32_t block, uint64_t size) override;
+            virtual void DestroyBlock(uint32_t block) override;
+            virtual void CopyRanges(const std::vector<Move> &moves) override;
+
+        private:
+            VulkanData *m_data;
+            std::vector<VkBuffer> m_buffers;
+            std::vector<VkDeviceMemory> m_mems;
+        };
+    }
+}
+
+#endif
\ No newline at end of file
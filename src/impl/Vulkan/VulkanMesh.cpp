@@ -2,6 +2,7 @@
 
 #ifdef RUT_HAS_VULKAN
 
+#include"VulkanBufferHeap.h"
 #include"RUT/Context.h"
 
 #include<stdexcept>
@@ -11,118 +12,203 @@ namespace rut
 {
     namespace impl
     {
-        VulkanMesh::VulkanMesh(Context *context, const VertexLayout &layout):
+        VulkanMesh::VulkanMesh(Context *context, const VertexLayout &layout, MeshUsage usage):
             m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
-            m_layout(layout)
+            m_layout(layout),
+            m_usage(usage)
         { Init(); }
 
-        VulkanMesh::VulkanMesh(Context *context, VertexLayout &&layout):
+        VulkanMesh::VulkanMesh(Context *context, VertexLayout &&layout, MeshUsage usage):
             m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
-            m_layout(std::move(layout))
+            m_layout(std::move(layout)),
+            m_usage(usage)
         { Init(); }
 
         void VulkanMesh::Init()
-        {}
+        {
+            uint32_t num_slots = m_layout.GetNumStreams() + 1;
+            m_mesh_data.num_streams = m_layout.GetNumStreams();
+            m_mesh_data.buffers.resize(num_slots, VK_NULL_HANDLE);
+            m_mesh_data.mems.resize(num_slots, VK_NULL_HANDLE);
+            m_mesh_data.have_buffers.resize(num_slots, false);
+            m_mesh_data.region_sizes.resize(num_slots, 0);
+            m_mesh_data.offsets.resize(num_slots, 0);
+            m_buffer_sizes.resize(num_slots, 0);
+            m_heap_handles.resize(num_slots, BufferHeap::INVALID_HANDLE);
+
+            m_mapped.resize(num_slots, nullptr);
+            m_shadows.resize(num_slots);
+            m_frame_dirty.resize(num_slots, std::vector<bool>(MAX_FRAMES_IN_FLIGHT, false));
+        }
 
         VulkanMesh::~VulkanMesh()
         {
             vkDeviceWaitIdle(m_data->device);
             
-            if (m_mesh_data.have_buffers[0])
+            for (uint32_t i = 0; i <= m_mesh_data.num_streams; ++i)
+                Destroy(i);
+        }
+
+        void VulkanMesh::Destroy(uint32_t index)
+        {
+            if (!m_mesh_data.have_buffers[index])
+                return;
+            
+            if (m_heap_handles[index] != BufferHeap::INVALID_HANDLE)
             {
-                vkDestroyBuffer(m_data->device, m_mesh_data.buffers[0], nullptr);
-                vkFreeMemory(m_data->device, m_mesh_data.mems[0], nullptr);
+                m_data->buffer_heap->Free(m_heap_handles[index]);
+                m_heap_handles[index] = BufferHeap::INVALID_HANDLE;
             }
-
-            if (m_mesh_data.have_buffers[1])
+            else
             {
-                vkDestroyBuffer(m_data->device, m_mesh_data.buffers[1], nullptr);
-                vkFreeMemory(m_data->device, m_mesh_data.mems[1], nullptr);
+                if (m_mapped[index])
+                    vkUnmapMemory(m_data->device, m_mesh_data.mems[index]);
+                
+                vkDestroyBuffer(m_data->device, m_mesh_data.buffers[index], nullptr);
+                vkFreeMemory(m_data->device, m_mesh_data.mems[index], nullptr);
             }
+
+            m_mesh_data.have_buffers[index] = false;
+            m_mesh_data.region_sizes[index] = 0;
+            m_mesh_data.offsets[index] = 0;
+            m_buffer_sizes[index] = 0;
+            m_mapped[index] = nullptr;
         }
 
         const VertexLayout &VulkanMesh::GetLayout() const { return m_layout; }
+        MeshUsage VulkanMesh::GetUsage() const { return m_usage; }
 
         void VulkanMesh::SetVertices(size_t num_vertices, const void *vertices)
         {
-            if (m_mesh_data.have_buffers[0])
-            {
-                vkDestroyBuffer(m_data->device, m_mesh_data.buffers[0], nullptr);
-                vkFreeMemory(m_data->device, m_mesh_data.mems[0], nullptr);
-            }
-
-            m_mesh_data.have_buffers[0] = true;
-
-            VkBufferCreateInfo buffer_create_info{};
-            buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-            buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-            buffer_create_info.size = num_vertices * m_layout.GetStride();
-            buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertices);
+            for (uint32_t i = 0; i < m_mesh_data.num_streams; ++i)
+                SetVertexStream(i, num_vertices, bytes + num_vertices * m_layout.GetStreamBase(i));
+        }
 
-            if (vkCreateBuffer(m_data->device, &buffer_create_info, nullptr, &m_mesh_data.buffers[0]) != VK_SUCCESS)
-                throw std::runtime_error("Error setting Vulkan mesh vertices: vkCreateBuffer failed");
+        void VulkanMesh::SetVertexStream(uint32_t stream, size_t num_vertices, const void *vertices)
+        {
+            if (stream >= m_mesh_data.num_streams)
+                throw std::runtime_error("Error setting Vulkan mesh data: Vertex stream out of range");
             
-            VkMemoryRequirements mem_requirements;
-            vkGetBufferMemoryRequirements(m_data->device, m_mesh_data.buffers[0], &mem_requirements);
-
-            VkMemoryAllocateInfo alloc_info{};
-            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            alloc_info.allocationSize = mem_requirements.size;
-            alloc_info.memoryTypeIndex = GetVulkanMemoryType(m_data->physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            Upload(stream, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, num_vertices * m_layout.GetStreamStride(stream), vertices);
+            m_mesh_data.num_vertices = num_vertices;
 
-            if (vkAllocateMemory(m_data->device, &alloc_info, nullptr, &m_mesh_data.mems[0]) != VK_SUCCESS)
-                throw std::runtime_error("Error setting Vulkan mesh vertices: vkAllocateMemory failed");
-            
-            vkBindBufferMemory(m_data->device, m_mesh_data.buffers[0], m_mesh_data.mems[0], 0);
+            UpdateMeshBounds(m_bounds, m_layout, stream, num_vertices, vertices);
+        }
 
-            // Load data
-            void *data;
-            vkMapMemory(m_data->device, m_mesh_data.mems[0], 0, buffer_create_info.size, 0, &data);
-            std::memcpy(data, vertices, buffer_create_info.size);
-            vkUnmapMemory(m_data->device, m_mesh_data.mems[0]);
+        void VulkanMesh::SetIndices(size_t num_indices, const uint32_t *indices)
+        {
+            Upload(m_mesh_data.num_streams, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, num_indices * sizeof(uint32_t), indices);
+            m_mesh_data.num_indices = num_indices;
 
-            m_mesh_data.num_vertices = num_vertices;
+            // Ranges of the old indices
+            m_lods.clear();
         }
 
-        void VulkanMesh::SetIndices(size_t num_indices, const uint32_t *indices)
+        void VulkanMesh::SetLods(const std::vector<MeshLod> &lods)
         {
-            if (m_mesh_data.have_buffers[1])
+            for (const MeshLod &lod : lods)
             {
-                vkDestroyBuffer(m_data->device, m_mesh_data.buffers[1], nullptr);
-                vkFreeMemory(m_data->device, m_mesh_data.mems[1], nullptr);
+                if (static_cast<uint64_t>(lod.index_offset) + lod.index_count > m_mesh_data.num_indices)
+                    throw std::runtime_error("Error setting Vulkan mesh LODs: Range exceeds the indices");
             }
 
-            m_mesh_data.have_buffers[1] = true;
+            m_lods = lods;
+        }
+        const std::vector<MeshLod> &VulkanMesh::GetLods() const { return m_lods; }
 
-            VkBufferCreateInfo buffer_create_info{};
-            buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-            buffer_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-            buffer_create_info.size = num_indices * sizeof(uint32_t);
-            buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        const MeshBounds &VulkanMesh::GetBounds() const { return m_bounds; }
 
-            if (vkCreateBuffer(m_data->device, &buffer_create_info, nullptr, &m_mesh_data.buffers[1]) != VK_SUCCESS)
-                throw std::runtime_error("Error setting Vulkan mesh indices: vkCreateBuffer failed");
+        size_t VulkanMesh::GetGpuSize() const
+        {
+            size_t size = 0;
+            for (VkDeviceSize buffer_size : m_buffer_sizes)
+                size += buffer_size;
             
-            VkMemoryRequirements mem_requirements;
-            vkGetBufferMemoryRequirements(m_data->device, m_mesh_data.buffers[1], &mem_requirements);
+            return size;
+        }
 
-            VkMemoryAllocateInfo alloc_info{};
-            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            alloc_info.allocationSize = mem_requirements.size;
-            alloc_info.memoryTypeIndex = GetVulkanMemoryType(m_data->physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        void VulkanMesh::Evict()
+        {
+            // Frames in flight may still read the buffers. Meshes evicted together only wait for the first
+            WaitVulkanDeviceIdle(m_data);
 
-            if (vkAllocateMemory(m_data->device, &alloc_info, nullptr, &m_mesh_data.mems[1]) != VK_SUCCESS)
-                throw std::runtime_error("Error setting Vulkan mesh indices: vkAllocateMemory failed");
+            for (uint32_t i = 0; i <= m_mesh_data.num_streams; ++i)
+            {
+                Destroy(i);
+                m_shadows[i].clear();
+                m_frame_dirty[i].assign(MAX_FRAMES_IN_FLIGHT, false);
+            }
+
+            m_mesh_data.num_vertices = 0;
+            m_mesh_data.num_indices = 0;
+        }
+
+        void VulkanMesh::Upload(uint32_t index, VkBufferUsageFlags usage, VkDeviceSize size, const void *data)
+        {
+            if (m_usage == MU_IMMUTABLE && m_mesh_data.have_buffers[index])
+                throw std::runtime_error("Error setting Vulkan mesh data: Data of immutable meshes can only be set once");
             
-            vkBindBufferMemory(m_data->device, m_mesh_data.buffers[1], m_mesh_data.mems[1], 0);
+            if (m_usage == MU_IMMUTABLE || m_usage == MU_STATIC)
+            {
+                // Device local range of the heap, filled through a staging buffer. The heap keeps the old range alive for frames in flight
+                Destroy(index);
+                if (size == 0)
+                    return;
+                
+                VulkanBufferHeap *heap = m_data->buffer_heap;
+                BufferHeap::Handle handle = heap->Allocate(size, [this, index](uint32_t block, uint64_t offset)
+                {
+                    m_mesh_data.buffers[index] = m_data->buffer_heap->GetBuffer(block);
+                    m_mesh_data.offsets[index] = offset;
+                });
+
+                m_heap_handles[index] = handle;
+                m_mesh_data.buffers[index] = heap->GetBuffer(heap->GetBlock(handle));
+                m_mesh_data.offsets[index] = heap->GetOffset(handle);
+                m_mesh_data.have_buffers[index] = true;
+                m_buffer_sizes[index] = heap->GetSize(handle);
+
+                heap->Write(handle, size, data);
+                return;
+            }
 
-            // Load data
-            void *data;
-            vkMapMemory(m_data->device, m_mesh_data.mems[1], 0, buffer_create_info.size, 0, &data);
-            std::memcpy(data, indices, buffer_create_info.size);
-            vkUnmapMemory(m_data->device, m_mesh_data.mems[1]);
+            // Host visible ring with one region per frame in flight, regions are refreshed from the shadow copy when their frame comes up
+            if (size > m_mesh_data.region_sizes[index])
+            {
+                if (m_mesh_data.have_buffers[index])
+                {
+                    vkDeviceWaitIdle(m_data->device);
+                    Destroy(index);
+                }
+
+                CreateVulkanBuffer(m_data, size * MAX_FRAMES_IN_FLIGHT, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_mesh_data.buffers[index], m_mesh_data.mems[index]);
+                m_mesh_data.have_buffers[index] = true;
+                m_mesh_data.region_sizes[index] = size;
+                m_buffer_sizes[index] = size * MAX_FRAMES_IN_FLIGHT;
+
+                if (vkMapMemory(m_data->device, m_mesh_data.mems[index], 0, VK_WHOLE_SIZE, 0, &m_mapped[index]) != VK_SUCCESS)
+                {
+                    Destroy(index);
+                    throw std::runtime_error("Error setting Vulkan mesh data: vkMapMemory failed");
+                }
+            }
 
-            m_mesh_data.num_indices = num_indices;
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+            m_shadows[index].assign(bytes, bytes + size);
+            m_frame_dirty[index].assign(MAX_FRAMES_IN_FLIGHT, true);
+        }
+
+        void VulkanMesh::Flush(uint32_t frame)
+        {
+            for (uint32_t i = 0; i < m_mapped.size(); ++i)
+            {
+                if (!m_mapped[i] || !m_frame_dirty[i][frame])
+                    continue;
+                
+                std::memcpy(reinterpret_cast<uint8_t*>(m_mapped[i]) + frame * m_mesh_data.region_sizes[i], m_shadows[i].data(), m_shadows[i].size());
+                m_frame_dirty[i][frame] = false;
+            }
         }
 
         uint64_t VulkanMesh::GetHandle() const { return reinterpret_cast<uint64_t>(&m_mesh_data); }
@@ -6,7 +6,11 @@
 
 #include"RUT/Mesh.h"
 #include"RUT/Layout.h"
+#include"RUT/Bounds.h"
 #include"VulkanUtils.h"
+#include"BufferHeap.h"
+
+#include<vector>
 
 namespace rut
 {
@@ -14,9 +18,17 @@ namespace rut
     {
         struct VulkanMeshData
         {
-            VkBuffer buffers[2];
-            VkDeviceMemory mems[2];
-            bool have_buffers[2] = { false, false };
+            // One buffer per vertex stream, followed by the index buffer
+            uint32_t num_streams = 0;
+            std::vector<VkBuffer> buffers;
+            std::vector<VkDeviceMemory> mems;
+            std::vector<bool> have_buffers;
+
+            // Host visible buffers hold one region per frame in flight, device local buffers have a region size of 0
+            std::vector<VkDeviceSize> region_sizes;
+
+            // Device local data lives in ranges of the context's buffer heap, which may move them at the start of a frame
+            std::vector<VkDeviceSize> offsets;
             uint32_t num_vertices = 0;
             uint32_t num_indices = 0;
         };
@@ -24,24 +36,51 @@ namespace rut
         class VulkanMesh : public Mesh
         {
         public:
-            VulkanMesh(Context *context, const VertexLayout &layout);
-            VulkanMesh(Context *context, VertexLayout &&layout);
+            VulkanMesh(Context *context, const VertexLayout &layout, MeshUsage usage);
+            VulkanMesh(Context *context, VertexLayout &&layout, MeshUsage usage);
             virtual ~VulkanMesh();
 
             virtual const VertexLayout &GetLayout() const override;
+            virtual MeshUsage GetUsage() const override;
 
             virtual void SetVertices(size_t num_vertices, const void *vertices) override;
+            virtual void SetVertexStream(uint32_t stream, size_t num_vertices, const void *vertices) override;
             virtual void SetIndices(size_t num_indices, const uint32_t *indices) override;
 
+            virtual void SetLods(const std::vector<MeshLod> &lods) override;
+            virtual const std::vector<MeshLod> &GetLods() const override;
+
+            virtual const MeshBounds &GetBounds() const override;
+
+            virtual size_t GetGpuSize() const override;
+            virtual void Evict() override;
+
             virtual uint64_t GetHandle() const override;
 
+            // Brings the given frame's region up to date with the last data set
+            void Flush(uint32_t frame);
+
         private:
             VulkanData *m_data;
             VertexLayout m_layout;
+            MeshUsage m_usage;
 
             VulkanMeshData m_mesh_data;
+            std::vector<MeshLod> m_lods;
+            MeshBounds m_bounds;
+
+            // Allocated size per slot, including all regions of host visible buffers
+            std::vector<VkDeviceSize> m_buffer_sizes;
+            std::vector<BufferHeap::Handle> m_heap_handles;
+
+            // Only used by host visible meshes
+            std::vector<void*> m_mapped;
+            std::vector<std::vector<uint8_t>> m_shadows;
+            std::vector<std::vector<bool>> m_frame_dirty;
 
             void Init();
+            void Upload(uint32_t index, VkBufferUsageFlags usage, VkDeviceSize size, const void *data);
+            void Destroy(uint32_t index);
         };
     }
 }
@@ -0,0 +1,207 @@
+#include"VulkanRenderTarget.h"
+
+#ifdef RUT_HAS_VULKAN
+
+#include"RUT/Context.h"
+
+#include<stdexcept>
+#include<cstring>
+
+// Indexed by rut::RenderTargetFormat
+static const VkFormat FORMAT_TO_VK_FORMAT[] =
+{
+    VK_FORMAT_R8G8B8A8_UNORM,
+    VK_FORMAT_R16G16B16A16_SFLOAT,
+    VK_FORMAT_R32G32B32A32_SFLOAT
+};
+
+namespace rut
+{
+    namespace impl
+    {
+        VulkanRenderTarget::VulkanRenderTarget(Context *context, const RenderTargetProperties &props):
+            m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
+            m_props(props)
+        {
+            VkFormat color_format = FORMAT_TO_VK_FORMAT[m_props.color_format];
+            VkFormat depth_format = m_props.has_depth ? ChooseDepthFormat() : VK_FORMAT_UNDEFINED;
+
+            CreateAttachment(color_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, m_color);
+            if (m_props.has_depth)
+                CreateAttachment(depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, m_depth);
+
+            m_target_data.render_pass = GetVulkanOffscreenRenderPass(m_data, color_format, depth_format);
+            m_target_data.extent = { m_props.width, m_props.height };
+            m_target_data.has_depth = m_props.has_depth;
+
+            VkImageView attachments[] = { m_color.view, m_depth.view };
+
+            VkFramebufferCreateInfo framebuffer_create_info{};
+            framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_create_info.renderPass = m_target_data.render_pass;
+            framebuffer_create_info.attachmentCount = m_props.has_depth ? 2 : 1;
+            framebuffer_create_info.pAttachments = attachments;
+            framebuffer_create_info.width = m_props.width;
+            framebuffer_create_info.height = m_props.height;
+            framebuffer_create_info.layers = 1;
+
+            if (vkCreateFramebuffer(m_data->device, &framebuffer_create_info, nullptr, &m_target_data.framebuffer) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan render target: vkCreateFramebuffer failed");
+
+            // Render passes leave the color image ready to be copied from, so it starts out that way for ReadPixels before any rendering
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = m_color.image;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.layerCount = 1;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            VkCommandBuffer cmd_buffer = BeginVulkanCommands(m_data);
+            vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            SubmitVulkanCommands(m_data, cmd_buffer);
+        }
+
+        VulkanRenderTarget::~VulkanRenderTarget()
+        {
+            vkDeviceWaitIdle(m_data->device);
+
+            vkDestroyFramebuffer(m_data->device, m_target_data.framebuffer, nullptr);
+            DestroyAttachment(m_color);
+            DestroyAttachment(m_depth);
+        }
+
+        VkFormat VulkanRenderTarget::ChooseDepthFormat() const
+        {
+            // Every device supports at least one of the two
+            VkFormatProperties format_props;
+            vkGetPhysicalDeviceFormatProperties(m_data->physical_device, VK_FORMAT_D32_SFLOAT, &format_props);
+            if (format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+                return VK_FORMAT_D32_SFLOAT;
+
+            return VK_FORMAT_X8_D24_UNORM_PACK32;
+        }
+
+        void VulkanRenderTarget::CreateAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, Attachment &attachment)
+        {
+            VkImageCreateInfo image_create_info{};
+            image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_create_info.imageType = VK_IMAGE_TYPE_2D;
+            image_create_info.format = format;
+            image_create_info.extent = { m_props.width, m_props.height, 1 };
+            image_create_info.mipLevels = 1;
+            image_create_info.arrayLayers = 1;
+            image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_create_info.usage = usage;
+            image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(m_data->device, &image_create_info, nullptr, &attachment.image) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan render target: vkCreateImage failed");
+
+            VkMemoryRequirements mem_requirements;
+            vkGetImageMemoryRequirements(m_data->device, attachment.image, &mem_requirements);
+
+            VkMemoryAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.allocationSize = mem_requirements.size;
+            alloc_info.memoryTypeIndex = GetVulkanMemoryType(m_data->physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            if (vkAllocateMemory(m_data->device, &alloc_info, nullptr, &attachment.memory) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan render target: vkAllocateMemory failed");
+
+            vkBindImageMemory(m_data->device, attachment.image, attachment.memory, 0);
+
+            VkImageViewCreateInfo image_view_create_info{};
+            image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            image_view_create_info.format = format;
+            image_view_create_info.image = attachment.image;
+            image_view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            image_view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            image_view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            image_view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+            image_view_create_info.subresourceRange.aspectMask = aspect;
+            image_view_create_info.subresourceRange.baseMipLevel = 0;
+            image_view_create_info.subresourceRange.levelCount = 1;
+            image_view_create_info.subresourceRange.baseArrayLayer = 0;
+            image_view_create_info.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(m_data->device, &image_view_create_info, nullptr, &attachment.view) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan render target: vkCreateImageView failed");
+        }
+
+        void VulkanRenderTarget::DestroyAttachment(Attachment &attachment)
+        {
+            if (attachment.image == VK_NULL_HANDLE)
+                return;
+
+            vkDestroyImageView(m_data->device, attachment.view, nullptr);
+            vkDestroyImage(m_data->device, attachment.image, nullptr);
+            vkFreeMemory(m_data->device, attachment.memory, nullptr);
+            attachment = {};
+        }
+
+        const RenderTargetProperties &VulkanRenderTarget::GetProperties() const { return m_props; }
+
+        void VulkanRenderTarget::ReadPixels(void *dst)
+        {
+            VkDeviceSize size = GetPixelDataSize();
+
+            VkBuffer staging_buffer;
+            VkDeviceMemory staging_memory;
+            CreateVulkanBuffer(m_data, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_memory);
+
+            // Tightly packed rows, top row first
+            VkBufferImageCopy region{};
+            region.bufferOffset = 0;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { m_props.width, m_props.height, 1 };
+
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+            // The frame that drew the target was submitted before, and its render pass orders itself before later copies
+            VkCommandBuffer cmd_buffer = BeginVulkanCommands(m_data);
+            vkCmdCopyImageToBuffer(cmd_buffer, m_color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging_buffer, 1, &region);
+            vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            try
+            {
+                SubmitVulkanCommands(m_data, cmd_buffer);
+            }
+            catch (...)
+            {
+                vkDestroyBuffer(m_data->device, staging_buffer, nullptr);
+                vkFreeMemory(m_data->device, staging_memory, nullptr);
+                throw;
+            }
+
+            void *mapped;
+            vkMapMemory(m_data->device, staging_memory, 0, size, 0, &mapped);
+            std::memcpy(dst, mapped, size);
+            vkUnmapMemory(m_data->device, staging_memory);
+
+            vkDestroyBuffer(m_data->device, staging_buffer, nullptr);
+            vkFreeMemory(m_data->device, staging_memory, nullptr);
+        }
+
+        uint64_t VulkanRenderTarget::GetHandle() const { return reinterpret_cast<uint64_t>(&m_target_data); }
+    }
+}
+
+#endif
\ No newline at end of file
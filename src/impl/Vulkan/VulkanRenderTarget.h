@@ -0,0 +1,54 @@
+#pragma once
+
+#include"RUT/Config.h"
+
+#ifdef RUT_HAS_VULKAN
+
+#include"RUT/RenderTarget.h"
+#include"VulkanUtils.h"
+
+namespace rut
+{
+    namespace impl
+    {
+        struct VulkanRenderTargetData
+        {
+            VkRenderPass render_pass;
+            VkFramebuffer framebuffer;
+            VkExtent2D extent;
+            bool has_depth;
+        };
+
+        class VulkanRenderTarget : public RenderTarget
+        {
+        public:
+            VulkanRenderTarget(Context *context, const RenderTargetProperties &props);
+            virtual ~VulkanRenderTarget();
+
+            virtual const RenderTargetProperties &GetProperties() const override;
+
+            virtual void ReadPixels(void *dst) override;
+
+            virtual uint64_t GetHandle() const override;
+
+        private:
+            struct Attachment
+            {
+                VkImage image = VK_NULL_HANDLE;
+                VkDeviceMemory memory = VK_NULL_HANDLE;
+                VkImageView view = VK_NULL_HANDLE;
+            };
+
+            VulkanData *m_data;
+            RenderTargetProperties m_props;
+            VulkanRenderTargetData m_target_data;
+            Attachment m_color, m_depth;
+
+            void CreateAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, Attachment &attachment);
+            void DestroyAttachment(Attachment &attachment);
+            VkFormat ChooseDepthFormat() const;
+        };
+    }
+}
+
+#endif
\ No newline at end of file
@@ -3,12 +3,16 @@
 #ifdef RUT_HAS_VULKAN
 
 #include"RUT/Context.h"
+#include"RUT/ResidencyManager.h"
 #include"VulkanShader.h"
 #include"VulkanMesh.h"
 #include"VulkanUniformBuffer.h"
+#include"VulkanRenderTarget.h"
 
 #include<stdexcept>
+#include<algorithm>
 #include<cstring>
+#include<string>
 
 static const VkCullModeFlagBits CULL_MODE_TO_BITS[] =
 {
@@ -27,7 +31,27 @@ static const VkFormat VERTEX_TYPE_TO_VK_FORMAT[] =
     VK_FORMAT_R32G32B32_SINT,
     VK_FORMAT_R32G32B32_SFLOAT,
     VK_FORMAT_R32G32B32A32_SINT,
-    VK_FORMAT_R32G32B32A32_SFLOAT
+    VK_FORMAT_R32G32B32A32_SFLOAT,
+    VK_FORMAT_UNDEFINED,
+    VK_FORMAT_UNDEFINED,
+    VK_FORMAT_R16G16_SFLOAT,
+    VK_FORMAT_R16G16B16A16_SFLOAT,
+    VK_FORMAT_R8G8B8A8_UNORM,
+    VK_FORMAT_R8G8B8A8_SNORM,
+    VK_FORMAT_R16G16_UNORM,
+    VK_FORMAT_R16G16_SNORM,
+    VK_FORMAT_R16G16B16A16_UNORM,
+    VK_FORMAT_R16G16B16A16_SNORM,
+    VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+    VK_FORMAT_A2B10G10R10_SNORM_PACK32
+};
+
+// Indexed by rut::DepthMode
+static const VkCompareOp DEPTH_MODE_TO_COMPARE_OP[] =
+{
+    VK_COMPARE_OP_ALWAYS,
+    VK_COMPARE_OP_LESS,
+    VK_COMPARE_OP_GREATER
 };
 
 namespace rut
@@ -36,8 +60,7 @@ namespace rut
     {
         VulkanRenderer::VulkanRenderer(Context *context, const RendererProperties &props):
             m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
-            m_props(props),
-            m_cached_extent(m_data->swapchain_extent)
+            m_props(props)
         {
             std::shared_ptr<VulkanShaderProgram> vk_program = std::dynamic_pointer_cast<VulkanShaderProgram>(m_props.shader);
 
@@ -49,68 +72,122 @@ namespace rut
             if (vkCreateDescriptorSetLayout(m_data->device, &descriptor_layout_create_info, nullptr, &m_descriptor_set_layout) != VK_SUCCESS)
                 throw std::runtime_error("Error creating Vulkan renderer: vkCreateDescriptorSetLayout failed");
             
-            VkDescriptorPoolSize pool_size;
-            pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            pool_size.descriptorCount = MAX_FRAMES_IN_FLIGHT * vk_program->GetLayoutBindings().size();
-
-            VkDescriptorPoolCreateInfo descriptor_pool_create_info{};
-            descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-            descriptor_pool_create_info.poolSizeCount = 1;
-            descriptor_pool_create_info.pPoolSizes = &pool_size;
-            descriptor_pool_create_info.maxSets = MAX_FRAMES_IN_FLIGHT;
-
-            if (vkCreateDescriptorPool(m_data->device, &descriptor_pool_create_info, nullptr, &m_descriptor_pool) != VK_SUCCESS)
-                throw std::runtime_error("Error creating Vulkan renderer: vkCreateDescriptorPool failed");
+            // Dynamic offsets are given in binding order
+            for (const VkDescriptorSetLayoutBinding &binding : vk_program->GetLayoutBindings())
+                m_uniform_bindings.push_back(binding.binding);
+            std::sort(m_uniform_bindings.begin(), m_uniform_bindings.end());
+            m_dynamic_offsets.resize(m_uniform_bindings.size(), 0);
+
+            m_descriptor_frames.resize(MAX_FRAMES_IN_FLIGHT);
+            for (DescriptorFrame &frame : m_descriptor_frames)
+                frame.buffers.resize(m_uniform_bindings.size(), VK_NULL_HANDLE);
+
+            VkPipelineLayoutCreateInfo layout_create_info{};
+            layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            layout_create_info.setLayoutCount = 1;
+            layout_create_info.pSetLayouts = &m_descriptor_set_layout;
+            layout_create_info.pushConstantRangeCount = 0; // Optional
+            layout_create_info.pPushConstantRanges = nullptr; // Optional
+
+            if (vkCreatePipelineLayout(m_data->device, &layout_create_info, nullptr, &m_pipeline_layout) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan renderer: vkCreatePipelineLayout failed");
+        }
+
+        // Matching inputs only depends on the format and the element names
+        static bool HasSameInputs(const VertexLayout &a, const VertexLayout &b)
+        {
+            if (!a.HasSameFormat(b))
+                return false;
             
-            std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, m_descriptor_set_layout);
+            for (size_t i = 0; i < a.GetNumEntries(); ++i)
+            {
+                if (a[i].name_hash != b[i].name_hash)
+                    return false;
+            }
+
+            return true;
+        }
 
-            VkDescriptorSetAllocateInfo descriptor_set_alloc_info{};
-            descriptor_set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-            descriptor_set_alloc_info.descriptorPool = m_descriptor_pool;
-            descriptor_set_alloc_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
-            descriptor_set_alloc_info.pSetLayouts = layouts.data();
+        VkPipeline VulkanRenderer::GetPipeline(const VertexLayout &layout)
+        {
+            uint64_t hash = layout.GetFormatHash();
 
-            m_descriptor_sets.resize(MAX_FRAMES_IN_FLIGHT);
-            if (vkAllocateDescriptorSets(m_data->device, &descriptor_set_alloc_info, &m_descriptor_sets[0]) != VK_SUCCESS)
-                throw std::runtime_error("Error creating Vulkan renderer: vkAllocateDescriptorSets failed");
+            // Consecutive draws mostly share their layout
+            const LayoutPipeline *last = m_last_layout_pipeline;
+            if (last && last->hash == hash && last->render_pass == m_render_pass && HasSameInputs(last->layout, layout))
+                return last->pipeline;
+            
+            auto range = m_layout_pipelines.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second.render_pass == m_render_pass && HasSameInputs(it->second.layout, layout))
+                {
+                    m_last_layout_pipeline = &it->second;
+                    return it->second.pipeline;
+                }
+            }
 
-            SetupPipeline();
+            VkPipeline pipeline = MatchPipeline(layout);
+            auto it = m_layout_pipelines.emplace(hash, LayoutPipeline{ hash, m_render_pass, layout, pipeline });
+            m_last_layout_pipeline = &it->second;
+            return pipeline;
         }
 
-        void VulkanRenderer::SetupPipeline()
+        VkPipeline VulkanRenderer::MatchPipeline(const VertexLayout &layout)
         {
-            if (m_have_pipline)
+            std::vector<const LayoutEntry*> entries = layout.MatchInputs(m_props.shader->GetProperties().input_layout);
+
+            PipelineKey key;
+            key.first = m_render_pass;
+            key.second.reserve(entries.size() * 4);
+            for (const LayoutEntry *entry : entries)
             {
-                vkDestroyPipeline(m_data->device, m_pipeline, nullptr);
-                vkDestroyPipelineLayout(m_data->device, m_pipeline_layout, nullptr);
+                key.second.push_back(entry->stream);
+                key.second.push_back(entry->offset);
+                key.second.push_back(entry->type);
+                key.second.push_back(layout.GetStreamStride(entry->stream));
             }
 
-            m_have_pipline = true;
+            auto it = m_pipelines.find(key);
+            if (it != m_pipelines.end())
+                return it->second;
 
-            VkVertexInputBindingDescription input_binding_desc{};
-            input_binding_desc.binding = 0;
-            input_binding_desc.stride = m_props.shader->GetProperties().input_layout.GetStride();
-            input_binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            // One binding per vertex stream the shader reads from, the others are not fetched
+            std::vector<VkVertexInputBindingDescription> input_binding_descs;
+            for (uint32_t i = 0; i < layout.GetNumStreams(); ++i)
+            {
+                if (std::none_of(entries.begin(), entries.end(), [i](const LayoutEntry *entry) { return entry->stream == i; }))
+                    continue;
+                
+                VkVertexInputBindingDescription input_binding_desc{};
+                input_binding_desc.binding = i;
+                input_binding_desc.stride = layout.GetStreamStride(i);
+                input_binding_desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+                input_binding_descs.push_back(input_binding_desc);
+            }
 
             std::vector<VkVertexInputAttributeDescription> attribute_descs;
-            uint32_t num_attributes = std::distance(m_props.shader->GetProperties().input_layout.begin(), m_props.shader->GetProperties().input_layout.end());
+            uint32_t num_attributes = static_cast<uint32_t>(entries.size());
             attribute_descs.reserve(num_attributes);
 
             uint32_t index = 0;
-            for (const auto &item : m_props.shader->GetProperties().input_layout)
+            for (const LayoutEntry *item : entries)
             {
                 VkVertexInputAttributeDescription attribute_desc{};
-                attribute_desc.binding = 0;
+                attribute_desc.binding = item->stream;
                 attribute_desc.location = index++;
-                attribute_desc.offset = item.GetOffset();
-                attribute_desc.format = VERTEX_TYPE_TO_VK_FORMAT[item.GetType()];
+                attribute_desc.offset = item->offset;
+                attribute_desc.format = VERTEX_TYPE_TO_VK_FORMAT[item->type];
+                if (attribute_desc.format == VK_FORMAT_UNDEFINED)
+                    throw std::runtime_error("Error creating Vulkan renderer: Matrix vertex attributes are not supported");
+                
                 attribute_descs.push_back(attribute_desc);
             }
 
             VkPipelineVertexInputStateCreateInfo vertex_input_create_info{};
             vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-            vertex_input_create_info.vertexBindingDescriptionCount = 1;
-            vertex_input_create_info.pVertexBindingDescriptions = &input_binding_desc;
+            vertex_input_create_info.vertexBindingDescriptionCount = input_binding_descs.size();
+            vertex_input_create_info.pVertexBindingDescriptions = input_binding_descs.data();
             vertex_input_create_info.vertexAttributeDescriptionCount = num_attributes;
             vertex_input_create_info.pVertexAttributeDescriptions = attribute_descs.data();
 
@@ -119,24 +196,13 @@ namespace rut
             input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
             input_assembly_create_info.primitiveRestartEnable = VK_FALSE;
 
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = static_cast<float>(m_data->swapchain_extent.width);
-            viewport.height = static_cast<float>(m_data->swapchain_extent.height);
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-
-            VkRect2D scissor{};
-            scissor.offset = { 0, 0 };
-            scissor.extent = m_data->swapchain_extent;
-
+            // Viewport and scissor are set per pass, so targets of any size share the pipeline
             VkPipelineViewportStateCreateInfo viewport_create_info{};
             viewport_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
             viewport_create_info.viewportCount = 1;
-            viewport_create_info.pViewports = &viewport;
+            viewport_create_info.pViewports = nullptr;
             viewport_create_info.scissorCount = 1;
-            viewport_create_info.pScissors = &scissor;
+            viewport_create_info.pScissors = nullptr;
 
             VkPipelineRasterizationStateCreateInfo rasterizer_create_info{};
             rasterizer_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -203,26 +269,25 @@ namespace rut
             color_blend_create_info.blendConstants[2] = 0.0f; // Optional
             color_blend_create_info.blendConstants[3] = 0.0f; // Optional
 
-            /*std::vector<VkDynamicState> dynamic_states =
+            std::vector<VkDynamicState> dynamic_states =
             {
                 VK_DYNAMIC_STATE_VIEWPORT,
-                VK_DYNAMIC_STATE_LINE_WIDTH
+                VK_DYNAMIC_STATE_SCISSOR
             };
 
             VkPipelineDynamicStateCreateInfo dynamic_state_create_info{};
             dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
             dynamic_state_create_info.dynamicStateCount = dynamic_states.size();
-            dynamic_state_create_info.pDynamicStates = dynamic_states.data();*/
-
-            VkPipelineLayoutCreateInfo layout_create_info{};
-            layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            layout_create_info.setLayoutCount = 1;
-            layout_create_info.pSetLayouts = &m_descriptor_set_layout;
-            layout_create_info.pushConstantRangeCount = 0; // Optional
-            layout_create_info.pPushConstantRanges = nullptr; // Optional
-
-            if (vkCreatePipelineLayout(m_data->device, &layout_create_info, nullptr, &m_pipeline_layout) != VK_SUCCESS)
-                throw std::runtime_error("Error creating Vulkan renderer: vkCreatePipelineLayout failed");
+            dynamic_state_create_info.pDynamicStates = dynamic_states.data();
+
+            // Only render passes with a depth attachment test depth
+            VkPipelineDepthStencilStateCreateInfo depth_stencil_create_info{};
+            depth_stencil_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+            depth_stencil_create_info.depthTestEnable = m_props.depth_props.mode != DM_NONE;
+            depth_stencil_create_info.depthWriteEnable = m_props.depth_props.enable_write;
+            depth_stencil_create_info.depthCompareOp = DEPTH_MODE_TO_COMPARE_OP[m_props.depth_props.mode];
+            depth_stencil_create_info.depthBoundsTestEnable = VK_FALSE;
+            depth_stencil_create_info.stencilTestEnable = VK_FALSE;
             
             // Create pipeline
             VkGraphicsPipelineCreateInfo pipeline_create_info{};
@@ -237,119 +302,318 @@ namespace rut
             pipeline_create_info.pViewportState = &viewport_create_info;
             pipeline_create_info.pRasterizationState = &rasterizer_create_info;
             pipeline_create_info.pMultisampleState = &multisampling_create_info;
-            pipeline_create_info.pDepthStencilState = nullptr; // Optional
+            pipeline_create_info.pDepthStencilState = m_has_depth ? &depth_stencil_create_info : nullptr;
             pipeline_create_info.pColorBlendState = &color_blend_create_info;
-            pipeline_create_info.pDynamicState = nullptr; // Optional
+            pipeline_create_info.pDynamicState = &dynamic_state_create_info;
 
             pipeline_create_info.layout = m_pipeline_layout;
-            pipeline_create_info.renderPass = m_data->render_pass;
+            pipeline_create_info.renderPass = m_render_pass;
             pipeline_create_info.subpass = 0;
             pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE; // Optional
             pipeline_create_info.basePipelineIndex = -1; // Optional
 
-            if (vkCreateGraphicsPipelines(m_data->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &m_pipeline) != VK_SUCCESS)
+            VkPipeline pipeline;
+            if (vkCreateGraphicsPipelines(m_data->device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS)
                 throw std::runtime_error("Error creating Vulkan context: vkCreateGraphicsPipelines failed");
+
+            m_pipelines[key] = pipeline;
+            return pipeline;
         }
 
         VulkanRenderer::~VulkanRenderer()
         {
             vkDeviceWaitIdle(m_data->device);
 
-            vkDestroyDescriptorPool(m_data->device, m_descriptor_pool, nullptr);
-            vkDestroyDescriptorSetLayout(m_data->device, m_descriptor_set_layout, nullptr);
-            
-            if (m_have_pipline)
+            for (const DescriptorFrame &frame : m_descriptor_frames)
             {
-                vkDestroyPipeline(m_data->device, m_pipeline, nullptr);
-                vkDestroyPipelineLayout(m_data->device, m_pipeline_layout, nullptr);
+                for (VkDescriptorPool pool : frame.pools)
+                    vkDestroyDescriptorPool(m_data->device, pool, nullptr);
             }
+
+            vkDestroyDescriptorSetLayout(m_data->device, m_descriptor_set_layout, nullptr);
+            
+            for (const auto &entry : m_pipelines)
+                vkDestroyPipeline(m_data->device, entry.second, nullptr);
+            vkDestroyPipelineLayout(m_data->device, m_pipeline_layout, nullptr);
         }
     
         const RendererProperties &VulkanRenderer::GetProperties() const { return m_props; }
 
-        void VulkanRenderer::Begin()
+        RendererStats VulkanRenderer::GetStats() const { return RendererStats(); }
+        void VulkanRenderer::ResetStats() {}
+
+        void VulkanRenderer::Begin() { Begin(nullptr); }
+
+        void VulkanRenderer::Begin(std::shared_ptr<RenderTarget> target)
         {
-            if (m_cached_extent.width != m_data->swapchain_extent.width || m_cached_extent.height != m_data->swapchain_extent.height)
+            // The old swapchain render pass was destroyed, and a new render pass may have been given its handle
+            if (m_swapchain_render_pass != m_data->render_pass)
             {
-                m_cached_extent = m_data->swapchain_extent;
-                SetupPipeline();
+                for (auto it = m_pipelines.begin(); it != m_pipelines.end();)
+                {
+                    if (it->first.first != m_swapchain_render_pass)
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    vkDestroyPipeline(m_data->device, it->second, nullptr);
+                    it = m_pipelines.erase(it);
+                }
+
+                for (auto it = m_layout_pipelines.begin(); it != m_layout_pipelines.end();)
+                {
+                    if (it->second.render_pass == m_swapchain_render_pass)
+                        it = m_layout_pipelines.erase(it);
+                    else
+                        ++it;
+                }
+
+                m_last_layout_pipeline = nullptr;
+                m_swapchain_render_pass = m_data->render_pass;
             }
 
-            std::shared_ptr<VulkanShaderProgram> vk_shader = std::dynamic_pointer_cast<VulkanShaderProgram>(m_props.shader);
-            std::vector<VkDescriptorBufferInfo> buffer_infos;
-            std::vector<VkWriteDescriptorSet> write_sets;
-            buffer_infos.reserve(vk_shader->GetLayoutBindings().size());
-            write_sets.reserve(vk_shader->GetLayoutBindings().size());
-            for (const auto &entry : vk_shader->GetBoundBuffers())
+            VkRenderPass render_pass;
+            VkFramebuffer framebuffer;
+            VkExtent2D extent;
+            bool has_depth;
+            if (target)
             {
-                VkDescriptorBufferInfo buffer_info{};
-                buffer_info.buffer = reinterpret_cast<VulkanUniformBufferData*>(entry.second->GetHandle())->buffers[m_data->current_frame];
-                buffer_info.offset = 0;
-                buffer_info.range = entry.second->GetLayout().GetStride();
-                buffer_infos.push_back(buffer_info);
-
-                VkWriteDescriptorSet write_set{};
-                write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                write_set.dstSet = m_descriptor_sets[m_data->current_frame];
-                write_set.dstBinding = entry.first;
-                write_set.dstArrayElement = 0;
-                write_set.descriptorCount = 1;
-                write_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-                write_set.pBufferInfo = &buffer_infos.back();
-                write_set.pImageInfo = nullptr;
-                write_set.pTexelBufferView = nullptr;
-                write_sets.push_back(write_set);
+                const VulkanRenderTargetData *target_data = reinterpret_cast<const VulkanRenderTargetData*>(target->GetHandle());
+                render_pass = target_data->render_pass;
+                framebuffer = target_data->framebuffer;
+                extent = target_data->extent;
+                has_depth = target_data->has_depth;
             }
+            else
+            {
+                if (!AcquireVulkanSwapchainImage(m_data))
+                    return;
 
-            vkUpdateDescriptorSets(m_data->device, write_sets.size(), write_sets.data(), 0, nullptr);
-            
-            VkCommandBufferBeginInfo command_buffer_begin_info{};
-            command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            command_buffer_begin_info.flags = 0; // Optional
-            command_buffer_begin_info.pInheritanceInfo = nullptr; // Optional
+                render_pass = m_data->render_pass;
+                framebuffer = m_data->swapchain_framebuffers[m_data->current_image_index];
+                extent = m_data->swapchain_extent;
+                has_depth = false;
+            }
+
+            // Throws before the pass is begun if the shader reads a binding without a buffer
+            BindUniforms(true);
+
+            m_render_pass = render_pass;
+            m_has_depth = has_depth;
+            m_bound_pipeline = VK_NULL_HANDLE;
+            m_recording = true;
 
-            if (vkBeginCommandBuffer(m_data->cmd_buffers[m_data->current_frame], &command_buffer_begin_info) != VK_SUCCESS)
-                throw std::runtime_error("Error beginning Vulkan renderer: vkBeginCommandBuffer failed");
-            
             VkRenderPassBeginInfo render_pass_begin_info{};
             render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            render_pass_begin_info.renderPass = m_data->render_pass;
-            render_pass_begin_info.framebuffer = m_data->swapchain_framebuffers[m_data->current_image_index];
+            render_pass_begin_info.renderPass = render_pass;
+            render_pass_begin_info.framebuffer = framebuffer;
             render_pass_begin_info.renderArea.offset = {0, 0};
-            render_pass_begin_info.renderArea.extent = m_data->swapchain_extent;
+            render_pass_begin_info.renderArea.extent = extent;
             
-            //! TODO: make dependent on framebuffer being rendered to
-            VkClearValue clear_value;
-            std::memcpy(clear_value.color.float32, &m_props.clear_props.clear_color[0], 4 * sizeof(float));
-            render_pass_begin_info.clearValueCount = 1;
-            render_pass_begin_info.pClearValues = &clear_value;
-
-            vkCmdBeginRenderPass(m_data->cmd_buffers[m_data->current_frame], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(m_data->cmd_buffers[m_data->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-            vkCmdBindDescriptorSets(m_data->cmd_buffers[m_data->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_descriptor_sets[m_data->current_frame], 0, nullptr);
+            VkClearValue clear_values[2];
+            std::memcpy(clear_values[0].color.float32, &m_props.clear_props.clear_color[0], 4 * sizeof(float));
+            clear_values[1].depthStencil = { m_props.clear_props.clear_depth, 0 };
+            render_pass_begin_info.clearValueCount = has_depth ? 2 : 1;
+            render_pass_begin_info.pClearValues = clear_values;
+
+            VkViewport viewport{};
+            viewport.x = 0.0f;
+            viewport.y = 0.0f;
+            viewport.width = static_cast<float>(extent.width);
+            viewport.height = static_cast<float>(extent.height);
+            viewport.minDepth = 0.0f;
+            viewport.maxDepth = 1.0f;
+
+            VkRect2D scissor{};
+            scissor.offset = { 0, 0 };
+            scissor.extent = extent;
+
+            VkCommandBuffer cmd_buffer = m_data->cmd_buffers[m_data->current_frame];
+            vkCmdBeginRenderPass(cmd_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+            vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+        }
+
+        VkDescriptorSet VulkanRenderer::AllocateDescriptorSet(DescriptorFrame &frame)
+        {
+            // Full pools are kept for the rest of the frame, the next one is tried or created
+            for (;; ++frame.pool_index)
+            {
+                bool created = frame.pool_index == frame.pools.size();
+                if (created)
+                {
+                    VkDescriptorPoolSize pool_size;
+                    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                    pool_size.descriptorCount = SETS_PER_POOL * m_uniform_bindings.size();
+
+                    VkDescriptorPoolCreateInfo pool_create_info{};
+                    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+                    pool_create_info.poolSizeCount = m_uniform_bindings.empty() ? 0 : 1;
+                    pool_create_info.pPoolSizes = &pool_size;
+                    pool_create_info.maxSets = SETS_PER_POOL;
+
+                    VkDescriptorPool pool;
+                    if (vkCreateDescriptorPool(m_data->device, &pool_create_info, nullptr, &pool) != VK_SUCCESS)
+                        throw std::runtime_error("Error binding Vulkan uniform buffers: vkCreateDescriptorPool failed");
+                    
+                    frame.pools.push_back(pool);
+                }
+
+                VkDescriptorSetAllocateInfo alloc_info{};
+                alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+                alloc_info.descriptorPool = frame.pools[frame.pool_index];
+                alloc_info.descriptorSetCount = 1;
+                alloc_info.pSetLayouts = &m_descriptor_set_layout;
+
+                VkDescriptorSet set;
+                if (vkAllocateDescriptorSets(m_data->device, &alloc_info, &set) == VK_SUCCESS)
+                    return set;
+                
+                if (created)
+                    throw std::runtime_error("Error binding Vulkan uniform buffers: vkAllocateDescriptorSets failed");
+            }
+        }
+
+        void VulkanRenderer::BindUniforms(bool force)
+        {
+            DescriptorFrame &frame = m_descriptor_frames[m_data->current_frame];
+
+            // The frame that used these sets last has finished
+            if (frame.frame_index != m_data->frame_index)
+            {
+                for (VkDescriptorPool pool : frame.pools)
+                    vkResetDescriptorPool(m_data->device, pool, 0);
+                
+                frame.frame_index = m_data->frame_index;
+                frame.pool_index = 0;
+                frame.set = VK_NULL_HANDLE;
+            }
+
+            // Every pass reads its own copy of the buffers, so passes of one frame can use different contents
+            bool changed = force;
+            bool rewrite = frame.set == VK_NULL_HANDLE;
+            const auto &bound_buffers = std::dynamic_pointer_cast<VulkanShaderProgram>(m_props.shader)->GetBoundBuffers();
+            for (size_t i = 0; i < m_uniform_bindings.size(); ++i)
+            {
+                auto it = bound_buffers.find(m_uniform_bindings[i]);
+                if (it == bound_buffers.end() || !it->second)
+                    throw std::runtime_error("Error binding Vulkan uniform buffers: No uniform buffer bound to binding " + std::to_string(m_uniform_bindings[i]));
+
+                // Streaming may replace the frame's buffer, so its handle is read afterwards
+                uint32_t offset = std::dynamic_pointer_cast<VulkanUniformBuffer>(it->second)->Stream();
+                changed |= offset != m_dynamic_offsets[i];
+                m_dynamic_offsets[i] = offset;
+
+                VkBuffer buffer = reinterpret_cast<VulkanUniformBufferData*>(it->second->GetHandle())->buffers[m_data->current_frame];
+                rewrite |= buffer != frame.buffers[i];
+                frame.buffers[i] = buffer;
+            }
+
+            // Sets recorded earlier in the frame must not be written again, so changed buffers get a new one
+            if (rewrite)
+            {
+                frame.set = AllocateDescriptorSet(frame);
+
+                std::vector<VkDescriptorBufferInfo> buffer_infos;
+                std::vector<VkWriteDescriptorSet> write_sets;
+                buffer_infos.reserve(m_uniform_bindings.size());
+                write_sets.reserve(m_uniform_bindings.size());
+                for (size_t i = 0; i < m_uniform_bindings.size(); ++i)
+                {
+                    VkDescriptorBufferInfo buffer_info{};
+                    buffer_info.buffer = frame.buffers[i];
+                    buffer_info.offset = 0;
+                    buffer_info.range = bound_buffers.at(m_uniform_bindings[i])->GetLayout().GetStride();
+                    buffer_infos.push_back(buffer_info);
+
+                    VkWriteDescriptorSet write_set{};
+                    write_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    write_set.dstSet = frame.set;
+                    write_set.dstBinding = m_uniform_bindings[i];
+                    write_set.dstArrayElement = 0;
+                    write_set.descriptorCount = 1;
+                    write_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                    write_set.pBufferInfo = &buffer_infos.back();
+                    write_set.pImageInfo = nullptr;
+                    write_set.pTexelBufferView = nullptr;
+                    write_sets.push_back(write_set);
+                }
+
+                vkUpdateDescriptorSets(m_data->device, write_sets.size(), write_sets.data(), 0, nullptr);
+                changed = true;
+            }
+
+            if (changed)
+                vkCmdBindDescriptorSets(m_data->cmd_buffers[m_data->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &frame.set, m_dynamic_offsets.size(), m_dynamic_offsets.data());
         }
 
-        void VulkanRenderer::Render(std::shared_ptr<Mesh> mesh)
+        void VulkanRenderer::Render(std::shared_ptr<Mesh> mesh) { RenderLod(mesh, 0); }
+
+        void VulkanRenderer::RenderLod(std::shared_ptr<Mesh> mesh, uint32_t lod)
         {
+            if (!m_recording)
+                return;
+
+            if (m_props.residency)
+                m_props.residency->Use(mesh.get());
+
+            std::dynamic_pointer_cast<VulkanMesh>(mesh)->Flush(m_data->current_frame);
+
             VulkanMeshData *mesh_data = reinterpret_cast<VulkanMeshData*>(mesh->GetHandle());
-            VkDeviceSize offset = { 0 };
-            vkCmdBindVertexBuffers(m_data->cmd_buffers[m_data->current_frame], 0, 1, &mesh_data->buffers[0], &offset);
+            VkBuffer vertex_buffers[VertexLayout::MAX_STREAMS];
+            VkDeviceSize offsets[VertexLayout::MAX_STREAMS];
+            for (uint32_t i = 0; i < mesh_data->num_streams; ++i)
+            {
+                if (!mesh_data->have_buffers[i])
+                    return;
+                
+                vertex_buffers[i] = mesh_data->buffers[i];
+                offsets[i] = mesh_data->offsets[i] + mesh_data->region_sizes[i] * m_data->current_frame;
+            }
+
+            // Buffers changed since the pass began take effect from this draw on
+            BindUniforms(false);
+
+            // Meshes with streams laid out differently need other vertex input state
+            VkPipeline pipeline = GetPipeline(mesh->GetLayout());
+            if (pipeline != m_bound_pipeline)
+            {
+                vkCmdBindPipeline(m_data->cmd_buffers[m_data->current_frame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                m_bound_pipeline = pipeline;
+            }
+
+            vkCmdBindVertexBuffers(m_data->cmd_buffers[m_data->current_frame], 0, mesh_data->num_streams, vertex_buffers, offsets);
 
-            uint32_t num_vertices = mesh_data->num_vertices;
             if (mesh_data->num_indices > 0)
             {
-                vkCmdBindIndexBuffer(m_data->cmd_buffers[m_data->current_frame], mesh_data->buffers[1], offset, VK_INDEX_TYPE_UINT32);
-                num_vertices = mesh_data->num_indices;
+                uint32_t index_slot = mesh_data->num_streams;
+                VkDeviceSize index_offset = mesh_data->offsets[index_slot] + mesh_data->region_sizes[index_slot] * m_data->current_frame;
+                vkCmdBindIndexBuffer(m_data->cmd_buffers[m_data->current_frame], mesh_data->buffers[index_slot], index_offset, VK_INDEX_TYPE_UINT32);
+
+                uint32_t first = 0, count = mesh_data->num_indices;
+                const std::vector<MeshLod> &lods = mesh->GetLods();
+                if (!lods.empty())
+                {
+                    const MeshLod &range = lods[std::min<size_t>(lod, lods.size() - 1)];
+                    first = range.index_offset;
+                    count = range.index_count;
+                }
+
+                vkCmdDrawIndexed(m_data->cmd_buffers[m_data->current_frame], count, 1, first, 0, 0);
             }
-            
-            vkCmdDraw(m_data->cmd_buffers[m_data->current_frame],num_vertices, 1, 0, 0);
+            else
+                vkCmdDraw(m_data->cmd_buffers[m_data->current_frame], mesh_data->num_vertices, 1, 0, 0);
         }
 
         void VulkanRenderer::End()
         {
+            if (!m_recording)
+                return;
+
+            // The context submits the frame's command buffer
             vkCmdEndRenderPass(m_data->cmd_buffers[m_data->current_frame]);
-            if (vkEndCommandBuffer(m_data->cmd_buffers[m_data->current_frame]) != VK_SUCCESS)
-                throw std::runtime_error("Error ending Vulkan renderer: vkEndCommandBuffer failed");
+            m_recording = false;
         }
     }
 }
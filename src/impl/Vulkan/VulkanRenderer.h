@@ -5,8 +5,13 @@
 #ifdef RUT_HAS_VULKAN
 
 #include"RUT/Renderer.h"
+#include"RUT/Layout.h"
 #include"VulkanUtils.h"
 
+#include<map>
+#include<unordered_map>
+#include<vector>
+
 #include<vulkan/vulkan.h>
 
 namespace rut
@@ -21,22 +26,71 @@ namespace rut
         
             virtual const RendererProperties &GetProperties() const override;
 
+            virtual RendererStats GetStats() const override;
+            virtual void ResetStats() override;
+
             virtual void Begin() override;
+            virtual void Begin(std::shared_ptr<RenderTarget> target) override;
             virtual void Render(std::shared_ptr<Mesh> mesh) override;
+            virtual void RenderLod(std::shared_ptr<Mesh> mesh, uint32_t lod) override;
             virtual void End() override;
         
         private:
             VulkanData *m_data;
             RendererProperties m_props;
-            VkExtent2D m_cached_extent;
-            bool m_have_pipline = false;
             VkPipelineLayout m_pipeline_layout;
             VkDescriptorSetLayout m_descriptor_set_layout;
-            VkPipeline m_pipeline;
-            VkDescriptorPool m_descriptor_pool;
-            std::vector<VkDescriptorSet> m_descriptor_sets;
 
-            void SetupPipeline();
+            // Descriptor sets of one frame in flight. A new set is allocated whenever a binding's buffer changes,
+            // the pools are reset once the frame that used them has finished
+            struct DescriptorFrame
+            {
+                std::vector<VkDescriptorPool> pools;
+                size_t pool_index = 0;
+                uint64_t frame_index = 0;
+                VkDescriptorSet set = VK_NULL_HANDLE;
+                std::vector<VkBuffer> buffers;
+            };
+
+            static const uint32_t SETS_PER_POOL = 16;
+
+            std::vector<DescriptorFrame> m_descriptor_frames;
+
+            // Uniform bindings in ascending order, and the dynamic offset of each buffer's copy currently bound
+            std::vector<uint32_t> m_uniform_bindings;
+            std::vector<uint32_t> m_dynamic_offsets;
+
+            // One pipeline per render pass drawn into and vertex input state, given as the stream, offset, type and stream stride
+            // of the mesh element at each input location. The swapchain's render pass is replaced when the swapchain is
+            typedef std::pair<VkRenderPass, std::vector<uint32_t>> PipelineKey;
+            VkRenderPass m_swapchain_render_pass = VK_NULL_HANDLE;
+            std::map<PipelineKey, VkPipeline> m_pipelines;
+
+            // Pipeline of each vertex layout drawn, so draws skip matching their layout against the shader's inputs.
+            // Keyed by format hash, the layouts are compared on a hit
+            struct LayoutPipeline
+            {
+                uint64_t hash;
+                VkRenderPass render_pass;
+                VertexLayout layout;
+                VkPipeline pipeline;
+            };
+
+            std::unordered_multimap<uint64_t, LayoutPipeline> m_layout_pipelines;
+            const LayoutPipeline *m_last_layout_pipeline = nullptr;
+
+            // Render pass of the current pass, pipelines are bound per mesh
+            VkRenderPass m_render_pass = VK_NULL_HANDLE;
+            bool m_has_depth = false;
+            VkPipeline m_bound_pipeline = VK_NULL_HANDLE;
+
+            // False while the window's swapchain is out of date, draws are skipped then
+            bool m_recording = false;
+
+            VkPipeline GetPipeline(const VertexLayout &layout);
+            VkPipeline MatchPipeline(const VertexLayout &layout);
+            VkDescriptorSet AllocateDescriptorSet(DescriptorFrame &frame);
+            void BindUniforms(bool force);
         };
     }
 }
@@ -21,12 +21,13 @@ namespace rut
 {
     namespace impl
     {
-        VulkanShaderUnit::VulkanShaderUnit(Context *context, ShaderType type, const std::string &source):
+        VulkanShaderUnit::VulkanShaderUnit(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines):
             m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
             m_type(type)
         {
             // Compile
-            CodeBlob blob = GenerateVulkanShader(source, type);
+            CodeBlob blob = GenerateVulkanShader(source, type, defines);
+            ReflectShader(reinterpret_cast<uint32_t*>(blob.data), blob.bytes / sizeof(uint32_t), type, m_reflection);
 
             // Create vulkan shader module
             VkShaderModuleCreateInfo create_info{};
@@ -49,18 +50,48 @@ namespace rut
 
         uint64_t VulkanShaderUnit::GetHandle() const { return reinterpret_cast<uint64_t>(m_module); }
 
+        const ShaderReflection &VulkanShaderUnit::GetReflection() const { return m_reflection; }
+
         VulkanShaderProgram::VulkanShaderProgram(Context *context, const ShaderProgramCreateProperties &create_props):
             m_data(reinterpret_cast<VulkanData*>(context->GetHandle())),
-            m_props(create_props.props)
+            m_props(create_props.props),
+            m_specialization_info{}
         {
+            // Map entries for constant ids a stage does not declare are ignored, so all stages share one info
+            for (const auto &constant : create_props.specialization_constants)
+            {
+                VkSpecializationMapEntry entry{};
+                entry.constantID = constant.id;
+                entry.offset = static_cast<uint32_t>(m_specialization_data.size() * sizeof(uint32_t));
+                entry.size = sizeof(uint32_t);
+                m_specialization_entries.push_back(entry);
+                m_specialization_data.push_back(constant.value);
+            }
+
+            m_specialization_info.mapEntryCount = static_cast<uint32_t>(m_specialization_entries.size());
+            m_specialization_info.pMapEntries = m_specialization_entries.data();
+            m_specialization_info.dataSize = m_specialization_data.size() * sizeof(uint32_t);
+            m_specialization_info.pData = m_specialization_data.data();
+
             //uint32_t uniform_buffer_index = 0;
+            std::vector<const ShaderReflection*> reflections;
+            std::unordered_map<uint32_t, VkShaderStageFlags> binding_stages;
             auto ProcessUnit = [&](VkShaderStageFlagBits bits, std::shared_ptr<ShaderUnit> unit)
             {
+                const ShaderReflection &reflection = std::dynamic_pointer_cast<VulkanShaderUnit>(unit)->GetReflection();
+                reflections.push_back(&reflection);
+                for (const auto &binding : reflection.uniform_bindings)
+                    binding_stages[binding.binding] |= bits;
+                
+                for (const auto &binding : reflection.unsupported_bindings)
+                    binding_stages[binding.binding] |= bits;
+
                 VkPipelineShaderStageCreateInfo create_info{};
                 create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
                 create_info.stage = bits;
                 create_info.module = reinterpret_cast<VkShaderModule>(unit->GetHandle());
                 create_info.pName = "main";
+                create_info.pSpecializationInfo = m_specialization_entries.empty() ? nullptr : &m_specialization_info;
                 m_pipeline_infos.push_back(create_info);
             };
 
@@ -73,14 +104,17 @@ namespace rut
             if (create_props.geometry_shader)
                 ProcessUnit(VK_SHADER_STAGE_GEOMETRY_BIT, create_props.geometry_shader);
             
+            // Layouts not given by the user are taken from the shaders themselves
+            MergeReflection(m_props, reflections.data(), reflections.size());
+
             for (const auto &uniform_binding : m_props.uniform_bindings)
             {
                 VkDescriptorSetLayoutBinding binding{};
                 binding.binding = uniform_binding.binding;
                 binding.descriptorCount = 1;
-                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
                 binding.pImmutableSamplers = nullptr;
-                binding.stageFlags = SHADER_TYPE_TO_STAGE_BITS[uniform_binding.stage];
+                binding.stageFlags = SHADER_TYPE_TO_STAGE_BITS[uniform_binding.stage] | binding_stages[uniform_binding.binding];
 
                 m_layout_bindings.push_back(binding);
             }
@@ -6,6 +6,7 @@
 
 #include"RUT/Shader.h"
 #include"VulkanUtils.h"
+#include"ShaderTools.h"
 
 #include<unordered_map>
 
@@ -23,17 +24,20 @@ namespace rut
         class VulkanShaderUnit : public ShaderUnit
         {
         public:
-            VulkanShaderUnit(Context *context, ShaderType type, const std::string &source);
+            VulkanShaderUnit(Context *context, ShaderType type, const std::string &source, const std::vector<ShaderDefine> &defines);
             virtual ~VulkanShaderUnit();
 
             virtual ShaderType GetType() const override;
 
             virtual uint64_t GetHandle() const override;
+
+            const ShaderReflection &GetReflection() const;
         
         private:
             VulkanData *m_data;
             ShaderType m_type;
             VkShaderModule m_module;
+            ShaderReflection m_reflection;
         };
 
         class VulkanShaderProgram : public ShaderProgram
@@ -56,6 +60,9 @@ namespace rut
             ShaderProgramProperties m_props;
             std::vector<VkPipelineShaderStageCreateInfo> m_pipeline_infos;
             std::vector<VkDescriptorSetLayoutBinding> m_layout_bindings;
+            std::vector<VkSpecializationMapEntry> m_specialization_entries;
+            std::vector<uint32_t> m_specialization_data;
+            VkSpecializationInfo m_specialization_info;
             std::unordered_map<uint32_t, std::shared_ptr<UniformBuffer>> m_bound_buffers;
         };
     }
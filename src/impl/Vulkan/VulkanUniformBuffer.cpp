@@ -8,16 +8,6 @@
 #include<algorithm>
 #include<cstring>
 
-static const uint32_t VERTEX_TYPE_BYTES[] =
-{
-    4, 4, 8, 8, 12, 12, 16, 16, 44, 64
-};
-
-static const uint32_t VERTEX_TYPE_COUNTS[] =
-{
-    1, 1, 2, 2, 3, 3, 4, 4, 9, 16
-};
-
 namespace rut
 {
     namespace impl
@@ -34,129 +24,131 @@ namespace rut
         {
             m_data = reinterpret_cast<VulkanData*>(context->GetHandle());
 
-            // Setup layout
-            uint32_t offset = 0;
-            for (auto &item : m_layout)
-            {
-                uint32_t alignment;
-                switch (item->GetType())
-                {
-                    case VT_INT:
-                    case VT_FLOAT:
-                        alignment = 4;
-                        break;
-                    
-                    case VT_IVEC2:
-                    case VT_FVEC2:
-                        alignment = 8;
-                        break;
-
-                    case VT_IVEC3:
-                    case VT_FVEC3:
-                    case VT_IVEC4:
-                    case VT_FVEC4:
-                    case VT_MAT3:
-                    case VT_MAT4:
-                        alignment = 16;
-                        break;
-                }
+            m_shadow.resize(m_layout.GetStride());
+            m_mapped_data = m_shadow.data();
 
-                // Alignment
-                uint32_t low_boundary = (offset / alignment) * alignment;
-                if (low_boundary < offset)
-                {
-                    // Add padding
-                    offset = low_boundary + alignment;
-                }
+            // Dynamic offsets have to be aligned
+            VkPhysicalDeviceProperties device_props;
+            vkGetPhysicalDeviceProperties(m_data->physical_device, &device_props);
+            VkDeviceSize alignment = std::max<VkDeviceSize>(device_props.limits.minUniformBufferOffsetAlignment, 1);
+            m_buffer_data.slot_size = (m_layout.GetStride() + alignment - 1) / alignment * alignment;
 
-                item->SetOffset(offset);
-                item->SetSize(VERTEX_TYPE_BYTES[item->GetType()]);
-                if (item->GetLength() > 1)
-                {
-                    dynamic_cast<UniformArrayLayoutItem*>(item)->SetStride(alignment);
-                    item->SetSize(alignment * item->GetLength());
-                }
-                if (item->GetType() == VT_MAT3 || item->GetType() == VT_MAT4)
-                {
-                    UniformMatrixLayoutItem *mat_item = dynamic_cast<UniformMatrixLayoutItem*>(item);
-                    mat_item->SetStride(4 * sizeof(float));
-                }
+            m_buffer_data.buffers.resize(MAX_FRAMES_IN_FLIGHT);
+            m_buffer_data.memorys.resize(MAX_FRAMES_IN_FLIGHT);
+            m_buffer_data.mapped.resize(MAX_FRAMES_IN_FLIGHT);
+            m_buffer_data.num_slots.resize(MAX_FRAMES_IN_FLIGHT);
+            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+                CreateFrameBuffer(i, INITIAL_SLOTS);
+        }
 
-                offset += item->GetSize();
-            }
-            m_layout.SetStride(offset);
+        VulkanUniformBuffer::~VulkanUniformBuffer()
+        {
+            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+                DestroyBuffer(m_buffer_data.buffers[i], m_buffer_data.memorys[i]);
+            
+            for (const RetiredBuffer &retired : m_retired)
+                DestroyBuffer(retired.buffer, retired.memory);
+        }
 
+        void VulkanUniformBuffer::CreateFrameBuffer(uint32_t frame, uint32_t num_slots)
+        {
             VulkanQueueFamilyIndices indices;
             GetVulkanQueueFamilies(m_data->physical_device, m_data->surface, indices);
 
-            m_buffer_data.buffers.resize(MAX_FRAMES_IN_FLIGHT);
-            m_buffer_data.memorys.resize(MAX_FRAMES_IN_FLIGHT);
-            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+            VkDeviceSize size = m_buffer_data.slot_size * num_slots;
+
+            VkBufferCreateInfo create_info{};
+            create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            create_info.queueFamilyIndexCount = 1;
+            create_info.pQueueFamilyIndices = &indices.graphics_family.value();
+            create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+            create_info.size = size;
+            
+            if (vkCreateBuffer(m_data->device, &create_info, nullptr, &m_buffer_data.buffers[frame]) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan uniform buffer: vkCreateBuffer failed");
+            
+            VkMemoryRequirements mem_requirements;
+            vkGetBufferMemoryRequirements(m_data->device, m_buffer_data.buffers[frame], &mem_requirements);
+
+            VkMemoryAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.memoryTypeIndex = GetVulkanMemoryType(m_data->physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            alloc_info.allocationSize = mem_requirements.size;
+            
+            if (vkAllocateMemory(m_data->device, &alloc_info, nullptr, &m_buffer_data.memorys[frame]) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan uniform buffer: vkAllocateMemory failed");
+            
+            vkBindBufferMemory(m_data->device, m_buffer_data.buffers[frame], m_buffer_data.memorys[frame], 0);
+
+            // Host coherent memory stays mapped for the lifetime of the buffer
+            if (vkMapMemory(m_data->device, m_buffer_data.memorys[frame], 0, size, 0, &m_buffer_data.mapped[frame]) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan uniform buffer: vkMapMemory failed");
+            
+            m_buffer_data.num_slots[frame] = num_slots;
+        }
+
+        void VulkanUniformBuffer::DestroyBuffer(VkBuffer buffer, VkDeviceMemory memory)
+        {
+            vkUnmapMemory(m_data->device, memory);
+            vkFreeMemory(m_data->device, memory, nullptr);
+            vkDestroyBuffer(m_data->device, buffer, nullptr);
+        }
+
+        const UniformLayout &VulkanUniformBuffer::GetLayout() const { return m_layout; }
+
+        void VulkanUniformBuffer::Map() {}
+
+        void VulkanUniformBuffer::Unmap()
+        {
+            // Copies already recorded into the frame stay as they are, the next pass or draw streams a new one
+            if (IsDirty())
             {
-                VkBufferCreateInfo create_info{};
-                create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-                create_info.queueFamilyIndexCount = 1;
-                create_info.pQueueFamilyIndices = &indices.graphics_family.value();
-                create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-                create_info.size = m_layout.GetStride();
-                
-                if (vkCreateBuffer(m_data->device, &create_info, nullptr, &m_buffer_data.buffers[i]) != VK_SUCCESS)
-                    throw std::runtime_error("Error creating Vulkan uniform buffer: vkCreateBuffer failed");
-                
-                VkMemoryRequirements mem_requirements;
-                vkGetBufferMemoryRequirements(m_data->device, m_buffer_data.buffers[i], &mem_requirements);
-
-                VkMemoryAllocateInfo alloc_info{};
-                alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                alloc_info.memoryTypeIndex = GetVulkanMemoryType(m_data->physical_device, mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-                alloc_info.allocationSize = mem_requirements.size;
-                
-                if (vkAllocateMemory(m_data->device, &alloc_info, nullptr, &m_buffer_data.memorys[i]) != VK_SUCCESS)
-                    throw std::runtime_error("Error creating Vulkan uniform buffer: vkAllocateMemory failed");
-                
-                vkBindBufferMemory(m_data->device, m_buffer_data.buffers[i], m_buffer_data.memorys[i], 0);
+                m_changed = true;
+                ClearDirty();
             }
         }
 
-        VulkanUniformBuffer::~VulkanUniformBuffer()
+        uint32_t VulkanUniformBuffer::Stream()
         {
-            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+            uint32_t frame = m_data->current_frame;
+
+            // The frame that used this frame's slots last has finished, and so have the ones buffers were retired in
+            if (m_stream_frame_index != m_data->frame_index)
             {
-                vkFreeMemory(m_data->device, m_buffer_data.memorys[i], nullptr);
-                vkDestroyBuffer(m_data->device, m_buffer_data.buffers[i], nullptr);
+                m_stream_frame_index = m_data->frame_index;
+                m_next_slot = 0;
+                m_changed = true;
+
+                for (auto it = m_retired.begin(); it != m_retired.end();)
+                {
+                    if (m_data->frame_index - it->frame_index < MAX_FRAMES_IN_FLIGHT)
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    DestroyBuffer(it->buffer, it->memory);
+                    it = m_retired.erase(it);
+                }
             }
-        }
 
-        const UniformLayout &VulkanUniformBuffer::GetLayout() const { return m_layout; }
+            if (!m_changed)
+                return m_stream_offset;
+            
+            // Draws recorded earlier in the frame keep reading the full buffer, so it is replaced by one twice the size
+            if (m_next_slot == m_buffer_data.num_slots[frame])
+            {
+                m_retired.push_back({ m_buffer_data.buffers[frame], m_buffer_data.memorys[frame], m_data->frame_index });
+                CreateFrameBuffer(frame, m_buffer_data.num_slots[frame] * 2);
+                m_next_slot = 0;
+            }
 
-        void VulkanUniformBuffer::Map() { vkMapMemory(m_data->device, m_buffer_data.memorys[m_data->current_frame], 0, m_layout.GetStride(), 0, &m_mapped_data); }
-        void VulkanUniformBuffer::Unmap() { vkUnmapMemory(m_data->device, m_buffer_data.memorys[m_data->current_frame]); }
-        
-#define SET_UNIFORM(name, value)\
-auto itr = std::find_if(m_layout.begin(), m_layout.end(), [&](LayoutItem *item){ return item->GetName() == name; });\
-if (itr == m_layout.end()) return;\
-(*itr)->Write(reinterpret_cast<uint8_t*>(m_mapped_data) + (*itr)->GetOffset(), value);
-
-        void VulkanUniformBuffer::SetVariable(const std::string &name, int i)               { SET_UNIFORM(name, &i); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, float f)             { SET_UNIFORM(name, &f); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec2 &v) { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec2 &v)  { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec3 &v) { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec3 &v)  { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec4 &v) { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec4 &v)  { SET_UNIFORM(name, &v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::mat3 &m)  { SET_UNIFORM(name, &m); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::mat4 &m)  { SET_UNIFORM(name, &m); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const int *i)        { SET_UNIFORM(name, i); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const float *f)      { SET_UNIFORM(name, f); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec2 *v) { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec2 *v)  { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec3 *v) { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec3 *v)  { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::ivec4 *v) { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::vec4 *v)  { SET_UNIFORM(name, v); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::mat3 *m)  { SET_UNIFORM(name, m); }
-        void VulkanUniformBuffer::SetVariable(const std::string &name, const glm::mat4 *m)  { SET_UNIFORM(name, m); }
+            m_stream_offset = static_cast<uint32_t>(m_next_slot++ * m_buffer_data.slot_size);
+            std::memcpy(reinterpret_cast<uint8_t*>(m_buffer_data.mapped[frame]) + m_stream_offset, m_shadow.data(), m_shadow.size());
+            m_changed = false;
+
+            return m_stream_offset;
+        }
 
         uint64_t VulkanUniformBuffer::GetHandle() const { return reinterpret_cast<uint64_t>(&m_buffer_data); }
     }
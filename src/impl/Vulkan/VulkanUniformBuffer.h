@@ -14,10 +14,15 @@ namespace rut
 {
     namespace impl
     {
+        // One buffer per frame in flight, each holding num_slots copies bound with dynamic offsets.
+        // A frame's buffer is replaced by a larger one when it runs out of slots
         struct VulkanUniformBufferData
         {
             std::vector<VkBuffer> buffers;
             std::vector<VkDeviceMemory> memorys;
+            std::vector<void*> mapped;
+            std::vector<uint32_t> num_slots;
+            VkDeviceSize slot_size;
         };
 
         class VulkanUniformBuffer : public UniformBuffer
@@ -31,36 +36,39 @@ namespace rut
 
             virtual void Map() override;
             virtual void Unmap() override;
-            virtual void SetVariable(const std::string &name, int i) override;
-            virtual void SetVariable(const std::string &name, float f) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec2 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec2 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec3 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec3 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec4 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec4 &v) override;
-            virtual void SetVariable(const std::string &name, const glm::mat3 &m) override;
-            virtual void SetVariable(const std::string &name, const glm::mat4 &m) override;
-            virtual void SetVariable(const std::string &name, const int *i) override;
-            virtual void SetVariable(const std::string &name, const float *f) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec2 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec2 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec3 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec3 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::ivec4 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::vec4 *v) override;
-            virtual void SetVariable(const std::string &name, const glm::mat3 *m) override;
-            virtual void SetVariable(const std::string &name, const glm::mat4 *m) override;
 
             virtual uint64_t GetHandle() const override;
+
+            // Copies the contents into the next free slot of the current frame and returns its dynamic offset.
+            // Returns the latest copy's offset if it is still current. May replace the current frame's buffer
+            uint32_t Stream();
         
         private:
             VulkanData *m_data;
             UniformLayout m_layout;
             VulkanUniformBufferData m_buffer_data;
-            void *m_mapped_data;
+            std::vector<uint8_t> m_shadow;
+
+            // Replaced buffers, destroyed once the frame they were retired in has finished
+            struct RetiredBuffer
+            {
+                VkBuffer buffer;
+                VkDeviceMemory memory;
+                uint64_t frame_index;
+            };
+
+            static const uint32_t INITIAL_SLOTS = 4;
+
+            std::vector<RetiredBuffer> m_retired;
+
+            bool m_changed = true;
+            uint64_t m_stream_frame_index = 0;
+            uint32_t m_next_slot = 0;
+            uint32_t m_stream_offset = 0;
 
             void Init(Context *context);
+            void CreateFrameBuffer(uint32_t frame, uint32_t num_slots);
+            void DestroyBuffer(VkBuffer buffer, VkDeviceMemory memory);
         };
     }
 }
@@ -2,8 +2,10 @@
 
 #ifdef RUT_HAS_VULKAN
 
+#include"VulkanBufferHeap.h"
 #include"RUT/Api.h"
 
+#include<algorithm>
 #include<stdexcept>
 #include<vector>
 #include<cstring>
@@ -165,6 +167,203 @@ namespace rut
             throw std::runtime_error("Error getting Vulkan physical device memory type: No suitable memory type found");
         }
 
+        void CreateVulkanBuffer(VulkanData *data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer &buffer, VkDeviceMemory &memory)
+        {
+            VkBufferCreateInfo buffer_create_info{};
+            buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            buffer_create_info.usage = usage;
+            buffer_create_info.size = size;
+            buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateBuffer(data->device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan buffer: vkCreateBuffer failed");
+            
+            VkMemoryRequirements mem_requirements;
+            vkGetBufferMemoryRequirements(data->device, buffer, &mem_requirements);
+
+            VkMemoryAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            alloc_info.allocationSize = mem_requirements.size;
+            alloc_info.memoryTypeIndex = GetVulkanMemoryType(data->physical_device, mem_requirements.memoryTypeBits, flags);
+
+            if (vkAllocateMemory(data->device, &alloc_info, nullptr, &memory) != VK_SUCCESS)
+            {
+                vkDestroyBuffer(data->device, buffer, nullptr);
+                throw std::runtime_error("Error creating Vulkan buffer: vkAllocateMemory failed");
+            }
+            
+            vkBindBufferMemory(data->device, buffer, memory, 0);
+        }
+
+        void CopyVulkanBuffer(VulkanData *data, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset)
+        {
+            VulkanBufferCopy copy{};
+            copy.src = src;
+            copy.dst = dst;
+            copy.region.dstOffset = dst_offset;
+            copy.region.size = size;
+            CopyVulkanBuffers(data, &copy, 1);
+        }
+
+        void CopyVulkanBuffers(VulkanData *data, const VulkanBufferCopy *copies, uint32_t num_copies)
+        {
+            VkCommandBuffer cmd_buffer = BeginVulkanCommands(data);
+
+            for (uint32_t i = 0; i < num_copies; ++i)
+                vkCmdCopyBuffer(cmd_buffer, copies[i].src, copies[i].dst, 1, &copies[i].region);
+
+            SubmitVulkanCommands(data, cmd_buffer);
+        }
+
+        VkCommandBuffer BeginVulkanCommands(VulkanData *data)
+        {
+            VkCommandBufferAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool = data->cmd_pool;
+            alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            alloc_info.commandBufferCount = 1;
+
+            VkCommandBuffer cmd_buffer;
+            if (vkAllocateCommandBuffers(data->device, &alloc_info, &cmd_buffer) != VK_SUCCESS)
+                throw std::runtime_error("Error recording Vulkan commands: vkAllocateCommandBuffers failed");
+            
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(cmd_buffer, &begin_info);
+
+            return cmd_buffer;
+        }
+
+        void SubmitVulkanCommands(VulkanData *data, VkCommandBuffer cmd_buffer)
+        {
+            vkEndCommandBuffer(cmd_buffer);
+
+            VkSubmitInfo submit_info{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &cmd_buffer;
+
+            VkResult result = vkQueueSubmit(data->graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+            if (result == VK_SUCCESS)
+                vkQueueWaitIdle(data->graphics_queue);
+            
+            vkFreeCommandBuffers(data->device, data->cmd_pool, 1, &cmd_buffer);
+
+            if (result != VK_SUCCESS)
+                throw std::runtime_error("Error submitting Vulkan commands: vkQueueSubmit failed");
+        }
+
+        void WaitVulkanDeviceIdle(VulkanData *data)
+        {
+            if (data->device_idle)
+                return;
+            
+            vkDeviceWaitIdle(data->device);
+            data->device_idle = true;
+        }
+
+        VkRenderPass GetVulkanOffscreenRenderPass(VulkanData *data, VkFormat color_format, VkFormat depth_format)
+        {
+            auto it = data->offscreen_render_passes.find({ color_format, depth_format });
+            if (it != data->offscreen_render_passes.end())
+                return it->second;
+
+            bool has_depth = depth_format != VK_FORMAT_UNDEFINED;
+
+            VkAttachmentDescription attachment_descs[2]{};
+            attachment_descs[0].format = color_format;
+            attachment_descs[0].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment_descs[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachment_descs[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            attachment_descs[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment_descs[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment_descs[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachment_descs[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+            attachment_descs[1].format = depth_format;
+            attachment_descs[1].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachment_descs[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachment_descs[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment_descs[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment_descs[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment_descs[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            attachment_descs[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            VkAttachmentReference color_attachment_ref{};
+            color_attachment_ref.attachment = 0;
+            color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            VkAttachmentReference depth_attachment_ref{};
+            depth_attachment_ref.attachment = 1;
+            depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            VkSubpassDescription subpass_desc{};
+            subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass_desc.colorAttachmentCount = 1;
+            subpass_desc.pColorAttachments = &color_attachment_ref;
+            subpass_desc.pDepthStencilAttachment = has_depth ? &depth_attachment_ref : nullptr;
+
+            // Earlier passes and copies of the same target finish first, and the copies of ReadPixels wait for the pass
+            VkSubpassDependency subpass_dependencies[2]{};
+            subpass_dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+            subpass_dependencies[0].dstSubpass = 0;
+            subpass_dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+            subpass_dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            subpass_dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+            subpass_dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+            subpass_dependencies[1].srcSubpass = 0;
+            subpass_dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+            subpass_dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            subpass_dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            subpass_dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            subpass_dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            VkRenderPassCreateInfo render_pass_create_info{};
+            render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            render_pass_create_info.attachmentCount = has_depth ? 2 : 1;
+            render_pass_create_info.pAttachments = attachment_descs;
+            render_pass_create_info.subpassCount = 1;
+            render_pass_create_info.pSubpasses = &subpass_desc;
+            render_pass_create_info.dependencyCount = 2;
+            render_pass_create_info.pDependencies = subpass_dependencies;
+
+            VkRenderPass render_pass;
+            if (vkCreateRenderPass(data->device, &render_pass_create_info, nullptr, &render_pass) != VK_SUCCESS)
+                throw std::runtime_error("Error creating Vulkan render target: vkCreateRenderPass failed");
+
+            data->offscreen_render_passes[{ color_format, depth_format }] = render_pass;
+            return render_pass;
+        }
+
+        VkDeviceSize GetVulkanMemoryBudget(VulkanData *data)
+        {
+            if (!data->supports_memory_budget)
+                return 0;
+            
+            auto get_memory_properties = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(data->instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+            if (!get_memory_properties)
+                return 0;
+            
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+            budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+            VkPhysicalDeviceMemoryProperties2 props{};
+            props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            props.pNext = &budget;
+            get_memory_properties(data->physical_device, &props);
+
+            VkDeviceSize total = 0;
+            for (uint32_t i = 0; i < props.memoryProperties.memoryHeapCount; ++i)
+            {
+                if (props.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                    total += budget.heapBudget[i];
+            }
+
+            return total;
+        }
+
         void CreateVulkanInstance(uint32_t num_extensions, const char *const *extensions, VulkanData *dst, uint32_t &version_major, uint32_t &version_minor)
         {
             // Get available extensions
@@ -197,6 +396,20 @@ namespace rut
                     throw std::runtime_error(std::string("Error creating Vulkan context. Requested/Required extension '") + required_extension + "' not available");
             }
 
+            // Needed to query memory budgets on Vulkan 1.0
+            for (const VkExtensionProperties &extension : available_extensions)
+            {
+                if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+                {
+                    auto IsProperties2 = [](const char *name) { return strcmp(name, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0; };
+                    if (std::none_of(necessary_extensions.begin(), necessary_extensions.end(), IsProperties2))
+                        necessary_extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+                    
+                    dst->supports_physical_device_properties2 = true;
+                    break;
+                }
+            }
+
             for (const char *required_layer : REQUIRED_LAYERS)
             {
                 bool found = false;
@@ -336,6 +549,24 @@ namespace rut
             if (data->physical_device == VK_NULL_HANDLE)
                 throw std::runtime_error("Error creating Vulkan context: No suitable physical devices available");
             
+            if (data->supports_physical_device_properties2)
+            {
+                uint32_t num_device_extensions;
+                vkEnumerateDeviceExtensionProperties(data->physical_device, nullptr, &num_device_extensions, nullptr);
+                std::vector<VkExtensionProperties> device_extensions(num_device_extensions);
+                vkEnumerateDeviceExtensionProperties(data->physical_device, nullptr, &num_device_extensions, device_extensions.data());
+
+                for (const VkExtensionProperties &extension : device_extensions)
+                {
+                    if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+                    {
+                        necessary_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+                        data->supports_memory_budget = true;
+                        break;
+                    }
+                }
+            }
+
             // Queues
             VulkanQueueFamilyIndices queue_family_indices;
             GetVulkanQueueFamilies(data->physical_device, data->surface, queue_family_indices);
@@ -377,6 +608,8 @@ namespace rut
             
             vkGetDeviceQueue(data->device, queue_family_indices.graphics_family.value(), 0, &data->graphics_queue);
             vkGetDeviceQueue(data->device, queue_family_indices.present_family.value(), 0, &data->present_queue);
+
+            data->buffer_heap = new VulkanBufferHeap(data);
         }
 
         void SetupVulkanSyncObjects(VulkanData *data)
@@ -599,25 +832,56 @@ namespace rut
             vkResetFences(data->device, 1, &data->in_flight_fences[data->current_frame]);
             vkResetCommandBuffer(data->cmd_buffers[data->current_frame], 0);
 
-            // Get next swapchain image
+            // The frame that used this slot last has finished, so its retired heap ranges can be reused
+            data->buffer_heap->Update();
+
+            // All render passes of the frame are recorded into one command buffer
+            VkCommandBufferBeginInfo command_buffer_begin_info{};
+            command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            if (vkBeginCommandBuffer(data->cmd_buffers[data->current_frame], &command_buffer_begin_info) != VK_SUCCESS)
+                throw std::runtime_error("Error beginning Vulkan context: vkBeginCommandBuffer failed");
+
+            data->swapchain_image_acquired = false;
+            ++data->frame_index;
+        }
+
+        bool AcquireVulkanSwapchainImage(VulkanData *data)
+        {
+            if (data->swapchain_image_acquired)
+                return true;
+
+            if (!data->swapchain_renderable)
+                return false;
+
             VkResult result = vkAcquireNextImageKHR(data->device, data->swapchain, UINT64_MAX, data->image_available_sems[data->current_frame], VK_NULL_HANDLE, &data->current_image_index);
             if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
                 data->swapchain_renderable = false;
+                return false;
+            }
             else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
                 throw std::runtime_error("Error beginning Vulkan context: vkAquireNextImageKHR failed");
+
+            data->swapchain_image_acquired = true;
+            return true;
         }
 
         void EndVulkanContext(VulkanData *data)
         {
-            if (!data->swapchain_renderable)
-                return;
-            
+            if (vkEndCommandBuffer(data->cmd_buffers[data->current_frame]) != VK_SUCCESS)
+                throw std::runtime_error("Error ending Vulkan context: vkEndCommandBuffer failed");
+
+            // Always submitted, so the frame's fence is signaled even if nothing was drawn into the window
+            bool present = data->swapchain_image_acquired;
+
             VkSubmitInfo submit_info{};
             submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
             VkSemaphore wait_semaphores[] = { data->image_available_sems[data->current_frame] };
             VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-            submit_info.waitSemaphoreCount = 1;
+            submit_info.waitSemaphoreCount = present ? 1 : 0;
             submit_info.pWaitSemaphores = wait_semaphores;
             submit_info.pWaitDstStageMask = wait_stages;
 
@@ -625,11 +889,18 @@ namespace rut
             submit_info.pCommandBuffers = &data->cmd_buffers[data->current_frame];
 
             VkSemaphore signal_semaphores[] = { data->render_finished_sems[data->current_frame] };
-            submit_info.signalSemaphoreCount = 1;
+            submit_info.signalSemaphoreCount = present ? 1 : 0;
             submit_info.pSignalSemaphores = signal_semaphores;
 
             if (vkQueueSubmit(data->graphics_queue, 1, &submit_info, data->in_flight_fences[data->current_frame]) != VK_SUCCESS)
-                throw std::runtime_error("Error creating Vulkan context: vkAllocateCommandBuffers failed");
+                throw std::runtime_error("Error ending Vulkan context: vkQueueSubmit failed");
+
+            data->device_idle = false;
+            data->swapchain_image_acquired = false;
+            data->current_frame = (data->current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+            if (!present)
+                return;
 
             VkPresentInfoKHR present_info{};
             present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -643,10 +914,8 @@ namespace rut
             VkResult result = vkQueuePresentKHR(data->present_queue, &present_info);
             if (result == VK_ERROR_OUT_OF_DATE_KHR)
                 data->swapchain_renderable = false;
-            if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+            else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
                 throw std::runtime_error("Error swaping Vulkan buffers: vkQueuePresentKHR failed");
-
-            data->current_frame = (data->current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
         }
 
         void DestroyVulkanInstance(VulkanData *data)
@@ -674,6 +943,13 @@ namespace rut
                 vkDestroySemaphore(data->device, data->render_finished_sems[i], nullptr);
             }
 
+            delete data->buffer_heap;
+            data->buffer_heap = nullptr;
+
+            for (const auto &entry : data->offscreen_render_passes)
+                vkDestroyRenderPass(data->device, entry.second, nullptr);
+            data->offscreen_render_passes.clear();
+
             vkDestroyDevice(data->device, nullptr);
             vkDestroySurfaceKHR(data->instance, data->surface, nullptr);
 
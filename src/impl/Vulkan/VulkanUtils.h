@@ -4,6 +4,8 @@
 
 #ifdef RUT_HAS_VULKAN
 
+#include<map>
+#include<utility>
 #include<vector>
 #include<optional>
 
@@ -15,6 +17,8 @@ namespace rut
 {
     namespace impl
     {
+        class VulkanBufferHeap;
+
         struct VulkanQueueFamilyIndices
         {
             std::optional<uint32_t> graphics_family;
@@ -35,6 +39,10 @@ namespace rut
             VkDevice device;
             VkQueue graphics_queue, present_queue;
 
+            // Optional extensions, enabled when available
+            bool supports_physical_device_properties2 = false;
+            bool supports_memory_budget = false;
+
             bool have_swapchain = false;
             VkSwapchainKHR swapchain;
             VkFormat swapchain_format;
@@ -45,22 +53,62 @@ namespace rut
             uint32_t current_image_index;
             VkRenderPass render_pass;
 
+            // The image is only acquired once something draws into the window, so offscreen-only frames never present
+            bool swapchain_image_acquired = false;
+
+            // Keyed by color and depth format. Kept until the device is destroyed, so renderers can key their pipelines by them
+            std::map<std::pair<VkFormat, VkFormat>, VkRenderPass> offscreen_render_passes;
+
             VkCommandPool cmd_pool;
             std::vector<VkCommandBuffer> cmd_buffers;
 
             std::vector<VkSemaphore> image_available_sems, render_finished_sems;
             std::vector<VkFence> in_flight_fences;
             uint32_t current_frame = 0;
+            uint64_t frame_index = 0;
             bool swapchain_renderable = false;
+
+            // No frame was submitted since the device was last waited on
+            bool device_idle = false;
+
+            // Pools the device local buffers of static and immutable meshes
+            VulkanBufferHeap *buffer_heap = nullptr;
+        };
+
+        struct VulkanBufferCopy
+        {
+            VkBuffer src, dst;
+            VkBufferCopy region;
         };
 
         void GetVulkanQueueFamilies(VkPhysicalDevice physical_device, VkSurfaceKHR surface, VulkanQueueFamilyIndices &indices);
         uint32_t GetVulkanMemoryType(VkPhysicalDevice physical_device, uint32_t filter, VkMemoryPropertyFlags flags);
+        void CreateVulkanBuffer(VulkanData *data, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, VkBuffer &buffer, VkDeviceMemory &memory);
+        void CopyVulkanBuffer(VulkanData *data, VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset = 0);
+
+        // Records all copies into one command buffer and waits for them to finish
+        void CopyVulkanBuffers(VulkanData *data, const VulkanBufferCopy *copies, uint32_t num_copies);
+
+        // One time command buffer outside of the frame's. Submitting waits for it to finish and frees it
+        VkCommandBuffer BeginVulkanCommands(VulkanData *data);
+        void SubmitVulkanCommands(VulkanData *data, VkCommandBuffer cmd_buffer);
+
+        // Waits only if a frame was submitted since the last wait, so a batch of evictions waits once
+        void WaitVulkanDeviceIdle(VulkanData *data);
+
+        // Clears on load, and leaves color ready to be copied from. Pass VK_FORMAT_UNDEFINED for no depth attachment
+        VkRenderPass GetVulkanOffscreenRenderPass(VulkanData *data, VkFormat color_format, VkFormat depth_format);
+
+        // Sum of the device local heap budgets reported by VK_EXT_memory_budget, or 0 without the extension
+        VkDeviceSize GetVulkanMemoryBudget(VulkanData *data);
         void CreateVulkanInstance(uint32_t num_extensions, const char *const *extensions, VulkanData *dst, uint32_t &version_major, uint32_t &version_minor);
         void SetupVulkanDevice(uint32_t num_extensions, const char *const *extensions, VulkanData *data);
         void SetupVulkanSwapchain(uint32_t width, uint32_t height, VulkanData *data);
         void SetupVulkanSyncObjects(VulkanData *data);
         void BeginVulkanContext(VulkanData *data);
+
+        // Acquires this frame's swapchain image unless that already happened. False if the swapchain is out of date
+        bool AcquireVulkanSwapchainImage(VulkanData *data);
         void EndVulkanContext(VulkanData *data);
         void DestroyVulkanInstance(VulkanData *data);
     }
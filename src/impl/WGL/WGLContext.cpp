@@ -51,6 +51,7 @@ namespace rut
 
             // Must wrap wglGetProcAddress due to calling convention
             LoadOpenGLFunctions([](const char *name) -> Proc { return reinterpret_cast<Proc>(wglGetProcAddress(name)); });
+            LoadOpenGLFeatures(&m_data);
 
             if (m_version_major < 3 || (m_version_major == 3 && m_version_minor < 3))
                 throw std::runtime_error("Device only supports OpenGL version " + std::to_string(m_version_major) + "." + std::to_string(m_version_major) + " - a minimum of 3.3 is required.");
@@ -58,6 +59,7 @@ namespace rut
 
         WGLContext::~WGLContext()
         {
+            DestroyOpenGLFeatures(&m_data);
             wglDeleteContext(m_data.context);
         }
 
@@ -70,6 +72,7 @@ namespace rut
         void WGLContext::End()
         {
             wglSwapLayerBuffers(m_data.device, WGL_SWAP_MAIN_PLANE);
+            EndOpenGLFrame(&m_data);
         }
 
         uint64_t WGLContext::GetHandle() const { return reinterpret_cast<uint64_t>(&m_data); }
@@ -5,6 +5,7 @@
 #ifdef RUT_HAS_WGL
 
 #include"RUT/Context.h"
+#include"impl/OpenGL/OpenGLUtils.h"
 
 #include<Windows.h>
 
@@ -12,7 +13,7 @@ namespace rut
 {
     namespace impl
     {
-        struct WGLData
+        struct WGLData : public OpenGLData
         {
             HDC device;
             HGLRC context;
@@ -142,7 +142,8 @@ namespace rut
                 WGLData *data = reinterpret_cast<WGLData*>(m_context->GetHandle());
                 if (!data->context_renderable)
                 {
-                    glViewport(0, 0, m_props.width, m_props.height);
+                    data->default_framebuffer_width = m_props.width;
+                    data->default_framebuffer_height = m_props.height;
                     data->context_renderable = true;
                 }
             }
@@ -153,7 +154,8 @@ namespace rut
                 EGLData *data = reinterpret_cast<EGLData*>(m_context->GetHandle());
                 if (!data->context_renderable)
                 {
-                    glViewport(0, 0, m_props.width, m_props.height);
+                    data->default_framebuffer_width = m_props.width;
+                    data->default_framebuffer_height = m_props.height;
                     data->context_renderable = true;
                 }
             }
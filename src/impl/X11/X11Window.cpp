@@ -174,7 +174,8 @@ namespace rut
                 GLXData *data = reinterpret_cast<GLXData*>(m_context->GetHandle());
                 if (!data->context_renderable)
                 {
-                    glViewport(0, 0, m_props.width, m_props.height);
+                    data->default_framebuffer_width = m_props.width;
+                    data->default_framebuffer_height = m_props.height;
                     data->context_renderable = true;
                 }
             }
@@ -185,7 +186,8 @@ namespace rut
                 EGLData *data = reinterpret_cast<EGLData*>(m_context->GetHandle());
                 if (!data->context_renderable)
                 {
-                    glViewport(0, 0, m_props.width, m_props.height);
+                    data->default_framebuffer_width = m_props.width;
+                    data->default_framebuffer_height = m_props.height;
                     data->context_renderable = true;
                 }
             }
@@ -0,0 +1,232 @@
+#include"RUT/Layout.h"
+#include"RUT/MeshOptimizer.h"
+#include"RUT/MeshLod.h"
+#include"RUT/MeshFile.h"
+
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<sstream>
+#include<stdexcept>
+#include<string>
+#include<vector>
+
+// Converts Wavefront OBJ files into optimized .rutmesh files with LODs, ready for Mesh::LoadFromFile
+
+struct ObjData
+{
+    std::vector<float> positions, normals, uvs;
+
+    // Position, uv and normal index per face corner, -1 where missing. Polygons are fan triangulated
+    std::vector<int64_t> corners;
+};
+
+static int64_t ResolveObjIndex(const std::string &token, size_t count)
+{
+    if (token.empty())
+        return -1;
+
+    int64_t index = std::stoll(token);
+    if (index < 0)
+        index += static_cast<int64_t>(count);
+    else
+        --index;
+
+    if (index < 0 || index >= static_cast<int64_t>(count))
+        throw std::runtime_error("Error parsing OBJ file: Index " + token + " out of range");
+
+    return index;
+}
+
+static ObjData ParseObj(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Error parsing OBJ file: Failed to open '" + path + "'");
+
+    ObjData obj;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+
+        if (keyword == "v")
+        {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            obj.positions.insert(obj.positions.end(), { x, y, z });
+        }
+        else if (keyword == "vn")
+        {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            stream >> x >> y >> z;
+            obj.normals.insert(obj.normals.end(), { x, y, z });
+        }
+        else if (keyword == "vt")
+        {
+            float u = 0.0f, v = 0.0f;
+            stream >> u >> v;
+            obj.uvs.insert(obj.uvs.end(), { u, v });
+        }
+        else if (keyword == "f")
+        {
+            std::vector<int64_t> face;
+            std::string vertex;
+            while (stream >> vertex)
+            {
+                std::string tokens[3];
+                size_t token = 0;
+                for (char c : vertex)
+                {
+                    if (c == '/')
+                    {
+                        if (++token > 2)
+                            throw std::runtime_error("Error parsing OBJ file: Invalid face vertex '" + vertex + "'");
+                    }
+                    else
+                        tokens[token] += c;
+                }
+
+                face.push_back(ResolveObjIndex(tokens[0], obj.positions.size() / 3));
+                face.push_back(ResolveObjIndex(tokens[1], obj.uvs.size() / 2));
+                face.push_back(ResolveObjIndex(tokens[2], obj.normals.size() / 3));
+
+                if (face[face.size() - 3] < 0)
+                    throw std::runtime_error("Error parsing OBJ file: Face vertex '" + vertex + "' without position");
+            }
+
+            for (size_t i = 2; i < face.size() / 3; ++i)
+            {
+                obj.corners.insert(obj.corners.end(), face.begin(), face.begin() + 3);
+                obj.corners.insert(obj.corners.end(), face.begin() + 3 * (i - 1), face.begin() + 3 * (i + 1));
+            }
+        }
+    }
+
+    return obj;
+}
+
+static void PrintUsage()
+{
+    std::cerr << "Usage: rutmesh <input.obj> <output.rutmesh> [--no-optimize] [--no-lods] [--max-lods <count>] [--max-error <fraction>]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> paths;
+    bool optimize = true;
+    rut::LodGeneratorProperties lod_props;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--no-optimize")
+            optimize = false;
+        else if (arg == "--no-lods")
+            lod_props.max_lods = 1;
+        else if (arg == "--max-lods" && i + 1 < argc)
+            lod_props.max_lods = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--max-error" && i + 1 < argc)
+            lod_props.max_error = static_cast<float>(std::atof(argv[++i]));
+        else if (arg.rfind("--", 0) == 0)
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+            paths.push_back(arg);
+    }
+
+    if (paths.size() != 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    try
+    {
+        ObjData obj = ParseObj(paths[0]);
+        if (obj.corners.empty())
+            throw std::runtime_error("Error parsing OBJ file: No faces in '" + paths[0] + "'");
+
+        bool has_uvs = false, has_normals = false;
+        for (size_t i = 0; i < obj.corners.size(); i += 3)
+        {
+            has_uvs |= obj.corners[i + 1] >= 0;
+            has_normals |= obj.corners[i + 2] >= 0;
+        }
+
+        std::vector<rut::VertexLayoutElement> elements = { { "position", rut::VT_FVEC3 } };
+        if (has_uvs)
+            elements.push_back({ "uv", rut::VT_FVEC2 });
+        if (has_normals)
+            elements.push_back({ "normal", rut::VT_FVEC3 });
+
+        rut::VertexLayout layout(elements);
+        size_t floats_per_vertex = layout.GetStride() / sizeof(float);
+
+        // Triangle soup, welded by the optimizer
+        size_t num_vertices = obj.corners.size() / 3;
+        std::vector<float> vertices;
+        vertices.reserve(num_vertices * floats_per_vertex);
+        for (size_t i = 0; i < obj.corners.size(); i += 3)
+        {
+            const float *position = &obj.positions[obj.corners[i] * 3];
+            vertices.insert(vertices.end(), position, position + 3);
+
+            if (has_uvs)
+            {
+                if (obj.corners[i + 1] >= 0)
+                    vertices.insert(vertices.end(), &obj.uvs[obj.corners[i + 1] * 2], &obj.uvs[obj.corners[i + 1] * 2] + 2);
+                else
+                    vertices.insert(vertices.end(), 2, 0.0f);
+            }
+
+            if (has_normals)
+            {
+                if (obj.corners[i + 2] >= 0)
+                    vertices.insert(vertices.end(), &obj.normals[obj.corners[i + 2] * 3], &obj.normals[obj.corners[i + 2] * 3] + 3);
+                else
+                    vertices.insert(vertices.end(), 3, 0.0f);
+            }
+        }
+
+        rut::MeshOptimizerProperties optimizer_props;
+        optimizer_props.optimize_vertex_cache = optimize;
+        optimizer_props.optimize_overdraw = optimize;
+        optimizer_props.optimize_vertex_fetch = optimize;
+
+        rut::MeshOptimizer optimizer(layout, optimizer_props);
+        optimizer.Optimize(num_vertices, vertices.data());
+
+        const rut::MeshOptimizerStats &stats = optimizer.GetStats();
+        std::cout << "Vertices: " << stats.vertices_before << " -> " << stats.vertices_after << ", ACMR: " << stats.acmr_before << " -> " << stats.acmr_after << std::endl;
+
+        const std::vector<uint8_t> &optimized_vertices = optimizer.GetVertices();
+        const std::vector<uint32_t> &optimized_indices = optimizer.GetIndices();
+
+        if (lod_props.max_lods > 1)
+        {
+            rut::LodGenerator lod_generator(layout, lod_props);
+            lod_generator.Generate(optimizer.GetNumVertices(), optimized_vertices.data(), optimized_indices.size(), optimized_indices.data());
+
+            const std::vector<rut::MeshLod> &lods = lod_generator.GetLods();
+            for (size_t i = 0; i < lods.size(); ++i)
+                std::cout << "LOD " << i << ": " << lods[i].index_count / 3 << " triangles, error " << lods[i].error << std::endl;
+
+            rut::MeshFile::Write(paths[1], layout, optimizer.GetNumVertices(), optimized_vertices.data(), lod_generator.GetIndices().size(), lod_generator.GetIndices().data(), lods);
+        }
+        else
+            rut::MeshFile::Write(paths[1], layout, optimizer.GetNumVertices(), optimized_vertices.data(), optimized_indices.size(), optimized_indices.data());
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file